@@ -3,15 +3,33 @@ set(SOURCES
     SOURCE/GRAIN/AnalysisMarker.h
     SOURCE/GRAIN/Grain.cpp
     SOURCE/GRAIN/Grain.h
+    SOURCE/GRAIN/GrainCloud.cpp
+    SOURCE/GRAIN/GrainCloud.h
+    SOURCE/GRAIN/GrainPool.cpp
+    SOURCE/GRAIN/GrainPool.h
+    SOURCE/GRAIN/GrainSchedule.cpp
+    SOURCE/GRAIN/GrainSchedule.h
     SOURCE/GRAIN/Granulator.cpp
     SOURCE/GRAIN/Granulator.h
+    SOURCE/GRAIN/TimeStretcher.cpp
+    SOURCE/GRAIN/TimeStretcher.h
+    SOURCE/GRAIN/WindowCache.cpp
+    SOURCE/GRAIN/WindowCache.h
+    SOURCE/PITCH/AsyncPitchDetector.cpp
+    SOURCE/PITCH/AsyncPitchDetector.h
     SOURCE/PITCH/PitchDetector.cpp
     SOURCE/PITCH/PitchDetector.h
+    SOURCE/PITCH/VoiceRanges.h
     SOURCE/PluginEditor.cpp
     SOURCE/PluginEditor.h
     SOURCE/PluginProcessor.cpp
     SOURCE/PluginProcessor.h
+    SOURCE/Util/CircularReadView.h
     SOURCE/Util/Juce_Header.h
+    SOURCE/Util/PolyphaseResampler.cpp
+    SOURCE/Util/PolyphaseResampler.h
+    SOURCE/Util/SimdKernels.cpp
+    SOURCE/Util/SimdKernels.h
     SOURCE/Util/Version.h
     SUBMODULES/RD/SOURCE/AudioFileHelpers.h
     SUBMODULES/RD/SOURCE/AudioFileProcessor.cpp
@@ -15,8 +15,17 @@ set(TESTS
     SUBMODULES/RD/TESTS/tests_Interpolator.cpp
     TESTS/TEST_UTILS/BufferGenerator.h
     TESTS/TEST_UTILS/TestDefaults.h
+    TESTS/test_AsyncPitchDetector.cpp
+    TESTS/test_CircularReadView.cpp
+    TESTS/test_GrainCloud.cpp
+    TESTS/test_GrainPool.cpp
+    TESTS/test_GrainSchedule.cpp
     TESTS/test_Granulator.cpp
     TESTS/test_PitchDetector.cpp
     TESTS/test_PluginBasics.cpp
     TESTS/test_PluginProcessor.cpp
+    TESTS/test_PolyphaseResampler.cpp
+    TESTS/test_SimdKernels.cpp
+    TESTS/test_TimeStretcher.cpp
+    TESTS/test_WindowCache.cpp
 )
\ No newline at end of file
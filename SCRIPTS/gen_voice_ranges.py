@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Generates SOURCE/PITCH/VoiceRanges.h from NOTES/SATB_Vocal_Ranges.csv
+# usage: python3 SCRIPTS/gen_voice_ranges.py NOTES/SATB_Vocal_Ranges.csv SOURCE/PITCH/VoiceRanges.h
+import sys
+import pathlib
+
+csv_file = pathlib.Path(sys.argv[1])
+header_file = pathlib.Path(sys.argv[2])
+
+ranges = []
+for line in csv_file.read_text().splitlines():
+    cols = [c.strip() for c in line.split(",")]
+    # data rows look like: Soprano , C4 -- A5 , 60 - 81 , 261 - 880 , 183 - 54
+    if len(cols) < 4 or "-" not in cols[3]:
+        continue
+    hz = [h.strip() for h in cols[3].split("-")]
+    if not all(h.isdigit() for h in hz):
+        continue
+    ranges.append((cols[0], cols[1].replace("--", "-"), int(hz[0]), int(hz[1])))
+
+entries = "\n".join(
+    f'\t\tVoiceRange {{ "{name}", {low}.f, {high}.f }}, // {notes}' for name, notes, low, high in ranges
+)
+
+header_file.write_text(f"""/**
+ * VoiceRanges.h
+ * GENERATED by SCRIPTS/gen_voice_ranges.py from NOTES/SATB_Vocal_Ranges.csv, don't edit by hand.
+ *
+ * Frequency bounds for the voice range presets, used to clamp the YIN lag search.
+ */
+
+#pragma once
+#include <array>
+
+namespace VoiceRanges
+{{
+	struct VoiceRange
+	{{
+		const char* name;
+		float minHz;
+		float maxHz;
+	}};
+
+	inline constexpr std::array<VoiceRange, {len(ranges)}> kPresets
+	{{
+{entries}
+	}};
+}} // end namespace VoiceRanges
+""")
@@ -4,7 +4,7 @@
  */
 
 #include "AnalysisMarker.h"
-#include "../SUBMODULES/RD/SOURCE/BufferHelper.h"
+#include "../Util/CircularReadView.h"
 
 AnalysisMarker::AnalysisMarker()
 {
@@ -29,17 +29,12 @@ juce::int64 AnalysisMarker::getNextAnalysisMarkIndex(CircularBuffer& circularBuf
 {
 	if (mIsFirstMark)
 	{
-		// For first mark, find peak within first period from current position
-		// Convert to circular buffer relative position
-		int circBufferSize = circularBuffer.getSize();
-		int startPos = static_cast<int>(absSampleIndex % circBufferSize);
-		int endPos = startPos + static_cast<int>(detectedPeriod);
+		// For first mark, find peak within first period from current position.
+		// The view wraps, so a period that runs past the end of the circular buffer is searched whole.
+		const int numSamples = juce::jlimit(1, circularBuffer.getSize(), static_cast<int>(detectedPeriod) + 1);
+		const int peakOffset = CircularReadView(circularBuffer, absSampleIndex, numSamples).findPeak(0);
 
-		// Find peak in circular buffer
-		juce::AudioBuffer<float>& buffer = circularBuffer.getBuffer();
-		int peakOffset = BufferHelper::getPeakIndex(buffer, startPos, std::min(endPos, circBufferSize - 1));
-
-		mCurrentAbsAnalysisMarkIndex = absSampleIndex + (peakOffset - startPos);
+		mCurrentAbsAnalysisMarkIndex = absSampleIndex + juce::jmax(0, peakOffset);
 		mIsFirstMark = false;
 	}
 	else
@@ -53,20 +48,8 @@ juce::int64 AnalysisMarker::getNextAnalysisMarkIndex(CircularBuffer& circularBuf
 //=======================================
 int AnalysisMarker::getWindowCenterOffset(CircularBuffer& circularBuffer, juce::int64 absAnalysisMarkIndex, float detectedPeriod)
 {
-	int circBufferSize = circularBuffer.getSize();
-	int centerPos = static_cast<int>(absAnalysisMarkIndex % circBufferSize);
-	int radius = static_cast<int>(detectedPeriod / 4.0f);
-
-	juce::AudioBuffer<float>& buffer = circularBuffer.getBuffer();
-
-	int searchStart = centerPos - radius;
-	int searchEnd = centerPos + radius;
-
-	// Handle wrapping for circular buffer
-	if (searchStart < 0) searchStart = 0;
-	if (searchEnd >= circBufferSize) searchEnd = circBufferSize - 1;
-
-	int peakPos = BufferHelper::getPeakIndex(buffer, searchStart, searchEnd, centerPos);
+	const int radius = juce::jmin(static_cast<int>(detectedPeriod / 4.0f), (circularBuffer.getSize() - 1) / 2);
+	const int peakIndex = CircularReadView(circularBuffer, absAnalysisMarkIndex - radius, radius * 2 + 1).findPeak(0);
 
-	return peakPos - centerPos; // Return offset from analysis mark
+	return peakIndex < 0 ? 0 : peakIndex - radius; // Return offset from analysis mark
 }
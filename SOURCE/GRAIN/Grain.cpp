@@ -7,8 +7,6 @@
 
 Grain::Grain()
 {
-	mBuffer.setSize(2, 1024);
-	mBuffer.clear();
 }
 
 Grain::~Grain()
@@ -16,13 +14,19 @@ Grain::~Grain()
 }
 
 //=======================================
-void Grain::prepare(int maxGrainSize, int numChannels)
+void Grain::prepare(const GrainPool& pool)
 {
-	mBuffer.setSize(numChannels, maxGrainSize);
-	mBuffer.clear();
+	mPool = &pool;
+	mPoolIndex = -1;
+}
 
-	mWindowBuffer.setSize(numChannels, maxGrainSize);
-	mWindowBuffer.clear();
+//=======================================
+juce::AudioBuffer<float> Grain::getBuffer() const
+{
+	if (mPool == nullptr || mGrainSize <= 0)
+		return {};
+	// the rest of the slice is whatever a longer grain left there
+	return mPool->getGrainBuffer(mPoolIndex, mGrainSize);
 }
 
 
@@ -32,6 +36,7 @@ void Grain::reset()
 	isActive = false;
 	mAnalysisRange = { -1, -1, -1 };
 	mSynthRange = { -1, -1, -1 };
-	mBuffer.clear();
-	mWindowBuffer.clear();
+	mWindowSlot = -1; // the Granulator's cache is reset along with the grains
+	mVoice = 0;
+	mPoolIndex = -1; // same for its pool
 }
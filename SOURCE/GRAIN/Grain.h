@@ -3,12 +3,14 @@
  * Created by Ryan Devens
  *
  * Represents a single grain for TD-PSOLA processing.
- * Each grain owns a buffer that stores pre-windowed audio data.
- * Windowing is applied by Granulator when the grain is created.
+ * Only the grain's metadata lives here, its pre-windowed samples are a slice of the Granulator's GrainPool.
+ * Windowing is applied by Granulator when the grain is created. Grains made from the same analysis range
+ * share one slice, they only differ in where they're placed.
  */
 
 #pragma once
 #include "../Util/Juce_Header.h"
+#include "GrainPool.h"
 
 class Grain
 {
@@ -20,19 +22,19 @@ public:
 	std::tuple<juce::int64, juce::int64, juce::int64> mAnalysisRange { -1, -1, -1 };
 	std::tuple<juce::int64, juce::int64, juce::int64> mSynthRange { -1, -1, -1 };
 	int mGrainSize = -1;
-	// Prepare the grain's buffer - call once during setup
-	void prepare(int maxGrainSize, int numChannels);
+	int mWindowSlot = -1; // WindowCache slot this grain holds while active, -1 for none
+	int mVoice = 0; // Granulator voice that placed it
+	// Points the grain at the pool its samples live in - call once during setup
+	void prepare(const GrainPool& pool);
 
-	// Get read-only access to the grain's buffer
-	const juce::AudioBuffer<float>& getBuffer() const { return mBuffer; }
-
-	// Get writable access to the grain's buffer (for Granulator to fill)
-	juce::AudioBuffer<float>& getBuffer() { return mBuffer; }
+	// View of the grain's mGrainSize samples in the pool, empty if the pool has no sample storage or the grain holds no slice
+	juce::AudioBuffer<float> getBuffer() const;
+	int getPoolIndex() const { return mPoolIndex; }
 
 	void reset();
 
 private:
 	friend class Granulator;
-	juce::AudioBuffer<float> mBuffer;
-	juce::AudioBuffer<float> mWindowBuffer; // vals applied when windowing grain, for normalization later
+	const GrainPool* mPool = nullptr;
+	int mPoolIndex = -1; // pool slice this grain holds, set by the Granulator while active
 };
@@ -0,0 +1,217 @@
+/**
+ * GrainCloud.cpp
+ * Created by Ryan Devens
+ */
+
+#include "GrainCloud.h"
+#include "../Util/CircularReadView.h"
+
+GrainCloud::GrainCloud()
+{
+}
+
+GrainCloud::~GrainCloud()
+{
+}
+
+//=======================================
+void GrainCloud::prepare(double sampleRate, int blockSize, int numChannels, float maxGrainMs, float maxPositionJitterMs)
+{
+	mSampleRate = sampleRate;
+	mBlockSize = blockSize;
+	mNumChannels = juce::jmax(1, numChannels);
+	mMaxGrainSize = juce::jmax(2, juce::roundToInt(maxGrainMs * sampleRate / 1000.0));
+	mMaxPositionJitter = juce::jmax(0, juce::roundToInt(maxPositionJitterMs * sampleRate / 1000.0));
+	mGrainSize = juce::jlimit(2, mMaxGrainSize, mGrainSize > 0 ? mGrainSize : mMaxGrainSize / 2);
+	mPositionJitter = juce::jmin(mPositionJitter, mMaxPositionJitter);
+
+	// the window's buffer has to hold the longest period it's set to
+	mWindow.setSizeShapePeriod(juce::jmax(static_cast<int>(sampleRate), mMaxGrainSize), Window::Shape::kHanning, mMaxGrainSize);
+	mWindowCache.prepare(mMaxGrainSize, 2 * kNumCloudGrainLengths); // room for the old lengths while the size changes
+	mWindowScratch.setSize(1, blockSize);
+	mWetBuffer.setSize(mNumChannels, blockSize);
+	mWetBuffer.clear();
+
+	const int grainCapacity = computeGrainCapacity(sampleRate, blockSize, mMaxGrainSize);
+	mGrains.assign((size_t)grainCapacity, CloudGrain());
+	mFreeGrains.clear();
+	mFreeGrains.reserve((size_t)grainCapacity);
+	for (int i = grainCapacity - 1; i >= 0; --i)
+		mFreeGrains.push_back(i);
+	mSchedule.prepare(grainCapacity);
+
+	mNextEmission = -1.0;
+	mNumEmittedGrains = 0;
+	resetNumDroppedGrains();
+}
+
+//=======================================
+int GrainCloud::computeGrainCapacity(double sampleRate, int blockSize, int maxGrainSize)
+{
+	const double grainsPerSample = (double)kMaxEmissionRateHz / juce::jmax(1.0, sampleRate);
+	return (int)std::ceil(grainsPerSample * (double)maxGrainSize) + (int)std::ceil(grainsPerSample * (double)blockSize) + 1;
+}
+
+//=======================================
+void GrainCloud::setEmissionRate(float hz)
+{
+	mEmissionRate = juce::jlimit(kMinEmissionRateHz, kMaxEmissionRateHz, hz);
+}
+
+//=======================================
+void GrainCloud::setGrainSize(float ms)
+{
+	mGrainSize = juce::jmax(2, juce::roundToInt(ms * mSampleRate / 1000.0));
+	if (mMaxGrainSize > 0)
+		mGrainSize = juce::jmin(mGrainSize, mMaxGrainSize);
+}
+
+//=======================================
+void GrainCloud::setPositionJitter(float ms)
+{
+	mPositionJitter = juce::jmax(0, juce::roundToInt(ms * mSampleRate / 1000.0));
+	if (mMaxGrainSize > 0)
+		mPositionJitter = juce::jmin(mPositionJitter, mMaxPositionJitter);
+}
+
+//=======================================
+void GrainCloud::setSizeJitter(float amount)
+{
+	mSizeJitter = juce::jlimit(0.f, kMaxSizeJitter, amount);
+}
+
+//=======================================
+float GrainCloud::getDensityGain() const
+{
+	// a Hann window averages 1/2, so that's how many windows cover a sample on average
+	const double overlap = (double)mEmissionRate * (double)mGrainSize / mSampleRate * 0.5;
+	return (float)(1.0 / juce::jmax(1.0, overlap));
+}
+
+//=======================================
+void GrainCloud::reset()
+{
+	mSchedule.processStartedBy(std::numeric_limits<juce::int64>::max(), [this](const GrainSchedule::Entry& entry)
+	{
+		_retireGrain(entry.grainIndex);
+		return false;
+	});
+	mNextEmission = -1.0;
+}
+
+//=======================================
+void GrainCloud::process(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer,
+						 std::tuple<juce::int64, juce::int64> processCounterRange)
+{
+	const juce::int64 blockStart = std::get<0>(processCounterRange);
+	const juce::int64 blockEnd = std::get<1>(processCounterRange);
+
+	// first block, or the counter jumped: start emitting here rather than catching up
+	if (mNextEmission < (double)blockStart)
+		mNextEmission = (double)blockStart;
+
+	const double emissionInterval = mSampleRate / (double)mEmissionRate;
+	while (mNextEmission <= (double)blockEnd)
+	{
+		_emit((juce::int64)mNextEmission);
+		mNextEmission += emissionInterval;
+	}
+
+	const int numSamples = processBlock.getNumSamples();
+	jassert (numSamples <= mWetBuffer.getNumSamples());
+	const int numChannels = juce::jmin(processBlock.getNumChannels(), mNumChannels, circularBuffer.getNumChannels());
+	for (int ch = 0; ch < numChannels; ++ch)
+		mWetBuffer.clear(ch, 0, numSamples);
+
+	// only grains that have started by the end of the block, in synth order
+	mSchedule.processStartedBy(blockEnd, [&](const GrainSchedule::Entry& entry)
+	{
+		// completely in the past, nothing left to play
+		if (entry.synthEnd < blockStart)
+		{
+			_retireGrain(entry.grainIndex);
+			return false;
+		}
+
+		const juce::int64 overlapStart = std::max(entry.synthStart, blockStart);
+		const juce::int64 overlapEnd = std::min(entry.synthEnd, blockEnd);
+		_addGrain(mGrains[(size_t)entry.grainIndex], circularBuffer, (int)(overlapStart - entry.synthStart),
+				  (int)(overlapStart - blockStart), (int)(overlapEnd - overlapStart + 1), numChannels);
+
+		if (entry.synthEnd <= blockEnd)
+		{
+			_retireGrain(entry.grainIndex);
+			return false;
+		}
+		return true;
+	});
+
+	const float densityGain = getDensityGain();
+	for (int ch = 0; ch < numChannels; ++ch)
+		juce::FloatVectorOperations::addWithMultiply(processBlock.getWritePointer(ch), mWetBuffer.getReadPointer(ch), densityGain, numSamples);
+}
+
+//=======================================
+void GrainCloud::_emit(juce::int64 synthStart)
+{
+	if (mFreeGrains.empty())
+	{
+		mNumDroppedGrains.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const int grainIndex = mFreeGrains.back();
+	mFreeGrains.pop_back();
+
+	// The grain plays what came in a grain length (and the jitter) before it starts, so all of its
+	// source has been written by the time any of it plays
+	CloudGrain& grain = mGrains[(size_t)grainIndex];
+	grain.grainSize = _pickGrainSize();
+	const int positionJitter = mPositionJitter > 0 ? mRandom.nextInt(mPositionJitter + 1) : 0;
+	grain.readStart = synthStart - grain.grainSize - positionJitter;
+	grain.windowSlot = mWindowCache.acquire(mWindow, grain.grainSize);
+
+	mSchedule.add(grainIndex, synthStart, synthStart + grain.grainSize - 1);
+	mNumEmittedGrains++;
+}
+
+//=======================================
+int GrainCloud::_pickGrainSize()
+{
+	if (mSizeJitter <= 0.f)
+		return mGrainSize;
+
+	// evenly spaced steps from -jitter to +jitter
+	const int step = mRandom.nextInt(kNumCloudGrainLengths);
+	const float offset = mSizeJitter * (2.f * (float)step / (float)(kNumCloudGrainLengths - 1) - 1.f);
+	return juce::jlimit(2, mMaxGrainSize, juce::roundToInt((float)mGrainSize * (1.f + offset)));
+}
+
+//=======================================
+void GrainCloud::_addGrain(const CloudGrain& grain, CircularBuffer& circularBuffer, int grainIndex, int blockIndex, int numSamples, int numChannels)
+{
+	float* windowValues = mWindowScratch.getWritePointer(0);
+	if (grain.windowSlot >= 0)
+	{
+		mWindowCache.expand(grain.windowSlot, grainIndex, numSamples, windowValues);
+	}
+	else
+	{
+		mWindow.setPeriod(grain.grainSize);
+		for (int i = 0; i < numSamples; ++i)
+			windowValues[i] = mWindow.getValueAtIndexInPeriod(grainIndex + i);
+	}
+
+	const CircularReadView source(circularBuffer, grain.readStart + grainIndex, numSamples);
+	for (int ch = 0; ch < numChannels; ++ch)
+		source.addWithMultiplyTo(ch, mWetBuffer.getWritePointer(ch, blockIndex), windowValues);
+}
+
+//=======================================
+void GrainCloud::_retireGrain(int grainIndex)
+{
+	CloudGrain& grain = mGrains[(size_t)grainIndex];
+	mWindowCache.release(grain.windowSlot);
+	grain.windowSlot = -1;
+	mFreeGrains.push_back(grainIndex);
+}
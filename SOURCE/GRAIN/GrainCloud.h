@@ -0,0 +1,117 @@
+/**
+ * GrainCloud.h
+ * Created by Ryan Devens
+ *
+ * Asynchronous granular synthesis. Grains are emitted at a steady rate instead of on pitch marks, each one a
+ * windowed snippet of the CircularBuffer from a grain length (plus some random position jitter) behind where it
+ * starts playing, with some random length jitter. Like the Granulator's kReference grains they read straight out
+ * of the CircularBuffer, only their ranges are kept, in a GrainSchedule, so a block only walks the grains that
+ * overlap it. The grain capacity is the CPU budget: prepare() makes it enough for the fastest rate at the longest
+ * grains, an emission that still finds it full is dropped. Audio thread only after prepare().
+ */
+
+#pragma once
+#include "../Util/Juce_Header.h"
+#include "GrainSchedule.h"
+#include "WindowCache.h"
+#include "../SUBMODULES/RD/SOURCE/CircularBuffer.h"
+#include "../SUBMODULES/RD/SOURCE/Window.h"
+#include <atomic>
+#include <vector>
+
+static constexpr float kMinEmissionRateHz = 1.f;
+static constexpr float kMaxEmissionRateHz = 400.f;
+static constexpr float kMaxSizeJitter = 0.5f;
+static constexpr int kNumCloudGrainLengths = 8; // jittered lengths are rounded to this many steps so their windows stay cached
+
+class GrainCloud
+{
+public:
+	GrainCloud();
+	~GrainCloud();
+
+	// maxGrainMs and maxPositionJitterMs bound what setGrainSize() and setPositionJitter() can ask for,
+	// they size the grains and how far back grains read. Not for the audio thread.
+	void prepare(double sampleRate, int blockSize, int numChannels, float maxGrainMs, float maxPositionJitterMs);
+
+	// Grains alive at once at kMaxEmissionRateHz with every grain maxGrainSize long, plus a block's worth of emissions
+	static int computeGrainCapacity(double sampleRate, int blockSize, int maxGrainSize);
+	int getGrainCapacity() const { return (int)mGrains.size(); }
+
+	// Samples the CircularBuffer has to hold so a grain's source isn't overwritten before it finishes playing
+	int getRequiredBufferSize() const { return 2 * mMaxGrainSize + mMaxPositionJitter + mBlockSize; }
+
+	// Take effect from the next emission, any thread that also calls process()
+	void setEmissionRate(float hz);
+	void setGrainSize(float ms); // a jittered grain is never longer than prepare()'s maxGrainMs
+	void setPositionJitter(float ms); // grains read up to this much further back, random per grain
+	void setSizeJitter(float amount); // grains are up to this fraction longer or shorter, up to kMaxSizeJitter
+	void setSeed(juce::int64 seed) { mRandom.setSeed(seed); }
+
+	float getEmissionRate() const { return mEmissionRate; }
+	int getGrainSize() const { return mGrainSize; }
+
+	// Emits every grain due in processCounterRange and adds the cloud into processBlock. The cloud is scaled down by
+	// how many windows are expected to overlap, so a dense cloud of the same material comes out at the input level.
+	void process(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer,
+				 std::tuple<juce::int64, juce::int64> processCounterRange);
+
+	// drops every grain, the next process() emits from the start of its block
+	void reset();
+
+	int getNumActiveGrains() const { return mSchedule.size(); }
+	const GrainSchedule& getSchedule() const { return mSchedule; }
+	juce::int64 getNumEmittedGrains() const { return mNumEmittedGrains; }
+
+	// emissions that found every grain in use. Safe to read from any thread.
+	int getNumDroppedGrains() const { return mNumDroppedGrains.load(std::memory_order_relaxed); }
+	void resetNumDroppedGrains() { mNumDroppedGrains.store(0, std::memory_order_relaxed); }
+
+	// 1 / expected window overlap at the current rate and size, never more than 1
+	float getDensityGain() const;
+
+private:
+	friend class GrainCloudTester;
+
+	struct CloudGrain
+	{
+		juce::int64 readStart = 0; // absolute sample in the CircularBuffer
+		int grainSize = 0;
+		int windowSlot = -1; // WindowCache slot held while it plays, -1 reads mWindow directly
+	};
+
+	double mSampleRate = 48000.0;
+	int mBlockSize = 0;
+	int mNumChannels = 2;
+	int mMaxGrainSize = 0;
+	int mMaxPositionJitter = 0;
+
+	float mEmissionRate = kMinEmissionRateHz;
+	int mGrainSize = 0;
+	int mPositionJitter = 0;
+	float mSizeJitter = 0.f;
+	juce::Random mRandom;
+
+	Window mWindow;
+	WindowCache mWindowCache;
+	juce::AudioBuffer<float> mWindowScratch; // window values for one grain's overlap with the block
+	juce::AudioBuffer<float> mWetBuffer;
+
+	std::vector<CloudGrain> mGrains; // sized in prepare()
+	std::vector<int> mFreeGrains; // stack of unused grain indices, lowest on top after prepare()
+	GrainSchedule mSchedule; // playing grains by synth start
+	double mNextEmission = -1.0; // absolute sample of the next grain, fractional so the rate doesn't drift
+	juce::int64 mNumEmittedGrains = 0;
+	std::atomic<int> mNumDroppedGrains { 0 };
+
+	// starts a grain at synthStart with a jittered length and read position
+	void _emit(juce::int64 synthStart);
+
+	// one of kNumCloudGrainLengths lengths within the size jitter around mGrainSize
+	int _pickGrainSize();
+
+	// Windows numSamples of the grain, starting grainIndex samples into it, and adds them into mWetBuffer at blockIndex
+	void _addGrain(const CloudGrain& grain, CircularBuffer& circularBuffer, int grainIndex, int blockIndex, int numSamples, int numChannels);
+
+	void _retireGrain(int grainIndex);
+};
@@ -0,0 +1,55 @@
+/**
+ * GrainPool.cpp
+ * Created by Ryan Devens
+ */
+
+#include "GrainPool.h"
+
+GrainPool::GrainPool()
+{
+}
+
+GrainPool::~GrainPool()
+{
+}
+
+//=======================================
+void GrainPool::prepare(int numGrains, int numChannels, int maxGrainSize)
+{
+	mStorage.free();
+	mData = nullptr;
+	mChannelPointers.clear();
+	mNumGrains = mNumChannels = mMaxGrainSize = mGrainStride = 0;
+
+	if (numGrains <= 0 || numChannels <= 0 || maxGrainSize <= 0)
+		return;
+
+	constexpr int floatsPerLine = kAlignment / (int)sizeof(float);
+	mNumGrains = numGrains;
+	mNumChannels = numChannels;
+	mMaxGrainSize = maxGrainSize;
+	mGrainStride = (maxGrainSize + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+
+	// a lane per channel plus the window lane
+	const size_t numFloats = (size_t)(numChannels + 1) * (size_t)numGrains * (size_t)mGrainStride;
+	mStorage.allocate(numFloats + (size_t)floatsPerLine, true);
+
+	const auto address = reinterpret_cast<juce::pointer_sized_uint>(mStorage.get());
+	const auto aligned = (address + (juce::pointer_sized_uint)kAlignment - 1) & ~(juce::pointer_sized_uint)(kAlignment - 1);
+	mData = mStorage.get() + (aligned - address) / sizeof(float);
+
+	mChannelPointers.resize((size_t)(numGrains * numChannels));
+	for (int grain = 0; grain < numGrains; ++grain)
+		for (int ch = 0; ch < numChannels; ++ch)
+			mChannelPointers[(size_t)(grain * numChannels + ch)] = getSamples(grain, ch);
+}
+
+//=======================================
+juce::AudioBuffer<float> GrainPool::getGrainBuffer(int grainIndex, int numSamples) const
+{
+	if (mData == nullptr || grainIndex < 0 || grainIndex >= mNumGrains)
+		return {};
+
+	const int viewNumSamples = numSamples < 0 ? mMaxGrainSize : juce::jmin(numSamples, mMaxGrainSize);
+	return juce::AudioBuffer<float>(mChannelPointers.data() + (size_t)(grainIndex * mNumChannels), mNumChannels, viewNumSamples);
+}
@@ -0,0 +1,56 @@
+/**
+ * GrainPool.h
+ * Created by Ryan Devens
+ *
+ * Sample storage for every grain the Granulator owns, in one cache line aligned block allocated in prepare().
+ * Laid out structure-of-arrays: a lane per channel holding each grain's samples back to back, then one lane
+ * of window values shared by all channels. Each grain's slice starts on a cache line.
+ * Grain only keeps its hot metadata, its buffer is a view into here.
+ */
+
+#pragma once
+#include "../Util/Juce_Header.h"
+#include <vector>
+
+class GrainPool
+{
+public:
+	static constexpr int kAlignment = 64; // bytes, one cache line
+
+	GrainPool();
+	~GrainPool();
+
+	// Allocates and clears room for numGrains grains of up to maxGrainSize samples. Not for the audio thread.
+	// numChannels or maxGrainSize of 0 frees everything.
+	void prepare(int numGrains, int numChannels, int maxGrainSize);
+
+	float* getSamples(int grainIndex, int channel) { return mData + _getOffset(channel, grainIndex); }
+	const float* getSamples(int grainIndex, int channel) const { return mData + _getOffset(channel, grainIndex); }
+	float* getWindow(int grainIndex) { return mData + _getOffset(mNumChannels, grainIndex); }
+	const float* getWindow(int grainIndex) const { return mData + _getOffset(mNumChannels, grainIndex); }
+
+	// Non-owning view of a grain's first numSamples samples (the whole slice for -1), empty if nothing is allocated
+	juce::AudioBuffer<float> getGrainBuffer(int grainIndex, int numSamples = -1) const;
+
+	int getNumGrains() const { return mNumGrains; }
+	int getNumChannels() const { return mNumChannels; }
+	int getMaxGrainSize() const { return mMaxGrainSize; }
+	int getGrainStride() const { return mGrainStride; }
+	bool isAllocated() const { return mData != nullptr; }
+
+private:
+	friend class GrainPoolTester;
+
+	juce::HeapBlock<float> mStorage; // over-allocated by one cache line so mData can be aligned
+	float* mData = nullptr;
+	std::vector<float*> mChannelPointers; // numGrains * numChannels, for getGrainBuffer()
+	int mNumGrains = 0;
+	int mNumChannels = 0;
+	int mMaxGrainSize = 0;
+	int mGrainStride = 0; // maxGrainSize rounded up to a cache line
+
+	size_t _getOffset(int lane, int grainIndex) const
+	{
+		return ((size_t)lane * (size_t)mNumGrains + (size_t)grainIndex) * (size_t)mGrainStride;
+	}
+};
@@ -0,0 +1,50 @@
+/**
+ * GrainSchedule.cpp
+ * Created by Ryan Devens
+ */
+
+#include "GrainSchedule.h"
+
+GrainSchedule::GrainSchedule()
+{
+}
+
+GrainSchedule::~GrainSchedule()
+{
+}
+
+//=======================================
+void GrainSchedule::prepare(int capacity)
+{
+	mEntries.assign((size_t)juce::jmax(0, capacity), Entry());
+	clear();
+}
+
+//=======================================
+void GrainSchedule::clear()
+{
+	mHead = 0;
+	mSize = 0;
+}
+
+//=======================================
+bool GrainSchedule::add(int grainIndex, juce::int64 synthStart, juce::int64 synthEnd)
+{
+	if (mSize >= getCapacity())
+		return false;
+
+	// walk back from the end past anything that starts later, usually nothing
+	int position = mSize;
+	while (position > 0 && _at(position - 1).synthStart > synthStart)
+	{
+		_at(position) = _at(position - 1);
+		--position;
+	}
+
+	Entry& entry = _at(position);
+	entry.synthStart = synthStart;
+	entry.synthEnd = synthEnd;
+	entry.grainIndex = grainIndex;
+	mSize++;
+	return true;
+}
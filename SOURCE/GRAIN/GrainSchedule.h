@@ -0,0 +1,86 @@
+/**
+ * GrainSchedule.h
+ * Created by Ryan Devens
+ *
+ * The Granulator's active grains, kept in a fixed size ring ordered by synth start.
+ * Each entry carries its grain's synth range, so finding what overlaps a block only walks entries
+ * that have started by the block's end and never touches the grains themselves.
+ * Grains are made in synth order, adding one is almost always a push at the back, and the ones
+ * that finish are the oldest, so they come off the front.
+ */
+
+#pragma once
+#include "../Util/Juce_Header.h"
+#include <vector>
+
+class GrainSchedule
+{
+public:
+	struct Entry
+	{
+		juce::int64 synthStart = 0;
+		juce::int64 synthEnd = 0;
+		int grainIndex = -1;
+	};
+
+	GrainSchedule();
+	~GrainSchedule();
+
+	// Room for capacity grains. Not for the audio thread.
+	void prepare(int capacity);
+	void clear();
+
+	// Inserts after any entry starting at or before synthStart. Returns false if the schedule is full.
+	bool add(int grainIndex, juce::int64 synthStart, juce::int64 synthEnd);
+
+	int size() const { return mSize; }
+	int getCapacity() const { return (int)mEntries.size(); }
+	bool isEmpty() const { return mSize == 0; }
+
+	// index 0 is the earliest synth start
+	const Entry& operator[](int index) const { return mEntries[(size_t)_wrap(mHead + index)]; }
+
+	// Calls keep(const Entry&) in synth order for every entry starting at or before lastSample and removes
+	// the ones it returns false for. Anything starting later isn't visited.
+	template <typename Fn>
+	void processStartedBy(juce::int64 lastSample, Fn&& keep)
+	{
+		int numStarted = 0;
+		while (numStarted < mSize && _at(numStarted).synthStart <= lastSample)
+			++numStarted;
+
+		// pack what's kept to the front of the started run, in order
+		int numKept = 0;
+		for (int i = 0; i < numStarted; ++i)
+		{
+			const Entry entry = _at(i);
+			if (keep(entry))
+				_at(numKept++) = entry;
+		}
+
+		// then slide it up against the entries that haven't started, and drop the gap off the front
+		const int numRemoved = numStarted - numKept;
+		if (numRemoved == 0)
+			return;
+		for (int i = numKept - 1; i >= 0; --i)
+			_at(i + numRemoved) = _at(i);
+		mHead = _wrap(mHead + numRemoved);
+		mSize -= numRemoved;
+	}
+
+private:
+	friend class GrainScheduleTester;
+
+	std::vector<Entry> mEntries; // ring, mSize entries from mHead
+	int mHead = 0;
+	int mSize = 0;
+
+	Entry& _at(int index) { return mEntries[(size_t)_wrap(mHead + index)]; }
+
+	// index is never more than twice the capacity
+	int _wrap(int index) const
+	{
+		const int capacity = (int)mEntries.size();
+		return index >= capacity ? index - capacity : index;
+	}
+};
@@ -6,6 +6,8 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include "Granulator.h"
+#include "../Util/SimdKernels.h"
+#include "../Util/CircularReadView.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -20,29 +22,138 @@ Granulator::~Granulator()
 }
 
 //=======================================
-void Granulator::prepare(double sampleRate, int blockSize, int maxGrainSize)
+void Granulator::prepare(double sampleRate, int blockSize, int maxGrainSize, int minPeriod, float maxShiftRatio, int numChannels,
+						 int maxNumVoices)
 {
+	if (minPeriod <= 0)
+		minPeriod = juce::jmax(1, maxGrainSize / 2);
+
+	mGrainStorage = mRequestedGrainStorage;
+	mSynthesisEngine = mRequestedSynthesisEngine;
+	const bool useOutputRing = mSynthesisEngine == SynthesisEngine::kOutputRing;
+	mFormantShifting = mRequestedFormantShifting && !useOutputRing;
+
+	// lowering the formants stretches a grain, up to 1 / kMinFormantFactor times its source
+	mMaxResampledGrainSize = mFormantShifting ? (int)std::ceil((float)maxGrainSize / kMinFormantFactor) : maxGrainSize;
+
+	// every voice is its own train of grains
+	mMaxNumVoices = useOutputRing ? 1 : juce::jlimit(1, kMaxVoices, maxNumVoices);
+	mMaxShiftRatio = juce::jmax(1.f, maxShiftRatio);
+
+	// a grain stretched by a lowered formant lives that many more periods, with one starting every period / ratio
+	int grainsPerVoice = computeGrainCapacity(blockSize, minPeriod, maxShiftRatio);
+	if (mFormantShifting)
+		grainsPerVoice += (int)std::ceil(mMaxShiftRatio * 2.f * (1.f / kMinFormantFactor - 1.f));
+	const int grainCapacity = grainsPerVoice * mMaxNumVoices;
 
 	// Configure the shared window
 	mWindow.setSizeShapePeriod(static_cast<int>(sampleRate), Window::Shape::kHanning, maxGrainSize);
-	mNormWindowBuffer.setSize(1, blockSize); mNormWindowBuffer.clear();
-	mWetBuffer.setSize(2, blockSize); mWetBuffer.clear();
+	mNormWindowBuffer.setSize(mMaxNumVoices > 1 ? mMaxNumVoices + 1 : 1, blockSize); mNormWindowBuffer.clear();
+	mNumChannels = juce::jlimit(1, kNumGrainChannels, numChannels);
+	mWetBuffer.setSize(mNumChannels * mMaxNumVoices, blockSize); mWetBuffer.clear();
+
+	// the channel count won't change until the next prepare(), so the per block loop can be compiled for it
+	mSpecializedNumChannels = mRequestedChannelSpecialization ? mNumChannels : 0;
+	switch (mSpecializedNumChannels)
+	{
+		case 1: mProcessGrains = &Granulator::_processGrains<1>; break;
+		case 2: mProcessGrains = &Granulator::_processGrains<2>; break;
+		default: mProcessGrains = &Granulator::_processGrains<0>; mSpecializedNumChannels = 0; break;
+	}
 
-	// Prepare each grain's buffer and reset
-	for (auto& grain : mGrains)
+	mSourceBuffer = nullptr;
+	mWindowScratch.setSize(1, useOutputRing ? maxGrainSize : (mGrainStorage == GrainStorage::kReference ? blockSize : 0));
+	mWindowCache.prepare(mMaxResampledGrainSize, kNumWindowCacheSlots);
+
+	// grains are made at most a grain ahead of the block that plays them
+	mOutputRing.setSize(useOutputRing ? mNumChannels + 1 : 0, useOutputRing ? blockSize + 2 * maxGrainSize : 0);
+	mOutputRing.clear();
+	mOutputRingStart = mOutputRingEnd = -1;
+
+	// One block for every grain's samples, referencing grains and the output ring don't need any
+	// unless they're resampled
+	mMaxGrainSize = maxGrainSize;
+	const bool needsPool = mFormantShifting || (mGrainStorage == GrainStorage::kCopy && !useOutputRing);
+	mGrainPool.prepare(grainCapacity, mNumChannels, needsPool ? mMaxResampledGrainSize : 0);
+	mResampleScratch.setSize(mFormantShifting ? 2 : 0, mFormantShifting ? maxGrainSize + 2 * PolyphaseResampler::kPadding : 0);
+	mResampleScratch.clear();
+	mNumResampledGrains = 0;
+
+	// every cutoff a formant factor can ask for, so changing it never builds a table on the audio thread
+	mResampler.prepare(mFormantShifting ? 1.f / kMaxFormantFactor : 1.f);
+	mResampler.setCutoff(1.f / mFormantFactor);
+
+	mGrains.clear();
+	mGrains.resize((size_t)grainCapacity);
+	mFreeGrains.clear();
+	mFreeGrains.reserve((size_t)grainCapacity);
+	mSchedule.prepare(grainCapacity);
+	for (int i = grainCapacity - 1; i >= 0; --i)
 	{
-		grain.prepare(maxGrainSize, 2);
-		grain.reset();
+		mGrains[(size_t)i].prepare(mGrainPool);
+		mGrains[(size_t)i].reset();
+		mFreeGrains.push_back(i);
 	}
+	resetNumDroppedGrains();
+
+	// Every grain can still need its own slice (a block per grain gives each one a new analysis range),
+	// sharing cuts the slices in use and the copying, not what's allocated
+	mSources.assign((size_t)mGrainPool.getNumGrains(), Source());
+	mFreeSources.clear();
+	for (int i = mGrainPool.getNumGrains() - 1; i >= 0; --i)
+		mFreeSources.push_back(i);
+	mLastSourceIndex = -1;
+	mNumSourceFills = 0;
+
+	mNormTable.assign((size_t)mMaxResampledGrainSize, 0.f);
+	mNormTableWindow.assign((size_t)mMaxResampledGrainSize, 0.f);
+	mOverlappingGrains.clear();
+	mOverlappingGrains.reserve((size_t)grainCapacity);
+	mNormTableGrainSize = mNormTableSpan = mNormTableHop = 0;
+	mNumNormTableFills = 0;
+	mLastBlockSteadyState = false;
+
+	resetSynthMark();
+}
+
+//=======================================
+void Granulator::setNumVoices(int numVoices)
+{
+	mNumVoices = juce::jlimit(1, kMaxVoices, numVoices);
+}
+
+//=======================================
+void Granulator::setVoice(int voice, float shiftRatio, float gain)
+{
+	jassert (voice >= 0 && voice < kMaxVoices && shiftRatio > 0.f);
+	if (voice < 0 || voice >= kMaxVoices)
+		return;
+	mVoices[(size_t)voice].shiftRatio = juce::jmax(0.01f, shiftRatio);
+	mVoices[(size_t)voice].gain = gain;
+}
+
+//=======================================
+void Granulator::setFormantFactor(float factor)
+{
+	mFormantFactor = juce::jlimit(kMinFormantFactor, kMaxFormantFactor, factor);
+
+	// reading faster than the source has to band limit it, slower only interpolates
+	mResampler.setCutoff(1.f / mFormantFactor);
+}
 
+//=======================================
+void Granulator::resetSynthMark()
+{
 	mSynthMark = -1;
 	mCumulativePhase = 0.0;
+	for (Voice& voice : mVoices)
+		voice.synthMark = -1;
 }
 
 
 //=======================================
 void Granulator::processDetecting(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer,
-									std::tuple<int, int> dryBlockRange, std::tuple<int, int> processCounterRange)
+									std::tuple<juce::int64, juce::int64> dryBlockRange, std::tuple<juce::int64, juce::int64> processCounterRange)
 {
 // {
 // 	// Read dry audio from circular buffer and write to processBlock
@@ -73,57 +184,111 @@ void Granulator::processTracking(juce::AudioBuffer<float>& processBlock, Circula
 						std::tuple<juce::int64, juce::int64> processCounterRange,
 				  		float detectedPeriod,  float shiftedPeriod)
 {
+	placeGrains(circularBuffer, analysisReadRangeInSampleCount, analysisWriteRangeInSampleCount, processCounterRange, detectedPeriod, shiftedPeriod);
+
+	// Process all active grains
+	processActiveGrains(processBlock, processCounterRange);
+}
+
+//=======================================
+void Granulator::placeGrains(CircularBuffer& circularBuffer,
+							 std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRangeInSampleCount,
+							 std::tuple<juce::int64, juce::int64, juce::int64> analysisWriteRangeInSampleCount,
+							 std::tuple<juce::int64, juce::int64> processCounterRange,
+							 float detectedPeriod, float shiftedPeriod)
+{
+	// grains made in this call can't land on samples already played
+	if (mSynthesisEngine == SynthesisEngine::kOutputRing)
+		_advanceOutputRing(std::get<0>(processCounterRange));
+
 	juce::int64 currentAnalysisWriteMark = std::get<1>(analysisWriteRangeInSampleCount);
+	_placeVoice(circularBuffer, analysisReadRangeInSampleCount, currentAnalysisWriteMark, detectedPeriod, shiftedPeriod, mSynthMark, 0);
+
+	// harmonies are placed from the same analysis mark, a voice that's switched off starts over when it's back
+	const int numVoices = getNumVoices();
+	for (int voice = 1; voice < kMaxVoices; ++voice)
+	{
+		Voice& harmony = mVoices[(size_t)voice];
+		if (voice >= numVoices)
+		{
+			harmony.synthMark = -1;
+			continue;
+		}
+		const float harmonyPeriod = detectedPeriod / juce::jmin(harmony.shiftRatio, mMaxShiftRatio);
+		_placeVoice(circularBuffer, analysisReadRangeInSampleCount, currentAnalysisWriteMark, detectedPeriod, harmonyPeriod, harmony.synthMark, voice);
+	}
+}
+
+//=======================================
+void Granulator::_placeVoice(CircularBuffer& circularBuffer, std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange,
+							 juce::int64 currentAnalysisWriteMark, float detectedPeriod, float shiftedPeriod,
+							 juce::int64& synthMark, int voice)
+{
 	juce::int64 nextAnalysisWriteMark = currentAnalysisWriteMark + (juce::int64)(detectedPeriod);
 
-	// If mSynthMark has drifted too far ahead of currentAnalysisWriteMark (due to detection variance),
+	// If synthMark has drifted too far ahead of currentAnalysisWriteMark (due to detection variance),
 	// resync it to prevent grain emission from stalling. This can happen when the detected peak
-	// is found slightly earlier than predicted, causing analysisWriteMark to be behind mSynthMark.
-	if(mSynthMark > nextAnalysisWriteMark)
+	// is found slightly earlier than predicted, causing analysisWriteMark to be behind synthMark.
+	if(synthMark > nextAnalysisWriteMark)
 	{
-		mSynthMark = currentAnalysisWriteMark;
+		synthMark = currentAnalysisWriteMark;
 	}
 
 	// This while loop is intended to make a grain for every synth mark
 	// between grainRange.start -> grainRange.mid. it is not "start -> end" because of overlap
-	// mSynthMark matches analysisWriteMark when tracking starts, then increments by shifted period.
+	// synthMark matches analysisWriteMark when tracking starts, then increments by shifted period.
 	// If shifting up we'd need 2 synth marks before we have the next analysis marker
 	// CURRENT STRATEGY:
 	// 	Use same analysisRange for grains who's synth marks are within same analysisWriteRange
 	// 	[ currentGrainWriteStart ]-----------------[ currentGrainWriteMark(mid) ]------------------[ currentGrainWriteEnd ]
-	while(mSynthMark < nextAnalysisWriteMark)
+	while(synthMark < nextAnalysisWriteMark)
 	{
 		// no previous marks - initialize tracking
-		if(mSynthMark < 0)
+		if(synthMark < 0)
 		{
-			mSynthMark = currentAnalysisWriteMark;
-			mCumulativePhase = 0.0; // Reset phase when tracking starts
+			synthMark = currentAnalysisWriteMark;
+			if (voice == 0)
+				mCumulativePhase = 0.0; // Reset phase when tracking starts
 		}
 
-		juce::int64 synthStart = mSynthMark - (juce::int64)detectedPeriod;
-		juce::int64 synthEnd = mSynthMark + (juce::int64)detectedPeriod - 1;
-		std::tuple<juce::int64, juce::int64, juce::int64> synthRangeInSampleCount = {synthStart, mSynthMark, synthEnd};
+		juce::int64 synthStart = synthMark - (juce::int64)detectedPeriod;
+		juce::int64 synthEnd = synthMark + (juce::int64)detectedPeriod - 1;
+		std::tuple<juce::int64, juce::int64, juce::int64> synthRangeInSampleCount = {synthStart, synthMark, synthEnd};
 
-		makeGrain(circularBuffer, analysisReadRangeInSampleCount, synthRangeInSampleCount, detectedPeriod, shiftedPeriod);
+		makeGrain(circularBuffer, analysisReadRange, synthRangeInSampleCount, detectedPeriod, shiftedPeriod, voice);
 
-		mSynthMark = mSynthMark + (juce::int64)shiftedPeriod; // IMPORTANT TO USE SHIFTED HERE
+		synthMark = synthMark + (juce::int64)shiftedPeriod; // IMPORTANT TO USE SHIFTED HERE
 	}
+}
 
+//=======================================
+int Granulator::computeGrainCapacity(int blockSize, int minPeriod, float maxShiftRatio)
+{
+	minPeriod = juce::jmax(1, minPeriod);
+	maxShiftRatio = juce::jmax(1.f, maxShiftRatio);
+	const double grainsPerPeriod = (double)maxShiftRatio * (3.0 + (double)blockSize / (double)minPeriod);
+	return juce::jmax(kNumGrains, (int)std::ceil(grainsPerPeriod) + 1);
+}
 
+//=======================================
+int Granulator::_acquireGrain()
+{
+	if (mFreeGrains.empty())
+		return -1; // No inactive grain available
 
-	// Process all active grains
-	processActiveGrains(processBlock, processCounterRange);
+	const int grainIndex = mFreeGrains.back();
+	mFreeGrains.pop_back();
+	return grainIndex;
 }
 
 //=======================================
-int Granulator::_findInactiveGrainIndex()
+void Granulator::_retireGrain(int grainIndex)
 {
-	for (int i = 0; i < kNumGrains; ++i)
-	{
-		if (!mGrains[i].isActive)
-			return i;
-	}
-	return -1; // No inactive grain available
+	Grain& grain = mGrains[(size_t)grainIndex];
+	grain.isActive = false;
+	_releaseWindow(grain);
+	_releaseSource(grain);
+	mFreeGrains.push_back(grainIndex);
 }
 
 void Granulator::makeGrain(
@@ -131,51 +296,77 @@ void Granulator::makeGrain(
     std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange,
     std::tuple<juce::int64, juce::int64, juce::int64> synthRange,
     float detectedPeriod,
-    float /*shiftedPeriod*/)
+    float /*shiftedPeriod*/,
+    int voice)
 {
-    const int grainIndex = _findInactiveGrainIndex();
-    if (grainIndex < 0)
+    const int period    = (int)std::llround(detectedPeriod);
+    const int sourceSize = period * 2;
+
+    // the pool is sized for the longest period we support
+    if (sourceSize <= 0)
+        return;
+
+    // formants shifted by resampling the grain to a new length around the same synth mark
+    const float formantFactor = mFormantShifting ? mFormantFactor : 1.f;
+    const bool isResampled = formantFactor != 1.f;
+    const int grainSize = isResampled ? juce::jmax(2, juce::roundToInt((float)sourceSize / formantFactor)) : sourceSize;
+    if (isResampled)
+    {
+        const juce::int64 synthStart = std::get<1>(synthRange) - grainSize / 2;
+        synthRange = {synthStart, std::get<1>(synthRange), synthStart + grainSize - 1};
+    }
+
+    // rendered once, there's no grain to keep around
+    if (mSynthesisEngine == SynthesisEngine::kOutputRing)
+    {
+        if (grainSize > mMaxGrainSize || !_addGrainToOutputRing(circularBuffer, std::get<0>(analysisReadRange), std::get<0>(synthRange), std::get<2>(synthRange), grainSize))
+            mNumDroppedGrains.fetch_add(1, std::memory_order_relaxed);
         return;
+    }
 
-    Grain& grain = mGrains[grainIndex];
+    const int grainIndex = sourceSize <= mMaxGrainSize ? _acquireGrain() : -1;
+    if (grainIndex < 0)
+    {
+        mNumDroppedGrains.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
 
-    const int period    = (int)std::llround(detectedPeriod);
-    const int grainSize = period * 2;
+    Grain& grain = mGrains[(size_t)grainIndex];
 
-    // Window must match the grain buffer length.
+    // Window must match the grain buffer length. Cached per length, only a new length generates one.
     mWindow.setPeriod(grainSize);
     mWindow.resetReadPos();
+    grain.mWindowSlot = mWindowCache.acquire(mWindow, grainSize);
 
     grain.isActive = true;
     grain.mAnalysisRange = analysisReadRange;
     grain.mSynthRange = synthRange;
 	grain.mGrainSize = grainSize;
-
-    const int numChannels = circularBuffer.getNumChannels();
+    grain.mVoice = voice;
 
     const juce::int64 readStart = std::get<0>(analysisReadRange);
-    const juce::int64 readEndExpected = readStart + (juce::int64)grainSize - 1;
+    const juce::int64 readEndExpected = readStart + (juce::int64)sourceSize - 1;
 
     // Assumption for TD-PSOLA: analysisReadRange spans exactly 2*period samples and is centered
     // on the pitch mark (analysisRange.mark). We do NOT phase-rotate reads per grain.
     (void)readEndExpected; // remove if you add an assert/log
 
-    grain.mBuffer.clear();
-
-    for (int i = 0; i < grainSize; ++i)
+    // source stays in the circular buffer, window is looked up during overlap-add
+    if (mGrainStorage == GrainStorage::kReference && !isResampled)
+    {
+        mSourceBuffer = &circularBuffer;
+    }
+    else if (!_acquireSource(grain, circularBuffer, readStart, sourceSize))
     {
-        const juce::int64 readPos = readStart + (juce::int64)i;
-        const int wrappedIndex = circularBuffer.getWrappedIndex(readPos);
-        const float w = mWindow.getNextSample();
-
-		grain.mWindowBuffer.setSample(0, i, w);
-        for (int ch = 0; ch < numChannels; ++ch)
-        {
-            const float s = circularBuffer.getBuffer().getSample(ch, wrappedIndex);
-            grain.mBuffer.setSample(ch, i, s * w);
-        }
+        // can't happen with a slice per grain, but don't leave a grain with nothing to play
+        jassertfalse;
+        _retireGrain(grainIndex);
+        mNumDroppedGrains.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
 
+    mSchedule.add(grainIndex, std::get<0>(synthRange), std::get<2>(synthRange));
+
     // IMPORTANT:
     // Pitch shifting happens because synth marks advance by shiftedPeriod elsewhere (mSynthMark += shiftedPeriod),
     // while analysis marks advance by detectedPeriod. Do not add a per-grain read offset here.
@@ -185,72 +376,531 @@ void Granulator::makeGrain(
 //=======================================
 void Granulator::processActiveGrains(juce::AudioBuffer<float>& processBlock, std::tuple<juce::int64, juce::int64> processCounterRange)
 {
-	int numChannels = processBlock.getNumChannels();
 	juce::int64 blockStart = std::get<0>(processCounterRange);
 	juce::int64 blockEnd = std::get<1>(processCounterRange);
-	mNormWindowBuffer.clear();
-	mWetBuffer.clear();
+	if (mSynthesisEngine == SynthesisEngine::kOutputRing)
+	{
+		mLastBlockSteadyState = false;
+		_readOutputRing(processBlock, blockStart);
+		return;
+	}
+
+	if (processBlock.getNumChannels() >= mSpecializedNumChannels && mProcessGrains != nullptr)
+		(this->*mProcessGrains)(processBlock, blockStart, blockEnd);
+	else
+		_processGrains<0>(processBlock, blockStart, blockEnd);
+}
+
+//=======================================
+template <int NumChannels>
+void Granulator::_processGrains(juce::AudioBuffer<float>& processBlock, juce::int64 blockStart, juce::int64 blockEnd)
+{
+	const int numSamples = processBlock.getNumSamples();
+	const int numVoices = getNumVoices();
 
-	for (auto& grain : mGrains)
+	// the voices' grains interleave, the table only describes one train
+	const bool steadyState = numVoices == 1 && mUseSteadyStateNorm && _writeSteadyStateNorm(blockStart, blockEnd, numSamples);
+	mLastBlockSteadyState = steadyState;
+	if (!steadyState)
 	{
-		if (!grain.isActive)
-			continue;
+		for (int voice = 0; voice < numVoices; ++voice)
+			mNormWindowBuffer.clear(voice, 0, numSamples);
+	}
+	for (int lane = 0; lane < numVoices * mNumChannels; ++lane)
+		mWetBuffer.clear(lane, 0, numSamples);
+
+	// a compile time count when specialized, so every channel loop below unrolls
+	const int numGrainChannels = NumChannels > 0 ? NumChannels : juce::jmin(processBlock.getNumChannels(), mNumChannels);
+	jassert (numGrainChannels <= mNumChannels);
+
+	// only grains that have started by the end of the block, in synth order
+	mSchedule.processStartedBy(blockEnd, [&](const GrainSchedule::Entry& entry)
+	{
+		// completely in the past, nothing left to play
+		if (entry.synthEnd < blockStart)
+		{
+			_retireGrain(entry.grainIndex);
+			return false;
+		}
 
-		juce::int64 synthStart = std::get<0>(grain.mSynthRange);
-		juce::int64 synthEnd = std::get<2>(grain.mSynthRange);
+		Grain& grain = mGrains[(size_t)entry.grainIndex];
+		const int wetLane = grain.mVoice * mNumChannels;
 
-		// Check if grain overlaps with current block
-		if (synthEnd < blockStart || synthStart > blockEnd)
+		// a voice that was switched off stops where it is, its grains just run out
+		if (grain.mVoice >= numVoices)
 		{
-			// Grain doesn't overlap with this block
-			// If grain is completely in the past, deactivate it
-			if (synthEnd < blockStart)
+			if (entry.synthEnd <= blockEnd)
 			{
-				grain.isActive = false;
+				_retireGrain(entry.grainIndex);
+				return false;
 			}
-			continue;
+			return true;
 		}
 
 		// Calculate overlap region
-		juce::int64 overlapStart = std::max(synthStart, blockStart);
-		juce::int64 overlapEnd = std::min(synthEnd, blockEnd);
+		juce::int64 overlapStart = std::max(entry.synthStart, blockStart);
+		juce::int64 overlapEnd = std::min(entry.synthEnd, blockEnd);
+
+		// Overlap-add the whole overlap region at once
+		const int numOverlapSamples = static_cast<int>(overlapEnd - overlapStart + 1);
+		const int blockIndex = static_cast<int>(overlapStart - blockStart); // Index within this process block
+		const int grainBufferIndex = static_cast<int>(overlapStart - entry.synthStart); // Index within the grain's buffer
 
-		// Process each sample in the overlap region
-		for (juce::int64 sampleCount = overlapStart; sampleCount <= overlapEnd; ++sampleCount)
+		// a resampled kReference grain holds a slice like a kCopy one
+		if (grain.mPoolIndex < 0)
 		{
-			// Index within this process block
-			int blockIndex = static_cast<int>(sampleCount - blockStart);
-
-			// Index within the grain's buffer
-			int grainBufferIndex = static_cast<int>(sampleCount - synthStart);
-			float windowVal = grain.mWindowBuffer.getSample(0, grainBufferIndex);
-			mNormWindowBuffer.addSample(0, blockIndex, windowVal);
-			// Read from grain's pre-windowed buffer and add to output (overlap-add)
-			for (int ch = 0; ch < numChannels; ++ch)
-			{
-				float grainSample = grain.mBuffer.getSample(ch, grainBufferIndex);
-				mWetBuffer.addSample(ch, blockIndex, grainSample);
-			}
+			_addReferencedGrain<NumChannels>(grain, grainBufferIndex, blockIndex, numOverlapSamples, numGrainChannels, !steadyState);
+		}
+		else
+		{
+			const int poolIndex = grain.mPoolIndex;
+			if (!steadyState)
+				SimdKernels::add(mNormWindowBuffer.getWritePointer(grain.mVoice, blockIndex), mGrainPool.getWindow(poolIndex) + grainBufferIndex, numOverlapSamples);
+			// grain's samples are pre-windowed
+			for (int ch = 0; ch < numGrainChannels; ++ch)
+				SimdKernels::add(mWetBuffer.getWritePointer(wetLane + ch, blockIndex), mGrainPool.getSamples(poolIndex, ch) + grainBufferIndex, numOverlapSamples);
 		}
 
 		// Deactivate grain if it's completely processed
-		if (synthEnd <= blockEnd)
+		if (entry.synthEnd <= blockEnd)
 		{
-			grain.isActive = false;
+			_retireGrain(entry.grainIndex);
+			return false;
 		}
+		return true;
+	});
+
+	if (numVoices > 1)
+	{
+		_mixVoices(processBlock, numGrainChannels, numSamples);
+		return;
+	}
+
+	// one divide per sample for every channel, samples no grain covered get 0 and are left alone
+	float* normGain = mNormWindowBuffer.getWritePointer(0);
+	if (!steadyState)
+		SimdKernels::guardedReciprocal(normGain, normGain, 1.0e-6f, numSamples);
+	for (int ch = 0; ch < numGrainChannels; ++ch)
+		SimdKernels::multiplyWhereNonZero(processBlock.getWritePointer(ch), mWetBuffer.getReadPointer(ch), normGain, numSamples);
+}
+
+//=======================================
+template <int NumChannels>
+void Granulator::_addReferencedGrain(Grain& grain, int grainIndex, int blockIndex, int numSamples, int numChannels, bool addToNorm)
+{
+	jassert (mSourceBuffer != nullptr);
+	if (mSourceBuffer == nullptr)
+		return;
+
+	// same table makeGrain() would have copied from, at this grain's length
+	if (grain.mWindowSlot < 0)
+		grain.mWindowSlot = mWindowCache.acquire(mWindow, grain.mGrainSize);
+
+	float* windowValues = mWindowScratch.getWritePointer(0);
+	if (grain.mWindowSlot >= 0)
+	{
+		mWindowCache.expand(grain.mWindowSlot, grainIndex, numSamples, windowValues);
+	}
+	else
+	{
+		mWindow.setPeriod(grain.mGrainSize);
+		for (int i = 0; i < numSamples; ++i)
+			windowValues[i] = mWindow.getValueAtIndexInPeriod(grainIndex + i);
+	}
+
+	if (addToNorm)
+		SimdKernels::add(mNormWindowBuffer.getWritePointer(grain.mVoice, blockIndex), windowValues, numSamples);
+
+	const int wetLane = grain.mVoice * mNumChannels;
+
+	const CircularReadView source(*mSourceBuffer, std::get<0>(grain.mAnalysisRange) + (juce::int64)grainIndex, numSamples);
+	if (NumChannels > 0 && mSourceBuffer->getNumChannels() >= NumChannels)
+	{
+		for (int ch = 0; ch < NumChannels; ++ch)
+			source.addWithMultiplyTo(ch, mWetBuffer.getWritePointer(wetLane + ch, blockIndex), windowValues);
+		return;
+	}
+
+	const int numSourceChannels = juce::jmin(numChannels, mSourceBuffer->getNumChannels());
+	for (int ch = 0; ch < numSourceChannels; ++ch)
+		source.addWithMultiplyTo(ch, mWetBuffer.getWritePointer(wetLane + ch, blockIndex), windowValues);
+}
+
+//=======================================
+void Granulator::_mixVoices(juce::AudioBuffer<float>& processBlock, int numChannels, int numSamples)
+{
+	const int numVoices = getNumVoices();
+
+	// 1 where any voice's window sum is above the floor guardedReciprocal() uses, the mix is written there as is
+	float* covered = mNormWindowBuffer.getWritePointer(mMaxNumVoices);
+	juce::FloatVectorOperations::copy(covered, mNormWindowBuffer.getReadPointer(0), numSamples);
+	for (int voice = 1; voice < numVoices; ++voice)
+		juce::FloatVectorOperations::max(covered, covered, mNormWindowBuffer.getReadPointer(voice), numSamples);
+	for (int i = 0; i < numSamples; ++i)
+		covered[i] = covered[i] > 1.0e-6f ? 1.f : 0.f;
+
+	// every voice divides by its own window sum, a voice placing grains twice as often doesn't come out louder
+	for (int voice = 0; voice < numVoices; ++voice)
+	{
+		float* normGain = mNormWindowBuffer.getWritePointer(voice);
+		SimdKernels::guardedReciprocal(normGain, normGain, 1.0e-6f, numSamples);
+		juce::FloatVectorOperations::multiply(normGain, mVoices[(size_t)voice].gain, numSamples);
 	}
 
-	
 	for (int ch = 0; ch < numChannels; ++ch)
 	{
-		for (int i = 0; i < processBlock.getNumSamples(); ++i)
+		float* mix = mWetBuffer.getWritePointer(ch);
+		SimdKernels::multiply(mix, mix, mNormWindowBuffer.getReadPointer(0), numSamples);
+		for (int voice = 1; voice < numVoices; ++voice)
+			juce::FloatVectorOperations::addWithMultiply(mix, mWetBuffer.getReadPointer(voice * mNumChannels + ch), mNormWindowBuffer.getReadPointer(voice), numSamples);
+		SimdKernels::multiplyWhereNonZero(processBlock.getWritePointer(ch), mix, covered, numSamples);
+	}
+}
+
+//=======================================
+bool Granulator::_addGrainToOutputRing(CircularBuffer& circularBuffer, juce::int64 readStart, juce::int64 synthStart, juce::int64 synthEnd, int grainSize)
+{
+	const int ringSize = mOutputRing.getNumSamples();
+	if (mOutputRingStart < 0)
+		mOutputRingStart = mOutputRingEnd = synthStart;
+	if (synthEnd >= mOutputRingStart + ringSize)
+		return false;
+
+	// anything before the read position has already been played
+	const int grainIndex = (int)juce::jmax((juce::int64)0, mOutputRingStart - synthStart);
+	const int numSamples = grainSize - grainIndex;
+	if (numSamples <= 0)
+		return true;
+
+	// same window values the per block engine uses
+	mWindow.setPeriod(grainSize);
+	float* windowValues = mWindowScratch.getWritePointer(0);
+	const int slot = mWindowCache.acquire(mWindow, grainSize);
+	if (slot >= 0)
+	{
+		mWindowCache.expand(slot, grainIndex, numSamples, windowValues);
+		mWindowCache.release(slot);
+	}
+	else
+	{
+		for (int i = 0; i < numSamples; ++i)
+			windowValues[i] = mWindow.getValueAtIndexInPeriod(grainIndex + i);
+	}
+
+	// the grain wraps the ring at most once
+	const juce::int64 firstSample = synthStart + grainIndex;
+	const int ringStart = (int)(((firstSample % ringSize) + ringSize) % ringSize);
+	const int firstLength = juce::jmin(numSamples, ringSize - ringStart);
+	const int windowLane = mOutputRing.getNumChannels() - 1;
+	const int numChannels = juce::jmin(circularBuffer.getNumChannels(), windowLane);
+
+	for (int span = 0, offset = 0; span < 2 && offset < numSamples; ++span)
+	{
+		const int ringIndex = span == 0 ? ringStart : 0;
+		const int length = span == 0 ? firstLength : numSamples - firstLength;
+
+		SimdKernels::add(mOutputRing.getWritePointer(windowLane, ringIndex), windowValues + offset, length);
+		const CircularReadView source(circularBuffer, readStart + grainIndex + offset, length);
+		for (int ch = 0; ch < numChannels; ++ch)
+			source.addWithMultiplyTo(ch, mOutputRing.getWritePointer(ch, ringIndex), windowValues + offset);
+		offset += length;
+	}
+
+	mOutputRingEnd = juce::jmax(mOutputRingEnd, synthEnd + 1);
+	return true;
+}
+
+//=======================================
+void Granulator::_advanceOutputRing(juce::int64 blockStart)
+{
+	const int ringSize = mOutputRing.getNumSamples();
+	if (mOutputRingStart < 0)
+	{
+		mOutputRingStart = mOutputRingEnd = blockStart;
+		return;
+	}
+
+	// Going back is fine as long as everything already added still fits, otherwise start over
+	if (blockStart < mOutputRingStart)
+	{
+		if (mOutputRingEnd > blockStart + ringSize)
+		{
+			mOutputRing.clear();
+			mOutputRingEnd = blockStart;
+		}
+		mOutputRingStart = blockStart;
+		return;
+	}
+
+	// clear what was skipped, the positions come back around as new samples
+	const juce::int64 numSkipped = juce::jmin(blockStart, mOutputRingEnd) - mOutputRingStart;
+	if (numSkipped >= ringSize)
+	{
+		mOutputRing.clear();
+	}
+	else if (numSkipped > 0)
+	{
+		const int ringStart = (int)(((mOutputRingStart % ringSize) + ringSize) % ringSize);
+		const int firstLength = juce::jmin((int)numSkipped, ringSize - ringStart);
+		for (int lane = 0; lane < mOutputRing.getNumChannels(); ++lane)
 		{
-			float normalizedWindowSample = mNormWindowBuffer.getSample(0, i);
-			if (normalizedWindowSample > 1.0e-6f)
-				processBlock.setSample(ch, i, mWetBuffer.getSample(ch, i) / normalizedWindowSample);
+			juce::FloatVectorOperations::clear(mOutputRing.getWritePointer(lane, ringStart), firstLength);
+			juce::FloatVectorOperations::clear(mOutputRing.getWritePointer(lane), (int)numSkipped - firstLength);
 		}
 	}
+	mOutputRingStart = blockStart;
+	mOutputRingEnd = juce::jmax(mOutputRingEnd, blockStart);
+}
+
+//=======================================
+void Granulator::_readOutputRing(juce::AudioBuffer<float>& processBlock, juce::int64 blockStart)
+{
+	_advanceOutputRing(blockStart);
+
+	const int ringSize = mOutputRing.getNumSamples();
+	const int numSamples = processBlock.getNumSamples();
+	jassert (numSamples <= mNormWindowBuffer.getNumSamples());
+	const int windowLane = mOutputRing.getNumChannels() - 1;
+	const int numChannels = juce::jmin(processBlock.getNumChannels(), windowLane);
+	float* normGain = mNormWindowBuffer.getWritePointer(0);
+
+	// nothing past mOutputRingEnd was ever written, only the slice up to it has to be read and cleared
+	const int numWritten = (int)juce::jlimit((juce::int64)0, (juce::int64)numSamples, mOutputRingEnd - blockStart);
+	const int ringStart = (int)(((blockStart % ringSize) + ringSize) % ringSize);
+	const int firstLength = juce::jmin(numWritten, ringSize - ringStart);
+
+	for (int span = 0, offset = 0; span < 2 && offset < numWritten; ++span)
+	{
+		const int ringIndex = span == 0 ? ringStart : 0;
+		const int length = span == 0 ? firstLength : numWritten - firstLength;
+
+		// same normalization as the per block engine, samples no grain covered are left alone
+		SimdKernels::guardedReciprocal(normGain + offset, mOutputRing.getReadPointer(windowLane, ringIndex), 1.0e-6f, length);
+		for (int ch = 0; ch < numChannels; ++ch)
+			SimdKernels::multiplyWhereNonZero(processBlock.getWritePointer(ch, offset), mOutputRing.getReadPointer(ch, ringIndex), normGain + offset, length);
+		for (int lane = 0; lane < mOutputRing.getNumChannels(); ++lane)
+			juce::FloatVectorOperations::clear(mOutputRing.getWritePointer(lane, ringIndex), length);
+
+		offset += length;
+	}
+
+	mOutputRingStart = blockStart + numSamples;
+	mOutputRingEnd = juce::jmax(mOutputRingEnd, mOutputRingStart);
+}
+
+//=======================================
+bool Granulator::_writeSteadyStateNorm(juce::int64 blockStart, juce::int64 blockEnd, int numSamples)
+{
+	// grains touching the block, the schedule already has them by synth start
+	mOverlappingGrains.clear();
+	for (int i = 0; i < mSchedule.size() && mSchedule[i].synthStart <= blockEnd; ++i)
+	{
+		if (mSchedule[i].synthEnd >= blockStart)
+			mOverlappingGrains.push_back(mSchedule[i].grainIndex);
+	}
+
+	if (mOverlappingGrains.empty())
+		return false;
+
+	const Grain& first = mGrains[(size_t)mOverlappingGrains.front()];
+	const Grain& last = mGrains[(size_t)mOverlappingGrains.back()];
+	const int grainSize = first.mGrainSize;
+	const juce::int64 firstStart = std::get<0>(first.mSynthRange);
+	const int span = (int)(std::get<2>(first.mSynthRange) - firstStart + 1);
+
+	// A lone grain can reuse the current table's hop, the end checks below still make sure nothing else
+	// should be overlapping it
+	juce::int64 hop = mNormTableHop;
+	if (mOverlappingGrains.size() > 1)
+		hop = std::get<0>(mGrains[(size_t)mOverlappingGrains[1]].mSynthRange) - firstStart;
+	else if (grainSize != mNormTableGrainSize || span != mNormTableSpan || mWindow.getShape() != mNormTableShape)
+		return false;
+
+	if (hop <= 0 || hop > (juce::int64)mNormTable.size() || span > grainSize)
+		return false;
+
+	// same length, one grain every hop
+	juce::int64 expectedStart = firstStart;
+	for (int grainIndex : mOverlappingGrains)
+	{
+		const Grain& grain = mGrains[(size_t)grainIndex];
+		const juce::int64 synthStart = std::get<0>(grain.mSynthRange);
+		if (grain.mGrainSize != grainSize || synthStart != expectedStart || std::get<2>(grain.mSynthRange) - synthStart + 1 != span)
+			return false;
+		expectedStart += hop;
+	}
+
+	// and nothing missing at either end: the grain before the first one finished before the block,
+	// the one after the last isn't due until after it
+	if (firstStart - hop + span - 1 >= blockStart || std::get<0>(last.mSynthRange) + hop <= blockEnd)
+		return false;
 
+	if (grainSize != mNormTableGrainSize || span != mNormTableSpan || (int)hop != mNormTableHop || mWindow.getShape() != mNormTableShape)
+		_fillNormTable(grainSize, span, (int)hop);
+
+	// tile the table across the block, starting at the block's offset into the hop
+	float* normGain = mNormWindowBuffer.getWritePointer(0);
+	int phase = (int)(((blockStart - firstStart) % hop + hop) % hop);
+	for (int i = 0; i < numSamples;)
+	{
+		const int numToCopy = juce::jmin(numSamples - i, (int)hop - phase);
+		juce::FloatVectorOperations::copy(normGain + i, mNormTable.data() + phase, numToCopy);
+		i += numToCopy;
+		phase = 0;
+	}
+	return true;
+}
+
+//=======================================
+void Granulator::_fillNormTable(int grainSize, int span, int hop)
+{
+	// same window values the grains themselves use
+	const int slot = mWindowCache.acquire(mWindow, grainSize);
+	if (slot >= 0)
+	{
+		mWindowCache.expand(slot, 0, span, mNormTableWindow.data());
+		mWindowCache.release(slot);
+	}
+	else
+	{
+		mWindow.setPeriod(grainSize);
+		for (int i = 0; i < span; ++i)
+			mNormTableWindow[(size_t)i] = mWindow.getValueAtIndexInPeriod(i);
+	}
+
+	juce::FloatVectorOperations::clear(mNormTable.data(), hop);
+	for (int start = 0; start < span; start += hop)
+		SimdKernels::add(mNormTable.data(), mNormTableWindow.data() + start, juce::jmin(hop, span - start));
+	SimdKernels::guardedReciprocal(mNormTable.data(), mNormTable.data(), 1.0e-6f, hop);
+
+	mNormTableShape = mWindow.getShape();
+	mNormTableGrainSize = grainSize;
+	mNormTableSpan = span;
+	mNormTableHop = hop;
+	mNumNormTableFills++;
+}
+
+//=======================================
+bool Granulator::_acquireSource(Grain& grain, CircularBuffer& circularBuffer, juce::int64 readStart, int sourceSize)
+{
+	const Window::Shape shape = mWindow.getShape();
+
+	// Grains sharing a range are made back to back (one per voice per mark), so only the newest fill can match
+	if (mLastSourceIndex >= 0)
+	{
+		Source& source = mSources[(size_t)mLastSourceIndex];
+		if (source.numHolders > 0 && source.readStart == readStart && source.sourceSize == sourceSize
+			&& source.grainSize == grain.mGrainSize && source.shape == shape)
+		{
+			source.numHolders++;
+			grain.mPoolIndex = mLastSourceIndex;
+			_releaseWindow(grain); // the shared slice already has its window
+			return true;
+		}
+	}
+
+	if (mFreeSources.empty())
+		return false;
+
+	const int poolIndex = mFreeSources.back();
+	mFreeSources.pop_back();
+	Source& source = mSources[(size_t)poolIndex];
+	source.readStart = readStart;
+	source.grainSize = grain.mGrainSize;
+	source.sourceSize = sourceSize;
+	source.shape = shape;
+	source.numHolders = 1;
+	grain.mPoolIndex = poolIndex;
+	mLastSourceIndex = poolIndex;
+
+	const int grainSize = grain.mGrainSize;
+	const int numChannels = juce::jmin(circularBuffer.getNumChannels(), mGrainPool.getNumChannels());
+
+	// fill the window once and apply it to every channel
+	float* windowValues = mGrainPool.getWindow(poolIndex);
+	if (grain.mWindowSlot >= 0)
+	{
+		mWindowCache.expand(grain.mWindowSlot, 0, grainSize, windowValues);
+		_releaseWindow(grain); // copied, the table stays cached for the next grain of this length
+	}
+	else
+	{
+		for (int i = 0; i < grainSize; ++i)
+			windowValues[i] = mWindow.getNextSample();
+	}
+
+	if (grainSize != sourceSize)
+	{
+		_resampleSource(poolIndex, circularBuffer, readStart, sourceSize, grainSize, numChannels);
+	}
+	else
+	{
+		const CircularReadView view(circularBuffer, readStart, grainSize);
+		for (int ch = 0; ch < numChannels; ++ch)
+			view.multiplyTo(ch, mGrainPool.getSamples(poolIndex, ch), windowValues);
+	}
+
+	// nothing past grainSize is read, but a source with fewer channels than the pool plays silence on the rest
+	for (int ch = numChannels; ch < mGrainPool.getNumChannels(); ++ch)
+		juce::FloatVectorOperations::clear(mGrainPool.getSamples(poolIndex, ch), grainSize);
+
+	mNumSourceFills++;
+	return true;
+}
+
+//=======================================
+void Granulator::_resampleSource(int poolIndex, CircularBuffer& circularBuffer, juce::int64 readStart, int sourceSize, int grainSize, int numChannels)
+{
+	// windowed at the source's length, the slice's own window is the one at grainSize for normalizing
+	float* analysisWindow = mResampleScratch.getWritePointer(0);
+	mWindow.setPeriod(sourceSize);
+	const int slot = mWindowCache.acquire(mWindow, sourceSize);
+	if (slot >= 0)
+	{
+		mWindowCache.expand(slot, 0, sourceSize, analysisWindow);
+		mWindowCache.release(slot);
+	}
+	else
+	{
+		for (int i = 0; i < sourceSize; ++i)
+			analysisWindow[i] = mWindow.getValueAtIndexInPeriod(i);
+	}
+
+	// the filter reads kPadding either side, which is silence past the window anyway
+	constexpr int padding = PolyphaseResampler::kPadding;
+	float* input = mResampleScratch.getWritePointer(1);
+	juce::FloatVectorOperations::clear(input, padding);
+	juce::FloatVectorOperations::clear(input + padding + sourceSize, padding);
+
+	// first and last outputs land on the first and last source samples
+	const double step = grainSize > 1 ? (double)(sourceSize - 1) / (double)(grainSize - 1) : 1.0;
+	const CircularReadView view(circularBuffer, readStart, sourceSize);
+	for (int ch = 0; ch < numChannels; ++ch)
+	{
+		view.multiplyTo(ch, input + padding, analysisWindow);
+		mResampler.process(input + padding, 0.0, step, mGrainPool.getSamples(poolIndex, ch), grainSize);
+	}
+	mNumResampledGrains++;
+}
+
+//=======================================
+void Granulator::_releaseSource(Grain& grain)
+{
+	if (grain.mPoolIndex < 0)
+		return;
+
+	Source& source = mSources[(size_t)grain.mPoolIndex];
+	jassert (source.numHolders > 0);
+	if (--source.numHolders == 0)
+		mFreeSources.push_back(grain.mPoolIndex);
+	grain.mPoolIndex = -1;
+}
+
+//=======================================
+void Granulator::_releaseWindow(Grain& grain)
+{
+	mWindowCache.release(grain.mWindowSlot);
+	grain.mWindowSlot = -1;
 }
 
 //=======================================
@@ -10,11 +10,22 @@
 #include "../Util/Juce_Header.h"
 #include "Grain.h"
 #include "AnalysisMarker.h"
+#include "WindowCache.h"
+#include "GrainPool.h"
+#include "GrainSchedule.h"
+#include "../Util/PolyphaseResampler.h"
 #include "../SUBMODULES/RD/SOURCE/CircularBuffer.h"
 #include "../SUBMODULES/RD/SOURCE/Window.h"
 #include <array>
+#include <atomic>
+#include <vector>
 
-static constexpr int kNumGrains = 4;
+static constexpr int kNumGrains = 4; // fewest grains prepare() allocates
+static constexpr int kNumWindowCacheSlots = 16; // distinct grain lengths kept around, more than are usually active at once
+static constexpr int kNumGrainChannels = 2;
+static constexpr int kMaxVoices = 4; // harmony voices one Granulator can place
+static constexpr float kMinFormantFactor = 0.5f;
+static constexpr float kMaxFormantFactor = 2.f;
 
 class Granulator
 {
@@ -22,12 +33,98 @@ public:
 	Granulator();
 	~Granulator();
 
-	void prepare(double sampleRate, int blockSize, int maxGrainSize);
+	// maxGrainSize is two of the longest period we'll be asked to granulate, longer grains are dropped.
+	// minPeriod and maxShiftRatio bound how many grains can be alive at once, see computeGrainCapacity().
+	// minPeriod <= 0 means maxGrainSize / 2. numChannels comes from the bus layout, at most kNumGrainChannels.
+	// maxNumVoices sizes the grains and overlap-add lanes for that many voices, see setNumVoices().
+	void prepare(double sampleRate, int blockSize, int maxGrainSize, int minPeriod = 0, float maxShiftRatio = 1.f,
+				 int numChannels = kNumGrainChannels, int maxNumVoices = 1);
+
+	// Grains needed so makeGrain() never runs out for one voice: a grain lives for its two periods, plus up to
+	// a period of being made ahead and a block before it's retired, and one starts every minPeriod / maxShiftRatio.
+	static int computeGrainCapacity(int blockSize, int minPeriod, float maxShiftRatio);
+
+	// Harmony voices. Every voice places its own train of grains, a synth mark every detectedPeriod / its shift
+	// ratio, from the same analysis marks, windows and (kCopy) sources, so an extra voice only costs its
+	// placement and overlap-add. Each voice is normalized by its own window sum and the voices are mixed with
+	// their gains, samples no voice covers are left alone. A lone voice plays at unity whatever its gain.
+	// Voice 0 follows the shiftedPeriod processTracking() is given, its ratio here is ignored.
+	// Asking for more than prepare()'s maxNumVoices places that many. Can be changed between blocks.
+	// kOutputRing only places voice 0.
+	void setNumVoices(int numVoices);
+	int getNumVoices() const { return juce::jmin(mNumVoices, mMaxNumVoices); }
+	int getMaxNumVoices() const { return mMaxNumVoices; }
+
+	// shiftRatio is limited to prepare()'s maxShiftRatio, that's what the grains were counted for
+	void setVoice(int voice, float shiftRatio, float gain);
+	float getVoiceShiftRatio(int voice) const { return mVoices[(size_t)voice].shiftRatio; }
+	float getVoiceGain(int voice) const { return mVoices[(size_t)voice].gain; }
+	juce::int64 getVoiceSynthMark(int voice) const { return voice == 0 ? mSynthMark : mVoices[(size_t)voice].synthMark; }
+
+	// kCopy: makeGrain() copies the windowed source into the grain's buffer.
+	// kReference: grains only keep their analysis range, the window is applied during overlap-add
+	// straight out of the CircularBuffer. The caller must size the CircularBuffer so a grain's
+	// source isn't overwritten before it finishes playing. Takes effect on the next prepare().
+	enum class GrainStorage
+	{
+		kCopy = 0,
+		kReference = 1
+	};
+
+	void setGrainStorage(GrainStorage storage) { mRequestedGrainStorage = storage; }
+	GrainStorage getGrainStorage() const { return mGrainStorage; }
+
+	// prepare() picks the per block grain loop compiled for its channel count (mono or stereo) so the
+	// channel loops are unrolled. Off keeps the generic loop that reads the count every block, for comparing.
+	// Blocks with fewer channels than prepare() was given always take the generic loop. On by default.
+	void setChannelSpecialization(bool shouldSpecialize) { mRequestedChannelSpecialization = shouldSpecialize; }
+	bool isChannelSpecialized() const { return mSpecializedNumChannels > 0; }
+	int getNumChannels() const { return mNumChannels; }
+
+	// kPerBlock: active grains are overlap-added into every block they span.
+	// kOutputRing: makeGrain() windows a grain straight out of the CircularBuffer and adds it, once, into an
+	// output ring covering blockSize + 2 * maxGrainSize samples, a lane per channel plus a window sum lane.
+	// A block only normalizes and clears its slice of the ring, so it costs the same however many grains
+	// there are and however long they are. Grains don't stay active and GrainStorage doesn't apply.
+	// Takes effect on the next prepare().
+	enum class SynthesisEngine
+	{
+		kPerBlock = 0,
+		kOutputRing = 1
+	};
+
+	void setSynthesisEngine(SynthesisEngine engine) { mRequestedSynthesisEngine = engine; }
+	SynthesisEngine getSynthesisEngine() const { return mSynthesisEngine; }
+	int getOutputRingSize() const { return mOutputRing.getNumSamples(); }
+
+	// When every grain in a block has the same length and they start a constant hop apart, the window
+	// sum repeats every hop. Its reciprocal is tabled once per (length, hop) and the per block window
+	// accumulation and divide are skipped. Irregular marks always fall back to accumulating. On by default.
+	void setSteadyStateNormalization(bool shouldUse) { mUseSteadyStateNorm = shouldUse; }
+	bool usedSteadyStateNormalizationLastBlock() const { return mLastBlockSteadyState; }
+	int getNumNormTableFills() const { return mNumNormTableFills; }
+
+	// Formant shift, independent of the pitch the synth marks give. A grain made at a formant factor other than 1
+	// is its windowed source resampled to 2 * period / factor samples around its synth mark, so everything under the
+	// pitch moves up by the factor (or down). The resampling goes through a PolyphaseResampler table, once per
+	// source, into a pool slice, kReference grains that are resampled get one too. A factor of exactly 1 doesn't
+	// resample anything. Off by default. On sizes the pool and window tables for grains up to
+	// maxGrainSize / kMinFormantFactor and gives kReference a pool. Takes effect on the next prepare().
+	// kOutputRing doesn't formant shift, isFormantShifting() stays false after prepare() so the caller can say so.
+	void setFormantShifting(bool shouldShift) { mRequestedFormantShifting = shouldShift; }
+	bool isFormantShifting() const { return mFormantShifting; }
+
+	// Limited to kMinFormantFactor..kMaxFormantFactor. Takes effect from the next grain, picks the resampler
+	// table prepare() built for it, so it's fine to call every block.
+	void setFormantFactor(float factor);
+	float getFormantFactor() const { return mFormantFactor; }
+	int getNumResampledGrains() const { return mNumResampledGrains; } // one per resampled source, like getNumSourceFills()
+	const PolyphaseResampler& getResampler() const { return mResampler; }
 
 	// no pitch being tracked, so we pop the dry block and write it. We also write current active grains.
 	// don't make any new grains though
 	void processDetecting(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer, 
-							std::tuple<int, int> delayedDryBlockRange, std::tuple<int, int> processCounterRange );
+							std::tuple<juce::int64, juce::int64> delayedDryBlockRange, std::tuple<juce::int64, juce::int64> processCounterRange );
 
 	// This is called when a pitch was detected and we are technically "tracking"
 	// this has the ability to make new grains unlike processDetecting()
@@ -39,17 +136,41 @@ public:
 						std::tuple<juce::int64, juce::int64> processCounterRange,
 				  		float detectedPeriod,  float shiftedPeriod);
 
-	std::array<Grain, kNumGrains>& getGrains() { return mGrains; }
+	// processTracking() without processing the block: makes the grains for one analysis mark. Call it for each
+	// mark in the block, oldest first, then processActiveGrains() once.
+	void placeGrains(CircularBuffer& circularBuffer,
+					 std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRangeInSampleCount,
+					 std::tuple<juce::int64, juce::int64, juce::int64> analysisWriteRangeInSampleCount,
+					 std::tuple<juce::int64, juce::int64> processCounterRange,
+					 float detectedPeriod, float shiftedPeriod);
+
+	std::vector<Grain>& getGrains() { return mGrains; }
+	int getGrainCapacity() const { return (int)mGrains.size(); }
+	int getNumActiveGrains() const { return mSchedule.size(); }
+	const GrainSchedule& getSchedule() const { return mSchedule; }
+
+	// grains makeGrain() couldn't make, because none were free or it was longer than maxGrainSize.
+	// Safe to read from any thread.
+	int getNumDroppedGrains() const { return mNumDroppedGrains.load(std::memory_order_relaxed); }
+	void resetNumDroppedGrains() { mNumDroppedGrains.store(0, std::memory_order_relaxed); }
 	juce::int64 getSynthMark() const { return mSynthMark; }
-	void resetSynthMark() { mSynthMark = -1; mCumulativePhase = 0.0; }
+	void resetSynthMark();
 	Window& getWindow() { return mWindow; }
+	const WindowCache& getWindowCache() const { return mWindowCache; }
+	const GrainPool& getGrainPool() const { return mGrainPool; }
+
+	// kCopy grains made from the same analysis range (shifting up makes several per range) share one
+	// windowed copy in the pool. Counts the copies actually made, each extraction is one fill.
+	int getNumSourceFills() const { return mNumSourceFills; }
+	int getNumSourcesInUse() const { return mGrainPool.getNumGrains() - (int)mFreeSources.size(); }
 
 	// Create and activate a new grain
 	void makeGrain(CircularBuffer& circularBuffer,
 				   std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange,
 				   std::tuple<juce::int64, juce::int64, juce::int64> synthRange,
 				   float detectedPeriod,
-				   float shiftedPeriod);
+				   float shiftedPeriod,
+				   int voice = 0);
 
 	// Process all active grains, writing to processBlock
 	void processActiveGrains(juce::AudioBuffer<float>& processBlock,
@@ -58,19 +179,142 @@ public:
 private:
 	friend class GranulatorTester;
 	Window mWindow;
-	juce::AudioBuffer<float> mNormWindowBuffer;
-	juce::AudioBuffer<float> mWetBuffer;
+	GrainStorage mRequestedGrainStorage = GrainStorage::kCopy;
+	GrainStorage mGrainStorage = GrainStorage::kCopy; // latched in prepare()
+	bool mRequestedChannelSpecialization = true;
+	int mNumChannels = kNumGrainChannels;
+	int mSpecializedNumChannels = 0; // channel count mProcessGrains was compiled for, 0 for the generic loop
+
+	using ProcessGrainsFn = void (Granulator::*)(juce::AudioBuffer<float>&, juce::int64, juce::int64);
+	ProcessGrainsFn mProcessGrains = nullptr; // picked in prepare()
+	SynthesisEngine mRequestedSynthesisEngine = SynthesisEngine::kPerBlock;
+	SynthesisEngine mSynthesisEngine = SynthesisEngine::kPerBlock; // latched in prepare()
+	WindowCache mWindowCache;
+	GrainPool mGrainPool; // kCopy and resampled windowed sources, see mSources
+	int mMaxGrainSize = 0;
+	int mMaxResampledGrainSize = 0; // longest grain after formant resampling, mMaxGrainSize without it
+	CircularBuffer* mSourceBuffer = nullptr; // kReference grains read from here, set by makeGrain()
+	juce::AudioBuffer<float> mWindowScratch; // window values for one grain's overlap with the block (kReference) or all of it (kOutputRing)
+
+	// kOutputRing, sample n is at n % size. Everything from mOutputRingStart (the next sample to be read)
+	// up to mOutputRingEnd may hold grains, the rest is clear.
+	juce::AudioBuffer<float> mOutputRing; // a lane per channel, then the window sum lane
+	juce::int64 mOutputRingStart = -1; // -1 until the first grain or block
+	juce::int64 mOutputRingEnd = -1;
+	juce::AudioBuffer<float> mNormWindowBuffer; // a window sum lane per voice, then where the mix covers
+	juce::AudioBuffer<float> mWetBuffer; // mNumChannels lanes per voice
+
+	std::vector<Grain> mGrains; // sized in prepare()
+	std::vector<int> mFreeGrains; // stack of inactive grain indices, lowest on top after prepare()
+	GrainSchedule mSchedule; // active grains by synth start
+	std::atomic<int> mNumDroppedGrains { 0 };
 
-	std::array<Grain, kNumGrains> mGrains;
+	// formant shifting, see setFormantShifting()
+	bool mRequestedFormantShifting = false;
+	bool mFormantShifting = false; // latched in prepare()
+	float mFormantFactor = 1.f;
+	PolyphaseResampler mResampler;
+	juce::AudioBuffer<float> mResampleScratch; // the source's window, then one channel of windowed source padded for the filter
+	int mNumResampledGrains = 0;
 
-	// Tracks when to create the next grain
+	// what each pool slice holds and how many grains play it
+	struct Source
+	{
+		juce::int64 readStart = -1;
+		int sourceSize = 0; // the analysis range's length, grainSize unless it was resampled
+		int grainSize = 0;
+		Window::Shape shape = Window::Shape::kNone;
+		int numHolders = 0;
+	};
+	std::vector<Source> mSources; // one per pool slice
+	std::vector<int> mFreeSources; // stack of unheld slices, lowest on top after prepare()
+	int mLastSourceIndex = -1; // the newest filled slice, the only one a new grain can share
+	int mNumSourceFills = 0;
+
+	// steady state normalization, see setSteadyStateNormalization()
+	bool mUseSteadyStateNorm = true;
+	bool mLastBlockSteadyState = false;
+	std::vector<float> mNormTable; // 1 / window sum at each offset into the hop
+	std::vector<float> mNormTableWindow; // window values the table was summed from
+	std::vector<int> mOverlappingGrains; // scratch, indices of the grains overlapping the block by synth start
+	Window::Shape mNormTableShape = Window::Shape::kNone;
+	int mNormTableGrainSize = 0;
+	int mNormTableSpan = 0;
+	int mNormTableHop = 0;
+	int mNumNormTableFills = 0;
+
+	// Tracks when to create the next grain, voice 0's
 	juce::int64 mSynthMark = -1;
 
+	struct Voice
+	{
+		float shiftRatio = 1.f;
+		float gain = 1.f;
+		juce::int64 synthMark = -1; // voice 0 uses mSynthMark
+	};
+	std::array<Voice, kMaxVoices> mVoices;
+	int mNumVoices = 1;
+	int mMaxNumVoices = 1; // latched in prepare()
+	float mMaxShiftRatio = 1.f;
+
 	// Tracks cumulative phase for grain emission (wraps around 2π)
 	double mCumulativePhase = 0.0;
 
-	// Find an inactive grain slot, returns -1 if none available
-	int _findInactiveGrainIndex();
+	// Makes a grain for every synth mark of one voice up to the next analysis mark
+	void _placeVoice(CircularBuffer& circularBuffer, std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange,
+					 juce::int64 currentAnalysisWriteMark, float detectedPeriod, float shiftedPeriod,
+					 juce::int64& synthMark, int voice);
+
+	// Normalizes each voice's lanes and mixes them into processBlock with the voice gains
+	void _mixVoices(juce::AudioBuffer<float>& processBlock, int numChannels, int numSamples);
+
+	// Pops an inactive grain off the free list, returns -1 if none available.
+	// It isn't scheduled until makeGrain() knows its synth range.
+	int _acquireGrain();
+
+	// Deactivates the grain and puts it back on the free list, the caller takes it out of mSchedule
+	void _retireGrain(int grainIndex);
+
+	// kOutputRing: windows the grain out of circularBuffer and adds whatever hasn't been read yet into the ring.
+	// Returns false if it ends past what the ring covers.
+	bool _addGrainToOutputRing(CircularBuffer& circularBuffer, juce::int64 readStart, juce::int64 synthStart, juce::int64 synthEnd, int grainSize);
+
+	// Moves the ring's read position to blockStart, clearing anything skipped over
+	void _advanceOutputRing(juce::int64 blockStart);
+
+	// Normalizes the ring's slice for the block into processBlock and clears it
+	void _readOutputRing(juce::AudioBuffer<float>& processBlock, juce::int64 blockStart);
+
+	// The per block engine: overlap-adds every grain that overlaps the block and normalizes.
+	// NumChannels of 0 works on whatever processBlock and mNumChannels share, otherwise on exactly NumChannels.
+	template <int NumChannels>
+	void _processGrains(juce::AudioBuffer<float>& processBlock, juce::int64 blockStart, juce::int64 blockEnd);
+
+	// Windows and adds numSamples of a kReference grain, starting grainIndex samples into it, at blockIndex.
+	// The window only goes into mNormWindowBuffer if addToNorm.
+	template <int NumChannels>
+	void _addReferencedGrain(Grain& grain, int grainIndex, int blockIndex, int numSamples, int numChannels, bool addToNorm);
+
+	// If the grains overlapping the block are a regular train with nothing missing, writes the normalization
+	// gain for each sample into mNormWindowBuffer and returns true. Otherwise leaves it alone.
+	bool _writeSteadyStateNorm(juce::int64 blockStart, juce::int64 blockEnd, int numSamples);
+
+	// Sums the window of grainSize, truncated to span samples, every hop into mNormTable and inverts it
+	void _fillNormTable(int grainSize, int span, int hop);
+
+	// Holds the pool slice with the grain's windowed source, filling a free one unless the newest filled
+	// slice is still held and has the same analysis range at the same length. sourceSize is the analysis range's length,
+	// a grain of another length is resampled from it. Returns false if there's no slice to fill.
+	bool _acquireSource(Grain& grain, CircularBuffer& circularBuffer, juce::int64 readStart, int sourceSize);
+
+	// Windows sourceSize samples from readStart and resamples them into the slice's grainSize samples
+	void _resampleSource(int poolIndex, CircularBuffer& circularBuffer, juce::int64 readStart, int sourceSize, int grainSize, int numChannels);
+
+	// lets go of the grain's slice, it's free again once no grain holds it
+	void _releaseSource(Grain& grain);
+
+	// hands the grain's window table back to the cache
+	void _releaseWindow(Grain& grain);
 	
 	// Calculate next synthesis start index
 	void _updateNextSynthStartIndex(float shiftedPeriod);
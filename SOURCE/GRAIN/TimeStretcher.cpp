@@ -0,0 +1,211 @@
+/**
+ * TimeStretcher.cpp
+ * Created by Ryan Devens
+ */
+
+#include "TimeStretcher.h"
+#include "../Util/CircularReadView.h"
+
+TimeStretcher::TimeStretcher()
+{
+}
+
+TimeStretcher::~TimeStretcher()
+{
+}
+
+//=======================================
+void TimeStretcher::prepare(double sampleRate, int blockSize, int numChannels, int minPeriod, int maxPeriod, float maxDelayMs)
+{
+	mSampleRate = sampleRate;
+	mBlockSize = blockSize;
+	mNumChannels = juce::jlimit(1, kNumGrainChannels, numChannels);
+	mMaxPeriod = juce::jmax(2, maxPeriod);
+	mMinPeriod = juce::jlimit(1, mMaxPeriod, minPeriod);
+	mMaxDelayMs = maxDelayMs;
+
+	// about 5 ms grains through noise and silence, the same as a voice in the middle of the range would get
+	mUnvoicedPeriod = juce::jlimit(mMinPeriod, mMaxPeriod, juce::roundToInt(sampleRate * 0.005));
+
+	// the same window setFrequencyRange() gives the longest period
+	const int detectionNumSamples = (mMaxPeriod + 2) * 2;
+	mDetectionBuffer.setSize(1, detectionNumSamples);
+	mDetectionBuffer.clear();
+	mPitchDetector.prepareToPlay(sampleRate, detectionNumSamples);
+	mPitchDetector.setSearchRange(detectionNumSamples, mMinPeriod);
+	mDetectionHop = juce::jmax(1, mMaxPeriod / 2);
+
+	// Half the detection window, or a grain around a mark that's up to 3/4 of a period from the position.
+	// Grains are made up to a period ahead of the block, so the analysis stays that much further back.
+	mReach = detectionNumSamples;
+	mMinDelay = mReach + mMaxPeriod;
+	mMaxDelay = juce::jmax(mMinDelay + blockSize + mMaxPeriod, juce::roundToInt(maxDelayMs * sampleRate / 1000.0));
+
+	// marks are a period apart whatever the stretch, the same as a pitch shift ratio of 1
+	mGranulator.setGrainStorage(Granulator::GrainStorage::kCopy);
+	mGranulator.prepare(sampleRate, blockSize, 2 * mMaxPeriod, mMinPeriod, 1.f, mNumChannels);
+
+	mNumResyncs = 0;
+	mNumDetections = 0;
+	reset();
+}
+
+//=======================================
+void TimeStretcher::setStretchFactor(float factor)
+{
+	mStretchFactor = juce::jlimit(kMinStretchFactor, kMaxStretchFactor, factor);
+}
+
+//=======================================
+void TimeStretcher::reset()
+{
+	mAnalysisPosition = 0.0;
+	mIsAnalysisPlaced = false;
+	mLastAnalysisMark = -1;
+	mLastDetectionPosition = -1;
+	mLastDetectedPeriod = -1.f;
+	mSynthMark = -1;
+	mFirstSample = -1;
+	mLastPeriod = -1;
+	mLastGrainVoiced = false;
+}
+
+//=======================================
+void TimeStretcher::process(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer,
+							std::tuple<juce::int64, juce::int64> processCounterRange)
+{
+	jassert (circularBuffer.getSize() >= getRequiredBufferSize());
+	const juce::int64 blockEnd = std::get<1>(processCounterRange);
+	_render(processBlock, circularBuffer, std::get<0>(processCounterRange), blockEnd, blockEnd, -1);
+}
+
+//=======================================
+void TimeStretcher::processOffline(const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output)
+{
+	const int numInputSamples = input.getNumSamples();
+	const int numChannels = juce::jmin(input.getNumChannels(), mNumChannels);
+	const int numOutputSamples = (int)std::ceil((double)numInputSamples / (double)mStretchFactor);
+	output.setSize(numChannels, numOutputSamples);
+	output.clear();
+
+	// The whole input, with room after it that reads as silence. Reads before the start wrap around into it.
+	CircularBuffer source;
+	source.setSize(input.getNumChannels(), numInputSamples + 2 * mReach + 1);
+	source.pushBuffer(input);
+
+	// grains left from realtime would be at the wrong sample counts
+	prepare(mSampleRate, mBlockSize, mNumChannels, mMinPeriod, mMaxPeriod, mMaxDelayMs);
+
+	for (int blockStart = 0; blockStart < numOutputSamples; blockStart += mBlockSize)
+	{
+		const int numSamples = juce::jmin(mBlockSize, numOutputSamples - blockStart);
+		juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), numChannels, blockStart, numSamples);
+		_render(block, source, blockStart, blockStart + numSamples - 1, -1, numInputSamples);
+	}
+
+	prepare(mSampleRate, mBlockSize, mNumChannels, mMinPeriod, mMaxPeriod, mMaxDelayMs);
+}
+
+//=======================================
+void TimeStretcher::_render(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer, juce::int64 blockStart, juce::int64 blockEnd,
+							juce::int64 newestSample, juce::int64 lastSample)
+{
+	if (mSynthMark < 0)
+	{
+		mSynthMark = blockStart;
+		mFirstSample = blockStart;
+	}
+
+	// every grain that starts by the end of the block, the next one waits until its period is known
+	for (;;)
+	{
+		if (newestSample >= 0)
+			_keepAnalysisInBuffer(newestSample);
+
+		juce::int64 position = (juce::int64)std::floor(mAnalysisPosition);
+		if (lastSample >= 0)
+			position = juce::jlimit((juce::int64)0, lastSample, position);
+
+		const float detectedPeriod = _periodAt(circularBuffer, position);
+		const bool isVoiced = detectedPeriod > 0.f;
+		const int period = isVoiced ? juce::jlimit(mMinPeriod, mMaxPeriod, (int)std::llround(detectedPeriod)) : mUnvoicedPeriod;
+		if (mSynthMark - period > blockEnd)
+			break;
+
+		const juce::int64 analysisMark = _placeAnalysisMark(circularBuffer, position, period, isVoiced);
+		mGranulator.makeGrain(circularBuffer,
+							  {analysisMark - period, analysisMark, analysisMark + period - 1},
+							  {mSynthMark - period, mSynthMark, mSynthMark + period - 1},
+							  (float)period, (float)period);
+
+		// pitch comes from the synth marks, tempo from the analysis
+		mSynthMark += period;
+		mAnalysisPosition += (double)period * (double)mStretchFactor;
+		mLastPeriod = period;
+		mLastGrainVoiced = isVoiced;
+	}
+
+	mGranulator.processActiveGrains(processBlock, {blockStart, blockEnd});
+}
+
+//=======================================
+void TimeStretcher::_keepAnalysisInBuffer(juce::int64 newestSample)
+{
+	const bool isStarting = !mIsAnalysisPlaced;
+	const bool ranAhead = (double)mSynthMark - mAnalysisPosition < (double)mMinDelay;
+	const bool fellBehind = (double)newestSample - mAnalysisPosition > (double)mMaxDelay;
+	if (!isStarting && !ranAhead && !fellBehind)
+		return;
+
+	// Speeding up runs into the newest input, go back as far as the buffer allows so the next run is as long as
+	// it can be, but not to before the input started. Slowing down falls behind the buffer, catch up to the newest.
+	const juce::int64 newestPosition = mSynthMark - mMinDelay;
+	juce::int64 position = newestPosition;
+	if (!isStarting && ranAhead)
+		position = juce::jmin(newestPosition, juce::jmax(newestSample - mMaxDelay, mFirstSample));
+	mAnalysisPosition = (double)position;
+	mIsAnalysisPlaced = true;
+	mLastAnalysisMark = -1;
+	if (!isStarting)
+		mNumResyncs++;
+}
+
+//=======================================
+float TimeStretcher::_periodAt(CircularBuffer& circularBuffer, juce::int64 position)
+{
+	if (mLastDetectionPosition >= 0 && std::abs(position - mLastDetectionPosition) < (juce::int64)mDetectionHop)
+		return mLastDetectedPeriod;
+
+	// left channel, like the analysis marks
+	const int numSamples = mDetectionBuffer.getNumSamples();
+	CircularReadView(circularBuffer, position - numSamples / 2, numSamples).copyTo(0, mDetectionBuffer.getWritePointer(0));
+	mLastDetectedPeriod = mPitchDetector.process(mDetectionBuffer);
+	mLastDetectionPosition = position;
+	mNumDetections++;
+	return mLastDetectedPeriod;
+}
+
+//=======================================
+juce::int64 TimeStretcher::_placeAnalysisMark(CircularBuffer& circularBuffer, juce::int64 position, int period, bool isVoiced)
+{
+	if (!isVoiced)
+	{
+		mLastAnalysisMark = -1;
+		return position;
+	}
+
+	// Slowing down lands on the same mark again, speeding up a few periods on. Only the first mark after a jump
+	// looks at the whole period around the position.
+	juce::int64 candidate = position;
+	int radius = period / 2;
+	if (mLastAnalysisMark >= 0)
+	{
+		const juce::int64 numPeriods = (juce::int64)std::llround((double)(position - mLastAnalysisMark) / (double)period);
+		candidate = mLastAnalysisMark + numPeriods * (juce::int64)period;
+		radius = period / 4;
+	}
+
+	const int peakIndex = CircularReadView(circularBuffer, candidate - radius, radius * 2 + 1).findPeak(0);
+	mLastAnalysisMark = candidate + (peakIndex < 0 ? 0 : peakIndex - radius);
+	return mLastAnalysisMark;
+}
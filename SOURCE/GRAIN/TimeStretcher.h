@@ -0,0 +1,122 @@
+/**
+ * TimeStretcher.h
+ * Created by Ryan Devens
+ *
+ * TD-PSOLA time stretching on the Granulator. It's the same analysis / synthesis split processTracking() uses to
+ * shift pitch, turned the other way around: synth marks advance by the natural period, so the pitch is kept, while
+ * the analysis position advances by period * stretch factor, so the input goes by faster or slower. Slowing down
+ * plays some analysis marks twice, speeding up skips some. The period is detected where the analysis position is,
+ * not at the newest input, and unvoiced stretches are cut into fixed grains.
+ *
+ * Realtime (process()) the input can't be read ahead of what has arrived or further back than the CircularBuffer
+ * holds, so the analysis position is kept between getMinDelay() and getMaxDelay() behind the newest sample and
+ * jumps when it leaves. Offline (processOffline()) the whole input is there and nothing jumps.
+ */
+
+#pragma once
+#include "../Util/Juce_Header.h"
+#include "Granulator.h"
+#include "../PITCH/PitchDetector.h"
+#include "../SUBMODULES/RD/SOURCE/CircularBuffer.h"
+
+static constexpr float kMinStretchFactor = 0.25f;
+static constexpr float kMaxStretchFactor = 4.f;
+
+class TimeStretcher
+{
+public:
+	TimeStretcher();
+	~TimeStretcher();
+
+	// minPeriod and maxPeriod bound the periods detected at the analysis position, grains are two of them.
+	// maxDelayMs is how far behind the input process() lets the analysis fall, see getRequiredBufferSize().
+	// Not for the audio thread.
+	void prepare(double sampleRate, int blockSize, int numChannels, int minPeriod, int maxPeriod, float maxDelayMs);
+
+	// Analysis advances period * factor for every period the synth marks advance: 2 plays the input twice as fast,
+	// 0.5 at half speed, the pitch stays where it was. Limited to kMinStretchFactor..kMaxStretchFactor.
+	// Takes effect from the next grain, call from the thread that calls process().
+	void setStretchFactor(float factor);
+	float getStretchFactor() const { return mStretchFactor; }
+
+	// Closest the analysis gets to the synth marks, which is the latency at a stretch factor of 1: half a detection
+	// window and a grain either side of it, and a grain made ahead of the block
+	int getMinDelay() const { return mMinDelay; }
+
+	// Furthest the analysis gets behind the newest sample
+	int getMaxDelay() const { return mMaxDelay; }
+
+	// Samples the CircularBuffer given to process() has to hold so nothing the analysis reads is overwritten
+	int getRequiredBufferSize() const { return mMaxDelay + mReach + 1; }
+
+	// Realtime. processCounterRange has to be the block that was just pushed into circularBuffer, grains are made
+	// for it and overlap-added in. The analysis starts getMinDelay() behind the synth marks. When it runs out of
+	// input (speeding up) it jumps back getMaxDelay() behind the newest sample, or to the first block since reset(),
+	// and when it falls that far behind (slowing down) it jumps forward to getMinDelay() again.
+	void process(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer,
+				 std::tuple<juce::int64, juce::int64> processCounterRange);
+
+	// Offline. Stretches all of input into output, which is resized to input length / stretch factor.
+	// Same grains as process() without the delay bounds. Allocates, not for the audio thread.
+	// Starts the realtime state over.
+	void processOffline(const juce::AudioBuffer<float>& input, juce::AudioBuffer<float>& output);
+
+	// the next process() starts the analysis and synth marks over from its block, grains still playing finish
+	void reset();
+
+	double getAnalysisPosition() const { return mAnalysisPosition; }
+	juce::int64 getSynthMark() const { return mSynthMark; }
+	int getLastPeriod() const { return mLastPeriod; } // period of the newest grain, -1 before the first
+	bool wasLastGrainVoiced() const { return mLastGrainVoiced; }
+	int getNumResyncs() const { return mNumResyncs; } // jumps process() made to stay inside the buffer
+	int getNumDetections() const { return mNumDetections; }
+	const Granulator& getGranulator() const { return mGranulator; }
+
+private:
+	friend class TimeStretcherTester;
+
+	double mSampleRate = 48000.0;
+	int mBlockSize = 0;
+	int mNumChannels = kNumGrainChannels;
+	int mMinPeriod = 0;
+	int mMaxPeriod = 0;
+	int mUnvoicedPeriod = 0; // grains are two of these where no pitch is found
+	int mReach = 0; // furthest a read goes either side of the analysis position
+	int mMinDelay = 0;
+	int mMaxDelay = 0;
+	float mMaxDelayMs = 0.f;
+
+	float mStretchFactor = 1.f;
+
+	Granulator mGranulator;
+	PitchDetector mPitchDetector;
+	juce::AudioBuffer<float> mDetectionBuffer; // mono, two of the longest periods centred on the analysis position
+	int mDetectionHop = 0; // the analysis moves this far before the period is detected again
+
+	double mAnalysisPosition = 0.0; // absolute sample, fractional so the stretch doesn't drift
+	bool mIsAnalysisPlaced = false; // process() puts it behind the newest sample on its first block
+	juce::int64 mLastAnalysisMark = -1; // -1 after a jump or unvoiced grain, the next mark is found from scratch
+	juce::int64 mLastDetectionPosition = -1;
+	float mLastDetectedPeriod = -1.f;
+	juce::int64 mSynthMark = -1;
+	juce::int64 mFirstSample = -1; // first block after a reset, there's nothing to jump back to before it
+	int mLastPeriod = -1;
+	bool mLastGrainVoiced = false;
+	int mNumResyncs = 0;
+	int mNumDetections = 0;
+
+	// Makes every grain that starts by blockEnd and overlap-adds the block. newestSample < 0 is offline, the
+	// analysis isn't bounded and never reads past lastSample.
+	void _render(juce::AudioBuffer<float>& processBlock, CircularBuffer& circularBuffer, juce::int64 blockStart, juce::int64 blockEnd,
+				 juce::int64 newestSample, juce::int64 lastSample);
+
+	// Moves the analysis position back inside [newestSample - mMaxDelay, mSynthMark - mMinDelay] if it left
+	void _keepAnalysisInBuffer(juce::int64 newestSample);
+
+	// Period at position, detected again once the analysis has moved mDetectionHop. -1 if unvoiced.
+	float _periodAt(CircularBuffer& circularBuffer, juce::int64 position);
+
+	// The pitch mark nearest position. Follows on from the last mark a whole number of periods, refined to the
+	// peak within a quarter period, so marks stay a period apart. Unvoiced grains go where the position is.
+	juce::int64 _placeAnalysisMark(CircularBuffer& circularBuffer, juce::int64 position, int period, bool isVoiced);
+};
@@ -0,0 +1,138 @@
+/**
+ * WindowCache.cpp
+ * Created by Ryan Devens
+ */
+
+#include "WindowCache.h"
+
+WindowCache::WindowCache()
+{
+}
+
+WindowCache::~WindowCache()
+{
+}
+
+//=======================================
+void WindowCache::prepare(int maxLength, int numSlots)
+{
+	mSlotStride = juce::jmax(1, maxLength / 2 + 1);
+	mTables.assign((size_t)(mSlotStride * numSlots), 0.f);
+	mSlots.assign((size_t)numSlots, Slot());
+	mUseCounter = 0;
+	mNumFills = 0;
+}
+
+//=======================================
+int WindowCache::acquire(Window& window, int length)
+{
+	if (length <= 0 || length / 2 + 1 > mSlotStride)
+		return -1;
+
+	const Window::Shape shape = window.getShape();
+	int freeSlot = -1;
+
+	for (int i = 0; i < (int)mSlots.size(); ++i)
+	{
+		Slot& slot = mSlots[(size_t)i];
+		if (slot.length == length && slot.shape == shape)
+		{
+			slot.numHolders++;
+			slot.lastUsed = ++mUseCounter;
+			return i;
+		}
+
+		// prefer an empty slot, otherwise the one nobody has used for longest
+		if (slot.numHolders != 0)
+			continue;
+		if (freeSlot < 0)
+		{
+			freeSlot = i;
+			continue;
+		}
+		const Slot& best = mSlots[(size_t)freeSlot];
+		if (best.length != 0 && (slot.length == 0 || slot.lastUsed < best.lastUsed))
+			freeSlot = i;
+	}
+
+	if (freeSlot < 0 || !_fill(freeSlot, window, length))
+		return -1;
+
+	Slot& slot = mSlots[(size_t)freeSlot];
+	slot.numHolders = 1;
+	slot.lastUsed = ++mUseCounter;
+	return freeSlot;
+}
+
+//=======================================
+void WindowCache::release(int slot)
+{
+	if (slot < 0 || slot >= (int)mSlots.size())
+		return;
+
+	jassert (mSlots[(size_t)slot].numHolders > 0);
+	mSlots[(size_t)slot].numHolders = juce::jmax(0, mSlots[(size_t)slot].numHolders - 1);
+}
+
+//=======================================
+void WindowCache::expand(int slot, int start, int numSamples, float* dest) const
+{
+	const Slot& s = mSlots[(size_t)slot];
+	const float* table = mTables.data() + (size_t)(slot * mSlotStride);
+	const int end = start + numSamples;
+
+	// first half straight out of the table, second half mirrored
+	const int forwardEnd = juce::jmin(end, s.length / 2 + 1);
+	int i = start;
+	if (i < forwardEnd)
+	{
+		juce::FloatVectorOperations::copy(dest, table + i, forwardEnd - i);
+		dest += forwardEnd - i;
+		i = forwardEnd;
+	}
+
+	const int mirror = s.length - s.mirrorOffset;
+	for (; i < end; ++i)
+		*dest++ = table[mirror - i];
+}
+
+//=======================================
+bool WindowCache::_fill(int slot, Window& window, int length)
+{
+	if (window.getPeriod() != length)
+		window.setPeriod(length);
+
+	Slot& s = mSlots[(size_t)slot];
+	float* table = mTables.data() + (size_t)(slot * mSlotStride);
+	const int half = length / 2;
+	for (int i = 0; i <= half; ++i)
+		table[i] = window.getValueAtIndexInPeriod(i);
+
+	// A periodic window mirrors around length / 2 (w[i] == w[length - i]), a symmetric one around
+	// (length - 1) / 2 (w[i] == w[length - 1 - i]). Check which one this shape is at a few points,
+	// loose enough for Window's table lookup at lengths that don't divide its size.
+	auto mirrorsWith = [&](int offset)
+	{
+		for (int i : { 1, half / 2, half - 1 })
+		{
+			if (i <= 0 || length - offset - i <= half)
+				continue;
+			if (std::abs(window.getValueAtIndexInPeriod(length - offset - i) - table[i]) > 1.0e-4f)
+				return false;
+		}
+		return true;
+	};
+
+	s.length = 0;
+	if (mirrorsWith(0))
+		s.mirrorOffset = 0;
+	else if (mirrorsWith(1))
+		s.mirrorOffset = 1;
+	else
+		return false;
+
+	s.shape = window.getShape();
+	s.length = length;
+	mNumFills++;
+	return true;
+}
@@ -0,0 +1,58 @@
+/**
+ * WindowCache.h
+ * Created by Ryan Devens
+ *
+ * Bounded cache of window tables keyed by (shape, length), so making a grain doesn't generate its window.
+ * All slots come out of one block allocated in prepare(), a miss fills a free slot in place.
+ * Windows are symmetric, so a slot only stores the first half (length / 2 + 1 values) and mirrors the rest.
+ * Grains hold a slot while they play, a slot is only reused once nothing holds it. Audio thread only after prepare().
+ */
+
+#pragma once
+#include "../Util/Juce_Header.h"
+#include "../SUBMODULES/RD/SOURCE/Window.h"
+#include <vector>
+
+class WindowCache
+{
+public:
+	WindowCache();
+	~WindowCache();
+
+	// allocates numSlots tables for windows up to maxLength samples. Not for the audio thread.
+	void prepare(int maxLength, int numSlots);
+
+	// Finds or fills the table for a window of length samples in window's current shape, and holds it.
+	// window is set to that period if it isn't already. Returns -1 if every slot is held,
+	// or the shape isn't symmetric, the caller has to read window directly then.
+	int acquire(Window& window, int length);
+	void release(int slot);
+
+	// Writes the window values for [start, start + numSamples) of the slot's window into dest
+	void expand(int slot, int start, int numSamples, float* dest) const;
+
+	int getLength(int slot) const { return mSlots[(size_t)slot].length; }
+	int getNumSlots() const { return (int)mSlots.size(); }
+	int getNumFills() const { return mNumFills; }
+
+private:
+	friend class WindowCacheTester;
+
+	struct Slot
+	{
+		Window::Shape shape = Window::Shape::kNone;
+		int length = 0; // 0 is empty
+		int mirrorOffset = 0; // values past the middle are table[length - mirrorOffset - i]
+		int numHolders = 0;
+		juce::uint32 lastUsed = 0;
+	};
+
+	std::vector<float> mTables; // numSlots * mSlotStride, the first half of each window
+	std::vector<Slot> mSlots;
+	int mSlotStride = 0;
+	juce::uint32 mUseCounter = 0;
+	int mNumFills = 0;
+
+	// fills the slot from window, returns false if the shape doesn't mirror
+	bool _fill(int slot, Window& window, int length);
+};
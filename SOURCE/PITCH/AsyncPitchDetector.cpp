@@ -0,0 +1,145 @@
+/**
+ * AsyncPitchDetector.cpp
+ * Created by Ryan Devens
+ */
+
+#include "AsyncPitchDetector.h"
+#include "PitchDetector.h"
+
+AsyncPitchDetector::AsyncPitchDetector(PitchDetector& detector)
+: juce::Thread("GrainMaker Pitch Detection")
+, mDetector(detector)
+{
+	// nothing to copy into until prepare(), but the slots line up with the FIFOs
+	mWindowSlots.resize((size_t)mWindowFifo.getTotalSize());
+	mWindowEndIndices.assign((size_t)mWindowFifo.getTotalSize(), -1);
+	mResults.resize((size_t)mResultFifo.getTotalSize());
+}
+
+AsyncPitchDetector::~AsyncPitchDetector()
+{
+	stop();
+}
+
+//=======================================
+void AsyncPitchDetector::prepare(int numChannels, int windowNumSamples, int numWindows)
+{
+	stop();
+
+	const int numWindowSlots = juce::jmax(1, numWindows) + 1;
+	mWindowSlots.resize((size_t)numWindowSlots);
+	for (auto& slot : mWindowSlots)
+	{
+		slot.setSize(numChannels, windowNumSamples);
+		slot.clear();
+	}
+	mWindowEndIndices.assign((size_t)numWindowSlots, -1);
+	mWindowFifo.setTotalSize(numWindowSlots);
+
+	const int numResultSlots = juce::jmax(kMinNumResults, 2 * numWindowSlots);
+	mResults.assign((size_t)numResultSlots, Result());
+	mResultFifo.setTotalSize(numResultSlots);
+
+	mWindowFifo.reset();
+	mResultFifo.reset();
+	mNumDroppedWindows.store(0);
+}
+
+//=======================================
+void AsyncPitchDetector::start()
+{
+	if (!isThreadRunning())
+		startThread();
+}
+
+void AsyncPitchDetector::stop()
+{
+	if (isThreadRunning())
+		stopThread(1000);
+}
+
+//=======================================
+bool AsyncPitchDetector::pushWindow(const juce::AudioBuffer<float>& window, juce::int64 endSampleIndex)
+{
+	int start1, size1, start2, size2;
+	mWindowFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+	if (size1 < 1)
+	{
+		mNumDroppedWindows.fetch_add(1);
+		return false;
+	}
+
+	auto& slot = mWindowSlots[(size_t)start1];
+	const int numChannels = juce::jmin(slot.getNumChannels(), window.getNumChannels());
+	const int numSamples = juce::jmin(slot.getNumSamples(), window.getNumSamples());
+	for (int ch = 0; ch < numChannels; ++ch)
+		slot.copyFrom(ch, 0, window, ch, 0, numSamples);
+
+	mWindowEndIndices[(size_t)start1] = endSampleIndex;
+	mWindowFifo.finishedWrite(1);
+	return true;
+}
+
+//=======================================
+bool AsyncPitchDetector::popLatestResult(Result& result)
+{
+	const int numReady = mResultFifo.getNumReady();
+	if (numReady == 0)
+		return false;
+
+	int start1, size1, start2, size2;
+	mResultFifo.prepareToRead(numReady, start1, size1, start2, size2);
+
+	// newest is at the end of whichever block was filled last
+	result = size2 > 0 ? mResults[(size_t)(start2 + size2 - 1)] : mResults[(size_t)(start1 + size1 - 1)];
+
+	mResultFifo.finishedRead(size1 + size2);
+	return true;
+}
+
+//=======================================
+bool AsyncPitchDetector::popResult(Result& result)
+{
+	int start1, size1, start2, size2;
+	mResultFifo.prepareToRead(1, start1, size1, start2, size2);
+	if (size1 < 1)
+		return false;
+
+	result = mResults[(size_t)start1];
+	mResultFifo.finishedRead(1);
+	return true;
+}
+
+//=======================================
+void AsyncPitchDetector::run()
+{
+	while (!threadShouldExit())
+	{
+		if (mWindowFifo.getNumReady() == 0)
+		{
+			// polling instead of having the audio thread signal us, signalling takes a lock
+			wait(1);
+			continue;
+		}
+
+		int start1, size1, start2, size2;
+		mWindowFifo.prepareToRead(1, start1, size1, start2, size2);
+
+		Result result;
+		result.period = mDetector.process(mWindowSlots[(size_t)start1]);
+		result.probability = result.period > 0.f ? (float)mDetector.getCurrentProbability() : 0.f;
+		result.sampleIndex = mWindowEndIndices[(size_t)start1];
+
+		mWindowFifo.finishedRead(1);
+
+		// if the audio thread stopped draining, drop this result, the next one will be fresher anyway
+		int wStart1, wSize1, wStart2, wSize2;
+		mResultFifo.prepareToWrite(1, wStart1, wSize1, wStart2, wSize2);
+		if (wSize1 > 0)
+		{
+			mResults[(size_t)wStart1] = result;
+			mResultFifo.finishedWrite(1);
+		}
+	}
+}
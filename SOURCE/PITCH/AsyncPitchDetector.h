@@ -0,0 +1,69 @@
+/**
+ * AsyncPitchDetector.h
+ * Created by Ryan Devens
+ *
+ * Runs a PitchDetector on a worker thread so detection cost stays off the audio thread.
+ * Detection windows go in through a wait-free SPSC queue of preallocated slots,
+ * results come back through a second SPSC queue that the audio thread drains.
+ * Owned by the Processor, which decides how stale a result is allowed to be.
+ */
+
+#pragma once
+#include "../Util/Juce_Header.h"
+#include <vector>
+
+class PitchDetector;
+
+class AsyncPitchDetector : private juce::Thread
+{
+public:
+	struct Result
+	{
+		float period = -1.f;
+		float probability = 0.f;
+		juce::int64 sampleIndex = -1; // last sample (in process counter time) of the window this result came from
+	};
+
+	explicit AsyncPitchDetector(PitchDetector& detector);
+	~AsyncPitchDetector() override;
+
+	// Allocates room for numWindows windows waiting for the worker (and twice that many results waiting for the
+	// audio thread), stops the worker if it was running. Not for the audio thread.
+	void prepare(int numChannels, int windowNumSamples, int numWindows = kDefaultNumWindows);
+	int getNumWindows() const { return mWindowFifo.getTotalSize() - 1; }
+
+	void start();
+	void stop();
+	bool isRunning() const { return isThreadRunning(); }
+
+	// Audio thread. Copies the window into a free slot, returns false (and counts a drop) if the worker is behind.
+	bool pushWindow(const juce::AudioBuffer<float>& window, juce::int64 endSampleIndex);
+
+	// Audio thread. Drains every published result and keeps the newest, returns false if nothing new arrived.
+	bool popLatestResult(Result& result);
+
+	// Audio thread. Takes the oldest published result, returns false if there's none.
+	bool popResult(Result& result);
+
+	int getNumDroppedWindows() const { return mNumDroppedWindows.load(); }
+
+private:
+	void run() override;
+
+	static constexpr int kDefaultNumWindows = 3;
+	static constexpr int kMinNumResults = 16;
+
+	PitchDetector& mDetector;
+
+	// a FIFO of n slots holds n - 1, so both have one spare
+	juce::AbstractFifo mWindowFifo { kDefaultNumWindows + 1 };
+	std::vector<juce::AudioBuffer<float>> mWindowSlots;
+	std::vector<juce::int64> mWindowEndIndices;
+
+	juce::AbstractFifo mResultFifo { kMinNumResults };
+	std::vector<Result> mResults;
+
+	std::atomic<int> mNumDroppedWindows { 0 };
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AsyncPitchDetector)
+};
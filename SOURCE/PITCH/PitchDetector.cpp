@@ -1,5 +1,6 @@
 #include "PitchDetector.h"
 #include "../../SUBMODULES/RD/SOURCE/BufferMath.h" // YIN stuff is here
+#include "../Util/SimdKernels.h"
 
 //
 PitchDetector::PitchDetector()
@@ -21,24 +22,213 @@ void PitchDetector::prepareToPlay(double sampleRate, int blockSize)
     mSampleRate = sampleRate;
 
 	mHalfBlock = (blockSize / 2);
+	mMaxHalfBlock = mHalfBlock;
+	mMinTau = 1;
 	
 	differenceBuffer.setSize(1, mHalfBlock);
 	differenceBuffer.clear();
 	cmndBuffer.setSize(1, mHalfBlock);
 	cmndBuffer.clear();
+
+	// lags go up to mHalfBlock, so the correlation needs room for 2 * mHalfBlock without circular wrap.
+	// A narrower search range gets a smaller plan, so every order up to that is planned here.
+	int maxFFTOrder = 0;
+	while((1 << maxFFTOrder) < mHalfBlock * 2)
+		++maxFFTOrder;
+
+	mFFTs.clear();
+	mFFTs.resize((size_t)maxFFTOrder + 1);
+	for(int order = juce::jmin(3, maxFFTOrder); order <= maxFFTOrder; ++order) // setSearchRange() never goes under 8 samples
+		mFFTs[(size_t)order] = std::make_unique<juce::dsp::FFT>(order);
+	_selectFFT();
+	mFFTFrameScratch.assign(static_cast<size_t>(2 << maxFFTOrder), 0.f);
+	mFFTSignalScratch.assign(static_cast<size_t>(2 << maxFFTOrder), 0.f);
+	mEnergyPrefix.assign(static_cast<size_t>(mHalfBlock * 2 + 1), 0.0);
+
+	// streaming history is mirrored (2x) so lagged reads are always contiguous
+	mStreamHistory.assign(static_cast<size_t>(mHalfBlock * 4), 0.f);
+	mStreamSums.assign(static_cast<size_t>(mHalfBlock), 0.0);
+	mStreamSamplesPushed = 0;
+
+	mState.store(State::kDetecting);
+
+	// coarse search runs the same YIN steps on a window decimated by mDecimationFactor
+	mDecimationFactor = mRequestedDecimationFactor;
+	const int coarseHalfBlock = juce::jmax(2, mHalfBlock / mDecimationFactor);
+	mCoarseWindow.setSize(1, coarseHalfBlock * 2);
+	mCoarseWindow.clear();
+	mCoarseDifference.setSize(1, coarseHalfBlock);
+	mCoarseDifference.clear();
+	mCoarseCmnd.setSize(1, coarseHalfBlock);
+	mCoarseCmnd.clear();
+
+	// anti alias, cutoff a little under the decimated nyquist
+	const int numTaps = mDecimationFactor * 8 + 1;
+	const double cutoff = 0.45 / (double)mDecimationFactor; // cycles per sample at the full rate
+	const double center = (double)(numTaps - 1) * 0.5;
+	mDecimationTaps.assign((size_t)numTaps, 0.f);
+	double tapSum = 0.0;
+	for(int k = 0; k < numTaps; ++k)
+	{
+		const double t = (double)k - center;
+		const double sinc = t == 0.0 ? 1.0 : std::sin(juce::MathConstants<double>::twoPi * cutoff * t) / (juce::MathConstants<double>::pi * 2.0 * cutoff * t);
+		const double hann = 0.5 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * (double)k / (double)(numTaps - 1));
+		mDecimationTaps[(size_t)k] = (float)(sinc * hann);
+		tapSum += sinc * hann;
+	}
+	for(auto& tap : mDecimationTaps)
+		tap = (float)(tap / tapSum); // unity gain at DC
 }
 
 
+//
+void PitchDetector::setFrequencyRange(float minHz, float maxHz)
+{
+	if(minHz <= 0.f || maxHz <= 0.f)
+	{
+		setSearchRange(mMaxHalfBlock * 2, 1);
+		return;
+	}
+
+	// longest period needs a couple of lags past it for the dip and the interpolation
+	const int maxPeriod = (int)std::ceil(mSampleRate / (double)juce::jmin(minHz, maxHz));
+	const int minPeriod = (int)std::floor(mSampleRate / (double)juce::jmax(minHz, maxHz));
+	setSearchRange((maxPeriod + 2) * 2, minPeriod);
+}
+
+//
+void PitchDetector::setSearchRange(int windowNumSamples, int minTau)
+{
+	mHalfBlock = juce::jlimit(4, juce::jmax(4, mMaxHalfBlock), windowNumSamples / 2);
+	mMinTau = juce::jlimit(1, mHalfBlock - 2, minTau);
+
+	// stays inside what prepareToPlay() allocated, so this never allocates
+	differenceBuffer.setSize(1, mHalfBlock, false, false, true);
+	cmndBuffer.setSize(1, mHalfBlock, false, false, true);
+
+	const int coarseHalfBlock = juce::jmax(2, mHalfBlock / mDecimationFactor);
+	mCoarseWindow.setSize(1, coarseHalfBlock * 2, false, false, true);
+	mCoarseDifference.setSize(1, coarseHalfBlock, false, false, true);
+	mCoarseCmnd.setSize(1, coarseHalfBlock, false, false, true);
+	_selectFFT();
+
+	// running sums and the tracked period belong to the old range
+	resetStream();
+	mState.store(State::kDetecting);
+}
+
 //
 float PitchDetector::process(juce::AudioBuffer<float>& buffer)
 {
+	if(mState.load() == State::kTracking && mTrackingEnabled.load())
+	{
+		float trackedPeriod = _processTracking(buffer);
+		if(trackedPeriod > 0.f)
+			return trackedPeriod;
+
+		// lost lock, fall through to a full search
+		mState.store(State::kDetecting);
+	}
+
 	float periodEstimate = -1.f;
-	differenceBuffer.clear();
-	cmndBuffer.clear();
-	// /* Step 1: Calculates the squared difference of the signal with a shifted version of itself. */
-	BufferMath::yin_difference(buffer, differenceBuffer, mHalfBlock-1);
+	if(mSearchMode.load() == SearchMode::kCoarseToFine)
+	{
+		periodEstimate = _processCoarseToFine(buffer);
+	}
+	else if(mDifferenceEngine.load() == DifferenceEngine::kFused)
+	{
+		periodEstimate = _processFused(buffer);
+	}
+	else
+	{
+		differenceBuffer.clear();
+		cmndBuffer.clear();
+		// /* Step 1: Calculates the squared difference of the signal with a shifted version of itself. */
+		if(mDifferenceEngine.load() == DifferenceEngine::kFFT && mFFT != nullptr)
+			_fftDifference(buffer);
+		else
+			SimdKernels::yinDifference(buffer.getReadPointer(0), differenceBuffer.getWritePointer(0), mHalfBlock,
+									   juce::jmin(mHalfBlock - 1, buffer.getNumSamples() - mHalfBlock));
+
+		periodEstimate = _estimatePeriodFromDifference();
+		mLastNumLagsSearched = mHalfBlock;
+	}
+
+	mState.store(periodEstimate > 0.f ? State::kTracking : State::kDetecting);
+	return periodEstimate;
+}
+
+//
+float PitchDetector::processStreaming(const juce::AudioBuffer<float>& newSamples)
+{
+	if(mStreamSums.empty())
+		return -1.f;
 
-	BufferMath::yin_normalized_difference(differenceBuffer, cmndBuffer);
+	const int windowSize = mHalfBlock;
+	const int historySize = mHalfBlock * 2;
+	const float* input = newSamples.getReadPointer(0);
+
+	for(int i = 0; i < newSamples.getNumSamples(); ++i)
+	{
+		const int writePos = static_cast<int>(mStreamSamplesPushed % historySize);
+		mStreamHistory[(size_t)writePos] = input[i];
+		mStreamHistory[(size_t)(writePos + historySize)] = input[i];
+
+		// history[newest - k] for any k < historySize, no wrap needed thanks to the mirrored copy
+		const float* newest = mStreamHistory.data() + writePos + historySize;
+		const float* expired = newest - windowSize;
+
+		// lags we can already pair the new sample with, and lags whose oldest term drops out of the window
+		const int numAddLags = (int)juce::jmin((juce::int64)windowSize, mStreamSamplesPushed + 1);
+		const int numRemoveLags = (int)juce::jlimit((juce::int64)0, (juce::int64)windowSize, mStreamSamplesPushed - windowSize + 1);
+
+		for(int tau = 1; tau < numAddLags; ++tau)
+		{
+			const double delta = (double)newest[0] - (double)newest[-tau];
+			mStreamSums[(size_t)tau] += delta * delta;
+		}
+		for(int tau = 1; tau < numRemoveLags; ++tau)
+		{
+			const double delta = (double)expired[0] - (double)expired[-tau];
+			mStreamSums[(size_t)tau] -= delta * delta;
+		}
+
+		++mStreamSamplesPushed;
+	}
+
+	// every lag needs a full window of pairs before the sums mean anything
+	if(mStreamSamplesPushed < historySize)
+		return -1.f;
+
+	float* diff = differenceBuffer.getWritePointer(0);
+	diff[0] = 0.f;
+	for(int tau = 1; tau < windowSize; ++tau)
+		diff[tau] = static_cast<float>(juce::jmax(0.0, mStreamSums[(size_t)tau])); // drift guard
+
+	// the sums are kept for every lag anyway, so there is no narrow search here. Just keep the state honest.
+	float periodEstimate = _estimatePeriodFromDifference();
+	mState.store(periodEstimate > 0.f ? State::kTracking : State::kDetecting);
+	return periodEstimate;
+}
+
+//
+void PitchDetector::resetStream()
+{
+	std::fill(mStreamHistory.begin(), mStreamHistory.end(), 0.f);
+	std::fill(mStreamSums.begin(), mStreamSums.end(), 0.0);
+	mStreamSamplesPushed = 0;
+}
+
+//
+float PitchDetector::_estimatePeriodFromDifference()
+{
+	float periodEstimate = -1.f;
+
+	SimdKernels::yinNormalizedDifference(differenceBuffer.getReadPointer(0), cmndBuffer.getWritePointer(0), cmndBuffer.getNumSamples());
+
+	// lags shorter than the highest allowed pitch can never win the threshold search
+	if(mMinTau > 1)
+		juce::FloatVectorOperations::fill(cmndBuffer.getWritePointer(0), 1.f, mMinTau);
 
 	int tauEstimate = BufferMath::yin_absolute_threshold(cmndBuffer, mThreshold);
 
@@ -47,6 +237,7 @@ float PitchDetector::process(juce::AudioBuffer<float>& buffer)
 		// doing difference buffer on purpose per yin paper
 		periodEstimate = BufferMath::yin_parabolic_interpolation(cmndBuffer, tauEstimate);
 		mCurrentPeriod.store(periodEstimate);
+		mProbability.store(1.0 - (double)cmndBuffer.getSample(0, tauEstimate));
 		// pitchInHertz = mSampleRate / bestTauEstimate;
 	}
 
@@ -67,4 +258,305 @@ const double PitchDetector::getCurrentPeriod()
 	return mCurrentPeriod.load();
 }
 
+const double PitchDetector::getCurrentProbability()
+{
+	return mProbability.load();
+}
+
+//
+void PitchDetector::setDifferenceEngine(DifferenceEngine engine)
+{
+	mDifferenceEngine.store(engine);
+}
+
+PitchDetector::DifferenceEngine PitchDetector::getDifferenceEngine() const
+{
+	return mDifferenceEngine.load();
+}
+
+//
+void PitchDetector::setSearchMode(SearchMode mode)
+{
+	mSearchMode.store(mode);
+}
+
+PitchDetector::SearchMode PitchDetector::getSearchMode() const
+{
+	return mSearchMode.load();
+}
+
+void PitchDetector::setDecimationFactor(int factor)
+{
+	jassert(factor == 2 || factor == 4);
+	mRequestedDecimationFactor = factor == 2 ? 2 : 4;
+}
+
+void PitchDetector::setTrackingBand(float fractionOfPeriod)
+{
+	mTrackingBand.store(juce::jlimit(0.01f, 0.9f, fractionOfPeriod));
+}
+
+void PitchDetector::setTrackingEnabled(bool shouldTrack)
+{
+	mTrackingEnabled.store(shouldTrack);
+	if(!shouldTrack)
+		mState.store(State::kDetecting);
+}
+
+//
+float PitchDetector::_processTracking(const juce::AudioBuffer<float>& buffer)
+{
+	const float trackedPeriod = static_cast<float>(mCurrentPeriod.load());
+	const float band = mTrackingBand.load();
+	const int lowTau = juce::jmax(juce::jmax(2, mMinTau), (int)std::floor(trackedPeriod * (1.f - band)));
+	const int highTau = juce::jmin(mHalfBlock - 2, (int)std::ceil(trackedPeriod * (1.f + band)));
+
+	if(trackedPeriod <= 0.f || highTau - lowTau < 2 || buffer.getNumSamples() < mHalfBlock * 2)
+		return -1.f;
+
+	const float* x = buffer.getReadPointer(0);
+
+	mEnergyPrefix[0] = 0.0;
+	for(int i = 0; i < mHalfBlock * 2; ++i)
+		mEnergyPrefix[(size_t)i + 1] = mEnergyPrefix[(size_t)i] + (double)x[i] * (double)x[i];
+	const double frameEnergy = mEnergyPrefix[(size_t)mHalfBlock];
+
+	// No cumulative mean without the lags below the band, so normalize by the energy of both frames instead.
+	// d / (r0 + r_tau) = 1 - normalized correlation, ~0 when periodic and ~1 for noise, same scale as the cmnd.
+	float* diff = differenceBuffer.getWritePointer(0);
+	float* cmnd = cmndBuffer.getWritePointer(0);
+	int bestTau = lowTau;
+	for(int tau = lowTau - 1; tau <= highTau + 1; ++tau)
+	{
+		const double laggedEnergy = mEnergyPrefix[(size_t)(tau + mHalfBlock)] - mEnergyPrefix[(size_t)tau];
+		const double totalEnergy = frameEnergy + laggedEnergy;
+		diff[tau] = _differenceAtLag(x, tau);
+		cmnd[tau] = totalEnergy > 1.0e-12 ? (float)((double)diff[tau] / totalEnergy) : 1.f;
+
+		if(tau >= lowTau && tau <= highTau && cmnd[tau] < cmnd[bestTau])
+			bestTau = tau;
+	}
+	mLastNumLagsSearched = highTau - lowTau + 3;
+
+	// pitch moved out of the band, or stopped being periodic
+	const double lockThreshold = juce::jmax(mThreshold.load(), (double)DEFAULT_THRESHOLD);
+	if(bestTau == lowTau || bestTau == highTau || cmnd[bestTau] > lockThreshold)
+		return -1.f;
+
+	// A jump up an octave (or an octave and a fifth) still dips at the tracked lag, the full search would take the
+	// shorter one. Two more lags to check is still far cheaper than searching below the band.
+	for(int divisor = 2; divisor <= 3; ++divisor)
+	{
+		const int subTau = (int)std::lround((float)bestTau / (float)divisor);
+		if(subTau < juce::jmax(2, mMinTau))
+			break;
+
+		const double laggedEnergy = mEnergyPrefix[(size_t)(subTau + mHalfBlock)] - mEnergyPrefix[(size_t)subTau];
+		const double totalEnergy = frameEnergy + laggedEnergy;
+		if(totalEnergy > 1.0e-12 && (double)_differenceAtLag(x, subTau) / totalEnergy <= lockThreshold)
+			return -1.f;
+	}
+
+	const float periodEstimate = BufferMath::yin_parabolic_interpolation(cmndBuffer, bestTau);
+	mCurrentPeriod.store(periodEstimate);
+	mProbability.store(1.0 - (double)cmndBuffer.getSample(0, bestTau));
+	return periodEstimate;
+}
+
+//
+float PitchDetector::_processFused(const juce::AudioBuffer<float>& buffer)
+{
+	// no clears, every bin we read below is written first in this sweep
+	const float* x = buffer.getReadPointer(0);
+	float* diff = differenceBuffer.getWritePointer(0);
+	float* cmnd = cmndBuffer.getWritePointer(0);
+	const float threshold = static_cast<float>(mThreshold.load());
+	const int lastTau = juce::jmin(mHalfBlock - 1, buffer.getNumSamples() - mHalfBlock);
+
+	diff[0] = 0.f;
+	cmnd[0] = 1.f;
+
+	double runningSum = 0.0;
+	int candidateTau = -1;
+	int tau = 1;
+	for(; tau <= lastTau; ++tau)
+	{
+		diff[tau] = _differenceAtLag(x, tau);
+		runningSum += (double)diff[tau];
+		cmnd[tau] = runningSum > 0.0 ? (float)((double)diff[tau] * (double)tau / runningSum) : 1.f;
+
+		if(candidateTau < 0)
+		{
+			if(tau >= mMinTau && cmnd[tau] < threshold)
+				candidateTau = tau;
+		}
+		else if(cmnd[tau] < cmnd[candidateTau])
+		{
+			candidateTau = tau; // still going down
+		}
+		else
+		{
+			break; // bottomed out, cmnd[candidateTau + 1] is already written for the interpolation
+		}
+	}
+	mLastNumLagsSearched = juce::jmin(tau, lastTau) + 1;
+
+	if(candidateTau <= 0)
+		return -1.f;
+
+	// ran off the end while still descending, no right neighbour to interpolate with
+	const float periodEstimate = candidateTau < tau && candidateTau < lastTau
+		? BufferMath::yin_parabolic_interpolation(cmndBuffer, candidateTau)
+		: (float)candidateTau;
+
+	mCurrentPeriod.store(periodEstimate);
+	mProbability.store(1.0 - (double)cmndBuffer.getSample(0, candidateTau));
+	return periodEstimate;
+}
+
+//
+float PitchDetector::_processCoarseToFine(const juce::AudioBuffer<float>& buffer)
+{
+	const int factor = mDecimationFactor;
+
+	// Coarse: plain YIN on the decimated window
+	_decimateForCoarseSearch(buffer);
+	mCoarseDifference.clear();
+	mCoarseCmnd.clear();
+	BufferMath::yin_difference(mCoarseWindow, mCoarseDifference, mCoarseDifference.getNumSamples() - 1);
+	BufferMath::yin_normalized_difference(mCoarseDifference, mCoarseCmnd);
+	if(mMinTau / factor > 1)
+		juce::FloatVectorOperations::fill(mCoarseCmnd.getWritePointer(0), 1.f, mMinTau / factor);
+	// lags are quantized to the factor, so a period between two coarse lags never dips as low as it does at full rate
+	const double coarseThreshold = juce::jmax(mThreshold.load(), (double)DEFAULT_THRESHOLD);
+	const int coarseTau = BufferMath::yin_absolute_threshold(mCoarseCmnd, coarseThreshold);
+
+	if(coarseTau <= 0)
+		return -1.f;
+
+	// Fine: full rate lags around coarseTau * factor. Keep one extra lag each side for the interpolation.
+	const float* x = buffer.getReadPointer(0);
+	const int centerTau = coarseTau * factor;
+	const int firstTau = juce::jmax(1, centerTau - factor - 1);
+	const int lastTau = juce::jmin(mHalfBlock - 2, centerTau + factor + 1);
+
+	if(lastTau - firstTau < 2)
+		return -1.f;
+
+	float* diff = differenceBuffer.getWritePointer(0);
+	int bestTau = firstTau + 1;
+	for(int tau = firstTau; tau <= lastTau; ++tau)
+	{
+		diff[tau] = _differenceAtLag(x, tau);
+		if(tau > firstTau && tau < lastTau && diff[tau] < diff[bestTau])
+			bestTau = tau;
+	}
+
+	// No cumulative mean at full rate, but over a few lags it is close to constant.
+	// Scale the neighbourhood so the dip sits at the coarse cmnd value, interpolation doesn't care about scale.
+	const float scale = mCoarseCmnd.getSample(0, coarseTau) / juce::jmax(diff[bestTau], 1.0e-9f);
+	float* cmnd = cmndBuffer.getWritePointer(0);
+	for(int tau = firstTau; tau <= lastTau; ++tau)
+		cmnd[tau] = diff[tau] * scale;
+
+	const float periodEstimate = BufferMath::yin_parabolic_interpolation(cmndBuffer, bestTau);
+	mCurrentPeriod.store(periodEstimate);
+	mProbability.store(1.0 - (double)cmndBuffer.getSample(0, bestTau));
+	mLastNumLagsSearched = mCoarseDifference.getNumSamples() + (lastTau - firstTau + 1);
+	return periodEstimate;
+}
+
+//
+void PitchDetector::_decimateForCoarseSearch(const juce::AudioBuffer<float>& buffer)
+{
+	const int factor = mDecimationFactor;
+	const int numTaps = (int)mDecimationTaps.size();
+	const int center = numTaps / 2;
+	const int numInput = buffer.getNumSamples();
+	const float* x = buffer.getReadPointer(0);
+	float* y = mCoarseWindow.getWritePointer(0);
+
+	// only compute the outputs we keep
+	for(int m = 0; m < mCoarseWindow.getNumSamples(); ++m)
+	{
+		const int inputCenter = m * factor;
+		float acc = 0.f;
+		if(inputCenter - center >= 0 && inputCenter + center < numInput)
+		{
+			const float* xk = x + inputCenter - center;
+			for(int k = 0; k < numTaps; ++k)
+				acc += mDecimationTaps[(size_t)k] * xk[k];
+		}
+		else
+		{
+			for(int k = 0; k < numTaps; ++k)
+			{
+				const int i = juce::jlimit(0, numInput - 1, inputCenter - center + k); // hold the edges
+				acc += mDecimationTaps[(size_t)k] * x[i];
+			}
+		}
+		y[m] = acc;
+	}
+}
+
+//
+float PitchDetector::_differenceAtLag(const float* x, int tau) const
+{
+	return SimdKernels::sumSquaredDifference(x, x + tau, mHalfBlock);
+}
+
+//
+void PitchDetector::_selectFFT()
+{
+	int fftOrder = 0;
+	while((1 << fftOrder) < mHalfBlock * 2)
+		++fftOrder;
+	mFFT = fftOrder < (int)mFFTs.size() ? mFFTs[(size_t)fftOrder].get() : nullptr;
+}
+
+//
+void PitchDetector::_fftDifference(const juce::AudioBuffer<float>& buffer)
+{
+	const int fftSize = mFFT->getSize();
+	const int numSignalSamples = juce::jmin(buffer.getNumSamples(), mHalfBlock * 2);
+	const int frameSize = juce::jmin(mHalfBlock, numSignalSamples);
+	const float* x = buffer.getReadPointer(0);
+
+	// frame is the first half of the window, signal is the whole window. acf(tau) = sum frame[j] * signal[j + tau]
+	// The transforms only read the first fftSize samples, so only the padding up to there needs clearing.
+	juce::FloatVectorOperations::copy(mFFTFrameScratch.data(), x, frameSize);
+	juce::FloatVectorOperations::clear(mFFTFrameScratch.data() + frameSize, fftSize - frameSize);
+	juce::FloatVectorOperations::copy(mFFTSignalScratch.data(), x, numSignalSamples);
+	juce::FloatVectorOperations::clear(mFFTSignalScratch.data() + numSignalSamples, fftSize - numSignalSamples);
+
+	mFFT->performRealOnlyForwardTransform(mFFTFrameScratch.data(), true);
+	mFFT->performRealOnlyForwardTransform(mFFTSignalScratch.data(), true);
+
+	// cross spectrum conj(Frame) * Signal, only non-negative bins are needed by the real inverse
+	auto* frameBins = reinterpret_cast<std::complex<float>*>(mFFTFrameScratch.data());
+	auto* signalBins = reinterpret_cast<std::complex<float>*>(mFFTSignalScratch.data());
+	for(int bin = 0; bin <= fftSize / 2; ++bin)
+		frameBins[bin] = std::conj(frameBins[bin]) * signalBins[bin];
+
+	// JUCE scales the inverse by 1 / fftSize, so this is the plain correlation
+	mFFT->performRealOnlyInverseTransform(mFFTFrameScratch.data());
+	const float* acf = mFFTFrameScratch.data();
+
+	mEnergyPrefix[0] = 0.0;
+	for(int i = 0; i < numSignalSamples; ++i)
+		mEnergyPrefix[(size_t)i + 1] = mEnergyPrefix[(size_t)i] + (double)x[i] * (double)x[i];
+
+	float* diff = differenceBuffer.getWritePointer(0);
+	const int maxTau = juce::jmin(differenceBuffer.getNumSamples(), numSignalSamples - frameSize + 1);
+	const double frameEnergy = mEnergyPrefix[(size_t)frameSize];
+
+	diff[0] = 0.f;
+	for(int tau = 1; tau < maxTau; ++tau)
+	{
+		const double laggedEnergy = mEnergyPrefix[(size_t)(tau + frameSize)] - mEnergyPrefix[(size_t)tau];
+		const double d = frameEnergy + laggedEnergy - 2.0 * (double)acf[tau];
+		diff[tau] = static_cast<float>(juce::jmax(0.0, d)); // rounding can dip just below zero at perfect periodicity
+	}
+}
+
 //
@@ -2,6 +2,8 @@
 //  Made by Ryan Devens, 2024-07-12 
 //
 
+#pragma once
+
 #define DEFAULT_SAMPLE_RATE 48000
 #define DEFAULT_BUFFER_SIZE 1024
 #define DEFAULT_THRESHOLD 0.15
@@ -11,7 +13,9 @@
     ATP handles this with two classes I believe, but I will handle it will a single class and two modes.
     Detection and Tracking.
 
-    There are different optimizations and callbacks once we have "detected" a pitch and enter tracking mode
+    There are different optimizations and callbacks once we have "detected" a pitch and enter tracking mode.
+    While tracking, only lags within mTrackingBand of the current period are evaluated.
+    If the best lag is not periodic enough or sits on the edge of the band we lose lock and do a full search.
 */
 
 #include "Util/Juce_Header.h"
@@ -28,13 +32,68 @@ public:
     // split it up however you like, this tells you what pitch is the fundamental in that buffer.
     float process(juce::AudioBuffer<float>& buffer);
 
+    // Streaming mode: only pass the samples that arrived since the last call (channel 0 is used).
+    // Keeps running per-lag sums over the newest mHalfBlock samples, so cost scales with the hop, not the window.
+    // Returns -1 until 2 * mHalfBlock samples have been pushed.
+    float processStreaming(const juce::AudioBuffer<float>& newSamples);
+    void resetStream();
+
     const double getCurrentPitch();
     const double getCurrentPeriod();
+    const double getCurrentProbability(); // 1 - cmnd at the chosen tau
+
+    // How the YIN difference function is computed, can be switched while running
+    enum class DifferenceEngine
+    {
+        kScalar = 0, // direct O(N^2) sum over every lag, vectorized by SimdKernels (Isa::kScalar is the plain reference)
+        kFFT = 1, // autocorrelation through juce::dsp::FFT, O(N log N)
+        kFused = 2 // difference, cumulative mean and threshold in one sweep over tau, stops after the first dip
+    };
+
+    void setDifferenceEngine(DifferenceEngine engine);
+    DifferenceEngine getDifferenceEngine() const;
+
+    // How process() searches the lags
+    enum class SearchMode
+    {
+        kFull = 0, // every lag up to mHalfBlock at full rate
+        kCoarseToFine = 1 // YIN on a decimated window, then only the neighbourhood of the coarse tau at full rate
+    };
+
+    void setSearchMode(SearchMode mode);
+    SearchMode getSearchMode() const;
+
+    // 2 or 4, takes effect on the next prepareToPlay() since the coarse buffers are sized from it
+    void setDecimationFactor(int factor);
+    int getDecimationFactor() const { return mDecimationFactor; } // the one in use
+
+    // Clamp the lag search to a frequency range. The window shrinks to 2x the longest allowed period,
+    // so higher voices cost less. Never grows past what prepareToPlay() allocated.
+    // minHz or maxHz <= 0 goes back to the full prepared range. Call from the thread that calls process().
+    void setFrequencyRange(float minHz, float maxHz);
+    void setSearchRange(int windowNumSamples, int minTau);
+    int getWindowNumSamples() const { return mHalfBlock * 2; }
+    int getMinTau() const { return mMinTau; }
+
+    enum class State
+    {
+        kDetecting = 0, // no lock, full search every call
+        kTracking = 1 // locked on to mCurrentPeriod, narrow search
+    };
+
+    State getState() const { return mState.load(); }
+
+    // Fraction of the current period searched either side while tracking (0.2 -> 0.8P to 1.2P)
+    void setTrackingBand(float fractionOfPeriod);
+    float getTrackingBand() const { return mTrackingBand.load(); }
+    void setTrackingEnabled(bool shouldTrack);
 
 private:
     // Conditions of the environment
     double mSampleRate = DEFAULT_SAMPLE_RATE;
-    int mHalfBlock = 0;
+    int mHalfBlock = 0; // active half window, lags searched are below this
+    int mMaxHalfBlock = 0; // what prepareToPlay() allocated for
+    int mMinTau = 1; // from the max frequency, lags below this are never chosen
 
     // Allowed amount of uncertainty, inverse of minimum probability needed to count as a pitch
     std::atomic<double> mThreshold = DEFAULT_THRESHOLD;
@@ -47,6 +106,55 @@ private:
     juce::AudioBuffer<float> differenceBuffer;
     juce::AudioBuffer<float> cmndBuffer; // "Cumulative Mean Normalized Difference" buffer, you can thank YIN for this abbrev.
 
+    std::atomic<DifferenceEngine> mDifferenceEngine { DifferenceEngine::kScalar }; // the reference, callers opt into the others
+
+    // FFT engine, everything is allocated in prepareToPlay() so process() never allocates
+    std::vector<std::unique_ptr<juce::dsp::FFT>> mFFTs; // indexed by order, one per order up to the prepared window
+    juce::dsp::FFT* mFFT = nullptr; // smallest of mFFTs that fits the current window, picked in setSearchRange()
+    std::vector<float> mFFTFrameScratch; // first half of the window, zero padded. 2 * fftSize for JUCE's real transform
+    std::vector<float> mFFTSignalScratch; // whole window, zero padded
+    std::vector<double> mEnergyPrefix; // running sum of x^2, lets us get the energy of any lagged frame in O(1)
+
+    // Streaming YIN state, d(tau) summed over the last mHalfBlock samples
+    std::vector<float> mStreamHistory;
+    std::vector<double> mStreamSums; // double so add/remove of the same term cancels cleanly over long runs
+    juce::int64 mStreamSamplesPushed = 0;
+
+    // Coarse to fine search state
+    std::atomic<SearchMode> mSearchMode { SearchMode::kFull };
+    int mRequestedDecimationFactor = 4;
+    int mDecimationFactor = 4; // latched in prepareToPlay()
+    std::vector<float> mDecimationTaps; // windowed sinc lowpass at the decimated nyquist
+    juce::AudioBuffer<float> mCoarseWindow;
+    juce::AudioBuffer<float> mCoarseDifference;
+    juce::AudioBuffer<float> mCoarseCmnd;
+
+    // Detect / track state machine
+    std::atomic<State> mState { State::kDetecting };
+    std::atomic<float> mTrackingBand { 0.2f };
+    std::atomic<bool> mTrackingEnabled { true };
+    int mLastNumLagsSearched = 0; // for tests, how much of the lag range the last call touched
+
+    // Narrow search around mCurrentPeriod, returns -1 on loss of lock
+    float _processTracking(const juce::AudioBuffer<float>& buffer);
+
+    // Single pass YIN, returns as soon as the first dip below mThreshold has bottomed out
+    float _processFused(const juce::AudioBuffer<float>& buffer);
+
+    // YIN steps 2-4 on whatever is in differenceBuffer
+    float _estimatePeriodFromDifference();
+
+    float _processCoarseToFine(const juce::AudioBuffer<float>& buffer);
+    void _decimateForCoarseSearch(const juce::AudioBuffer<float>& buffer);
+
+    // d(tau) for a single lag over the first mHalfBlock samples of x, matches one bin of BufferMath::yin_difference
+    float _differenceAtLag(const float* x, int tau) const;
+
+    // Fills differenceBuffer with d(tau) = r(0) + r_tau(0) - 2 * acf(tau), same result as BufferMath::yin_difference
+    void _fftDifference(const juce::AudioBuffer<float>& buffer);
+    // points mFFT at the plan for the current mHalfBlock, never allocates
+    void _selectFFT();
+
 
     
 };
\ No newline at end of file
@@ -0,0 +1,27 @@
+/**
+ * VoiceRanges.h
+ * GENERATED by SCRIPTS/gen_voice_ranges.py from NOTES/SATB_Vocal_Ranges.csv, don't edit by hand.
+ *
+ * Frequency bounds for the voice range presets, used to clamp the YIN lag search.
+ */
+
+#pragma once
+#include <array>
+
+namespace VoiceRanges
+{
+	struct VoiceRange
+	{
+		const char* name;
+		float minHz;
+		float maxHz;
+	};
+
+	inline constexpr std::array<VoiceRange, 4> kPresets
+	{
+		VoiceRange { "Soprano", 261.f, 880.f }, // C4 - A5
+		VoiceRange { "Alto", 174.f, 587.f }, // F3 - D5
+		VoiceRange { "Tenor", 123.f, 392.f }, // B2 - G4
+		VoiceRange { "Bass", 82.f, 261.f }, // E2 - C4
+	};
+} // end namespace VoiceRanges
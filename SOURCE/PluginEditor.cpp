@@ -34,6 +34,10 @@ PluginEditor::PluginEditor (PluginProcessor& p)
 	// INIT DISPLAYS
 	mPitchDisplay = std::make_unique<juce::Label>();
 	addAndMakeVisible(mPitchDisplay.get());
+	mDroppedGrainsDisplay = std::make_unique<juce::Label>();
+	addAndMakeVisible(mDroppedGrainsDisplay.get());
+	mFormantDisplay = std::make_unique<juce::Label>();
+	addAndMakeVisible(mFormantDisplay.get());
 	
 	// ADD SLIDERS
 	mPitchShiftSlider = std::make_unique<juce::Slider>(juce::Slider::SliderStyle::Rotary, juce::Slider::TextEntryBoxPosition::TextBoxBelow);
@@ -52,6 +56,8 @@ PluginEditor::PluginEditor (PluginProcessor& p)
 	mVersionLabel->setBounds(10, 350, 60, 12);
 	mPitchDisplayLabel->setBounds(100, 50, 100, 30);
 	mPitchDisplay->setBounds(100, 100, 100, 30);
+	mDroppedGrainsDisplay->setBounds(100, 300, 200, 30);
+	mFormantDisplay->setBounds(100, 330, 250, 20);
 
 	mShiftRatioLabel->setBounds(200, 50, 100, 30);
 	mPitchShiftSlider->setBounds(200, 100, 100, 100);
@@ -83,6 +89,8 @@ PluginEditor::~PluginEditor()
 	mPitchShiftSlider.reset();
 	mEmissionRateSlider.reset();
 	mPitchDisplay.reset();
+	mDroppedGrainsDisplay.reset();
+	mFormantDisplay.reset();
 }
 
 //==============================================================================
@@ -105,4 +113,7 @@ void PluginEditor::timerCallback()
 	float currentPitch = mProcessor.getLastDetectedPeriod();
 	auto pitchString = juce::String(currentPitch);
 	mPitchDisplay->setText(pitchString, juce::NotificationType::dontSendNotification);
+	mDroppedGrainsDisplay->setText("Dropped Grains: " + juce::String(mProcessor.getNumDroppedGrains()), juce::NotificationType::dontSendNotification);
+	mFormantDisplay->setText(mProcessor.isFormantShiftingAvailable() ? juce::String() : "Formant: not available with the output ring engine",
+							 juce::NotificationType::dontSendNotification);
 }
\ No newline at end of file
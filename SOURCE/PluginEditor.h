@@ -25,6 +25,8 @@ private:
     std::unique_ptr<juce::Label> mEmissionRateLabel;
 
     std::unique_ptr<juce::Label> mPitchDisplay;
+    std::unique_ptr<juce::Label> mDroppedGrainsDisplay;
+    std::unique_ptr<juce::Label> mFormantDisplay;
 
     std::unique_ptr<juce::Slider> mPitchShiftSlider;
     std::unique_ptr<juce::Slider> mEmissionRateSlider;
@@ -1,10 +1,16 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 #include "PITCH/PitchDetector.h"
+#include "PITCH/AsyncPitchDetector.h"
+#include "PITCH/VoiceRanges.h"
 #include "GRAIN/Granulator.h"
+#include "GRAIN/GrainCloud.h"
+#include "GRAIN/TimeStretcher.h"
 #include "GRAIN/AnalysisMarker.h"
 #include "../SUBMODULES/RD/SOURCE/CircularBuffer.h"
 #include "../SUBMODULES/RD/SOURCE/BufferHelper.h"
+#include "Util/CircularReadView.h"
+#include "Util/SimdKernels.h"
 
 
 //==============================================================================
@@ -13,10 +19,21 @@ PluginProcessor::PluginProcessor()
 , apvts(*this, nullptr, "Parameters", _createParameterLayout())
 {
     mPitchDetector = std::make_unique<PitchDetector>();
+    mPitchDetector->setDifferenceEngine(PitchDetector::DifferenceEngine::kFFT); // O(N log N), same result as the scalar reference
+    mAsyncPitchDetector = std::make_unique<AsyncPitchDetector>(*mPitchDetector);
     mCircularBuffer = std::make_unique<CircularBuffer>();
 	mGranulator = std::make_unique<Granulator>();
+	mGranulator->setGrainStorage(Granulator::GrainStorage::kReference); // grains read straight from mCircularBuffer
+	mGranulator->setFormantShifting(true); // sized for it in prepareToPlay(), so "formant" works whenever it's moved
+	mGrainCloud = std::make_unique<GrainCloud>();
+	mTimeStretcher = std::make_unique<TimeStretcher>();
 
 	mShiftRatio = 1.f;
+	for(int voice = 0; voice < MagicNumbers::maxHarmonyVoices; ++voice)
+	{
+		mHarmonyShiftRatios[(size_t)voice].store(1.f);
+		mHarmonyGains[(size_t)voice].store(1.f);
+	}
 
     _initParameterListeners();
 
@@ -26,9 +43,12 @@ PluginProcessor::PluginProcessor()
 //
 PluginProcessor::~PluginProcessor()
 {
+	mAsyncPitchDetector.reset(); // stops the worker before the detector it uses goes away
 	mCircularBuffer.reset();
     mPitchDetector.reset();
     mGranulator.reset();
+    mGrainCloud.reset();
+    mTimeStretcher.reset();
 	mAnalysisMarker.reset();
 }
 
@@ -100,33 +120,76 @@ void PluginProcessor::changeProgramName (int index, const juce::String& newName)
 //==============================================================================
 void PluginProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-	// be atleast minLookaheadSize, if at or above, use 2x block size
-	int pitchDetectBufferNumSamples = samplesPerBlock >= MagicNumbers::minDetectionSize ? (samplesPerBlock * 2) : MagicNumbers::minDetectionSize;
-	// scale for sample rates, we deal with the same size for 44100 and 48000 for now (same for 88200 and 96000)
-	if(sampleRate > 48000.0 && sampleRate <= 96000.0)
-		pitchDetectBufferNumSamples = pitchDetectBufferNumSamples * 2;
-	else if(sampleRate > 96000.0)
-		pitchDetectBufferNumSamples = pitchDetectBufferNumSamples * 4;
+	// room for the longest analysis window, or the longest period any voice range can ask for
+	const int minFrequencyPeriod = static_cast<int>(std::ceil(sampleRate / MagicNumbers::minDetectableHz));
+	const int maxWindowNumSamples = juce::roundToInt(MagicNumbers::maxAnalysisMs * sampleRate / 1000.0);
+	const int detectionCapacity = juce::jmax(MagicNumbers::minDetectionSize, maxWindowNumSamples, (minFrequencyPeriod + 2) * 2);
+	mDetectionCapacity = detectionCapacity;
+	mSampleRate = sampleRate;
 
 	mDetectionBuffer.clear();
-	mDetectionBuffer.setSize(getTotalNumOutputChannels(), pitchDetectBufferNumSamples);
-
-    mPitchDetector->prepareToPlay(sampleRate, pitchDetectBufferNumSamples);
-
-    mCircularBuffer->setSize(getTotalNumOutputChannels(), static_cast<int>(pitchDetectBufferNumSamples) * 2); // by default 2 seconds
+	mDetectionBuffer.setSize(1, detectionCapacity);
+	mDetectionHopBuffer.setSize(1, maxWindowNumSamples);
+	mDetectionHopBuffer.clear();
+	mCorrelationBuffer.setSize(1, (minFrequencyPeriod + 2) * 2);
+
+    // worker has to be stopped before the detector is resized under it
+    mAsyncPitchDetector->stop();
+    mPitchDetector->prepareToPlay(sampleRate, detectionCapacity);
+    mFrequencyRangeDirty.store(false);
+    _applyFrequencyRange();
+
+    // a block can cross a hop every minAnalysisHopMs, the worker gets a window for each and can fall a block behind
+    const int minHopNumSamples = juce::jmax(1, juce::roundToInt(MagicNumbers::minAnalysisHopMs * sampleRate / 1000.0));
+    const int maxHopsPerBlock = samplesPerBlock / minHopNumSamples + 1;
+    mHopEstimates.clear();
+    mHopEstimates.reserve((size_t)(2 * maxHopsPerBlock));
+
+    mAsyncPitchDetector->prepare(1, mDetectionBuffer.getNumSamples(), 2 * maxHopsPerBlock);
+    mAsyncDetectionActive = mUseAsyncDetection.load();
+    mLastAsyncPeriod = -1.f;
+    mLastAsyncSampleIndex = -1;
+    if(mAsyncDetectionActive)
+        mAsyncPitchDetector->start();
+
+    mGrainCloud->prepare(sampleRate, samplesPerBlock, getTotalNumOutputChannels(), MagicNumbers::maxCloudGrainMs, MagicNumbers::maxCloudJitterMs);
+
+    // grains are two periods, and no voice range goes below minDetectableHz or above maxDetectableHz
+    const int maxFrequencyPeriod = static_cast<int>(std::floor(sampleRate / MagicNumbers::maxDetectableHz));
+    mTimeStretcher->prepare(sampleRate, samplesPerBlock, getTotalNumOutputChannels(), maxFrequencyPeriod, minFrequencyPeriod + 2,
+                            MagicNumbers::maxStretchDelayMs);
+
+    // Has to hold a full detection window behind the lookahead and the newest block. Grains reference
+    // their analysis range in here until they finish, that's up to 2 periods (<= capacity) more.
+    // Cloud grains read further back than that, up to two of their longest grains and the jitter,
+    // and stretching can fall up to maxStretchDelayMs behind.
+    const int circularBufferSize = juce::jmax(detectionCapacity * 2 + MagicNumbers::minLookaheadSize + samplesPerBlock,
+                                              mGrainCloud->getRequiredBufferSize(), mTimeStretcher->getRequiredBufferSize());
+    mCircularBuffer->setSize(getTotalNumOutputChannels(), circularBufferSize);
     //mCircularBuffer->setDelay(MagicNumbers::minLookaheadSize);  // delay is factored in as part of getAnalysisReadRange
 
-    mGranulator->prepare(sampleRate, samplesPerBlock, pitchDetectBufferNumSamples);
+    mGranulator->prepare(sampleRate, samplesPerBlock, (minFrequencyPeriod + 2) * 2, maxFrequencyPeriod, MagicNumbers::maxShiftRatio,
+                         getTotalNumOutputChannels(), MagicNumbers::maxHarmonyVoices);
 
 	mSamplesProcessed = 0;
 	mBlockSize = samplesPerBlock;
     mPredictedNextAnalysisMark = -1;
+    mWasStreamingDetection = false;
+    mNextDetectionEnd = kNoSample;
+    mLastHopPeriod = -1.f;
+    mNumDetectionsLastBlock = 0;
+    mNumAnalysisMarksLastBlock = 0;
+    mLastAnalysisMark = kNoSample;
+    mLastMarkedDetectionEnd = kNoSample;
+    mProcessState = ProcessState::kDetecting;
+    mLastProcessMode = ProcessMode::kPitch;
 }
 
 void PluginProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    mAsyncPitchDetector->stop();
 }
 
 bool PluginProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -157,6 +220,11 @@ void PluginProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     juce::ignoreUnused (midiMessages);
 
     juce::ScopedNoDenormals noDenormals;
+
+    // the worker owns the detector in async mode, range changes wait for the next prepareToPlay() there
+    if(!mAsyncDetectionActive && mFrequencyRangeDirty.exchange(false))
+        _applyFrequencyRange();
+
     [[maybe_unused]] auto totalNumInputChannels  = getTotalNumInputChannels();
     [[maybe_unused]] auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -169,9 +237,37 @@ void PluginProcessor::processBlock (juce::AudioBuffer<float>& buffer,
 
     // clean up buffers, about to fill
 	buffer.clear();
-    mDetectionBuffer.clear();
 
 
+    // the cloud doesn't need a pitch and the stretcher finds its own, nothing is detected here while they run
+    const ProcessMode processMode = mProcessMode.load();
+    if(processMode != ProcessMode::kPitch)
+    {
+        mNumDetectionsLastBlock = 0;
+        mNumAnalysisMarksLastBlock = 0;
+        if(processMode == ProcessMode::kCloud)
+            doCloud(buffer);
+        else
+            doStretch(buffer);
+        mLastProcessMode = processMode;
+        mSamplesProcessed += buffer.getNumSamples();
+        return;
+    }
+
+    // detection hops and pitch marks didn't move while the other modes ran, start them over
+    if(mLastProcessMode != ProcessMode::kPitch)
+    {
+        mLastProcessMode = ProcessMode::kPitch;
+        mNextDetectionEnd = kNoSample;
+        mLastHopPeriod = -1.f;
+        mWasStreamingDetection = false;
+        mPredictedNextAnalysisMark = -1;
+        mLastAnalysisMark = kNoSample;
+        mLastMarkedDetectionEnd = kNoSample;
+        mGranulator->resetSynthMark();
+        mProcessState = ProcessState::kDetecting;
+    }
+
     float detected_period = doDetection(buffer);
 
     doCorrection(buffer, detected_period);
@@ -182,24 +278,239 @@ void PluginProcessor::processBlock (juce::AudioBuffer<float>& buffer,
 //=============================================================================
 float PluginProcessor::doDetection(juce::AudioBuffer<float>& processBuffer)
 {
+    juce::ignoreUnused(processBuffer);
+
     // range we will detect on
     auto [detectStart, detectEnd] = getDetectionRange();
-    mCircularBuffer->readRange(mDetectionBuffer, detectStart);
+    juce::ignoreUnused(detectStart);
+
+    // first block lines the hops up with the end of the detection range
+    if(mNextDetectionEnd == kNoSample)
+        mNextDetectionEnd = detectEnd;
+
+    // Every hop that ended inside this block gets its own detection, correction marks each one with its period
+    const int hopNumSamples = getAnalysisHopNumSamples();
+    mHopEstimates.clear();
+    mNumDetectionsLastBlock = 0;
+    while(mNextDetectionEnd <= detectEnd)
+    {
+        const float hopPeriod = _detectHop(mNextDetectionEnd);
+        if(!mAsyncDetectionActive)
+        {
+            mLastHopPeriod = hopPeriod;
+            _addHopEstimate(mNextDetectionEnd, hopPeriod);
+        }
+        mNextDetectionEnd += hopNumSamples;
+        ++mNumDetectionsLastBlock;
+    }
+
+    if(mAsyncDetectionActive)
+    {
+        // The worker only sees a window once the block that pushed it has returned, so a result is at least a block
+        // old when it's picked up. Trust it for that block on top of the lookahead slack.
+        const juce::int64 maxAge = MagicNumbers::minLookaheadSize + mBlockSize;
+        AsyncPitchDetector::Result result;
+        while(mAsyncPitchDetector->popResult(result))
+        {
+            mLastAsyncPeriod = result.period;
+            mLastAsyncSampleIndex = result.sampleIndex;
+            if(detectEnd - result.sampleIndex <= maxAge)
+                _addHopEstimate(result.sampleIndex, result.period);
+        }
+
+        if(mLastAsyncSampleIndex < 0 || detectEnd - mLastAsyncSampleIndex > maxAge)
+        {
+            mHopEstimates.clear();
+            return -1.f;
+        }
+
+        // The newest result already stands in for the end of this block, the ones before it keep their spacing
+        // behind it so each still gets its own mark.
+        const juce::int64 lateBy = detectEnd - mLastAsyncSampleIndex;
+        for(auto& hop : mHopEstimates)
+            hop.hopEnd += lateBy;
+        return mLastAsyncPeriod;
+    }
+
+    return mLastHopPeriod;
+}
+
+//=============================================================================
+float PluginProcessor::_detectHop(juce::int64 hopEnd)
+{
+    // hopEnd is the last sample of the hop (inclusive, like getDetectionRange()), every path's window ends on it
+    if(mAsyncDetectionActive)
+    {
+        readDetectionMono(mDetectionBuffer, hopEnd - mDetectionBuffer.getNumSamples() + 1);
+        mAsyncPitchDetector->pushWindow(mDetectionBuffer, hopEnd);
+        return -1.f; // results are picked up once per block in doDetection()
+    }
+
+    if(mUseStreamingDetection.load())
+    {
+        if(!mWasStreamingDetection)
+        {
+            mPitchDetector->resetStream();
+            mWasStreamingDetection = true;
+        }
+
+        // only the samples that entered the detection range since the last hop
+        const int hopNumSamples = juce::jmin(getAnalysisHopNumSamples(), mDetectionHopBuffer.getNumSamples());
+        mDetectionHopBuffer.setSize(1, hopNumSamples, false, false, true);
+        readDetectionMono(mDetectionHopBuffer, hopEnd - hopNumSamples + 1);
+        return mPitchDetector->processStreaming(mDetectionHopBuffer);
+    }
+    mWasStreamingDetection = false;
+
+    // window ends at the hop end, its size depends on the voice range
+    readDetectionMono(mDetectionBuffer, hopEnd - mDetectionBuffer.getNumSamples() + 1);
 
     // Try and detect pitch, update state accordingly in temp variable for now
     float detected_period = mPitchDetector->process(mDetectionBuffer);
     return detected_period;
 }
 
+//=============================================================================
+void PluginProcessor::_addHopEstimate(juce::int64 hopEnd, float period)
+{
+    // reserved in prepareToPlay() for the shortest hop, a host block longer than promised drops the extra ones
+    if(mHopEstimates.size() < mHopEstimates.capacity())
+        mHopEstimates.push_back({ hopEnd, period });
+}
+
+//=============================================================================
+int PluginProcessor::getAnalysisHopNumSamples() const
+{
+    return juce::jmax(1, _msToSamples(mAnalysisHopMs.load()));
+}
+
+//=============================================================================
+bool PluginProcessor::isFormantShiftingAvailable() const
+{
+    return mGranulator->isFormantShifting();
+}
+
+//=============================================================================
+int PluginProcessor::getNumDroppedDetectionWindows() const
+{
+    return mAsyncDetectionActive ? mAsyncPitchDetector->getNumDroppedWindows() : 0;
+}
+
+//=============================================================================
+int PluginProcessor::getNumDroppedGrains() const
+{
+    return mGranulator->getNumDroppedGrains();
+}
+
+//=============================================================================
+int PluginProcessor::_msToSamples(float ms) const
+{
+    return juce::roundToInt((double)ms * mSampleRate / 1000.0);
+}
+
+//=============================================================================
+void PluginProcessor::readDetectionMono(juce::AudioBuffer<float>& dest, juce::int64 startIndex)
+{
+    const int numSourceChannels = mCircularBuffer->getBuffer().getNumChannels();
+    float* out = dest.getWritePointer(0);
+
+    // startIndex is negative while warming up, the view wraps it like any other index
+    const CircularReadView source(*mCircularBuffer, startIndex, dest.getNumSamples());
+
+    DetectionSource detectionSource = numSourceChannels > 1 ? mDetectionSource.load() : DetectionSource::kLeft;
+    int sourceChannel = 0;
+
+    if(detectionSource == DetectionSource::kMaxEnergy)
+    {
+        float bestEnergy = -1.f;
+        for(int ch = 0; ch < numSourceChannels; ++ch)
+        {
+            float energy = 0.f;
+            source.forEachSpan(ch, [&energy](const float* in, int, int length)
+            {
+                energy += SimdKernels::dotProduct(in, in, length);
+            });
+
+            if(energy > bestEnergy)
+            {
+                bestEnergy = energy;
+                sourceChannel = ch;
+            }
+        }
+        detectionSource = DetectionSource::kLeft; // from here on it's a single channel copy
+    }
+
+    if(detectionSource == DetectionSource::kMid)
+    {
+        source.forEachSpan(0, [out](const float* left, int offset, int length)
+        {
+            juce::FloatVectorOperations::copyWithMultiply(out + offset, left, 0.5f, length);
+        });
+        source.forEachSpan(1, [out](const float* right, int offset, int length)
+        {
+            juce::FloatVectorOperations::addWithMultiply(out + offset, right, 0.5f, length);
+        });
+        return;
+    }
+
+    source.copyTo(sourceChannel, out);
+}
+
 //=============================================================================
 void PluginProcessor::doCorrection(juce::AudioBuffer<float>& processBuffer, float detectedPeriod)
 {
-    const float shiftedPeriod = detectedPeriod / mShiftRatio;
+    _applyHarmonyVoices();
+    mGranulator->setFormantFactor(mFormantFactor.load());
+    mNumAnalysisMarksLastBlock = 0;
+
+    // no pitch (or lost lock), let the grains we already have finish and start fresh next time
+    if(detectedPeriod <= 0.f)
+    {
+        if(mProcessState == ProcessState::kTracking)
+        {
+            mGranulator->resetSynthMark();
+            mPredictedNextAnalysisMark = -1;
+            mLastAnalysisMark = kNoSample;
+            mLastMarkedDetectionEnd = kNoSample;
+        }
+        mProcessState = ProcessState::kDetecting;
+
+        mGranulator->processDetecting(processBuffer, *mCircularBuffer.get(), getDryBlockRange(), getProcessCounterRange());
+        return;
+    }
+    mProcessState = ProcessState::kTracking;
 
     const juce::int64 endProcessSample   = mSamplesProcessed + mBlockSize - 1;
     const juce::int64 endDetectionSample = endProcessSample - MagicNumbers::minLookaheadSize;
 
+    // Hops that ended before the newest sample mark the cycles they found with their own period, so a block
+    // spanning several hops gets grains from several analysis marks rather than stretching one over the block.
+    // Those only count if they found a cycle past the last mark, the newest hop always marks like it used to.
+    for(const auto& hop : mHopEstimates)
+    {
+        if(hop.period > 0.f && hop.hopEnd < endDetectionSample)
+            _placeAnalysisMark(hop.hopEnd, hop.period, true);
+    }
+    _placeAnalysisMark(endDetectionSample, detectedPeriod, false);
+
+    mGranulator->processActiveGrains(processBuffer, getProcessCounterRange());
+}
+
+//=============================================================================
+void PluginProcessor::_placeAnalysisMark(juce::int64 endDetectionSample, float detectedPeriod, bool onlyIfNewCycle)
+{
+    // already marked up to here, an async estimate from before the last block
+    if(endDetectionSample <= mLastMarkedDetectionEnd)
+        return;
+
     const juce::int64 markedIndex = chooseStablePitchMark(endDetectionSample, detectedPeriod);
+    if(onlyIfNewCycle && markedIndex <= mLastAnalysisMark)
+        return;
+
+    mLastMarkedDetectionEnd = endDetectionSample;
+    if(markedIndex != mLastAnalysisMark)
+        ++mNumAnalysisMarksLastBlock;
+    mLastAnalysisMark = markedIndex;
 
     // Prediction for NEXT time (in the SAME coordinate system as markedIndex)
     mPredictedNextAnalysisMark = markedIndex + (juce::int64)std::llround(detectedPeriod);
@@ -207,16 +518,40 @@ void PluginProcessor::doCorrection(juce::AudioBuffer<float>& processBuffer, floa
     auto analysisReadRange  = getAnalysisReadRange(markedIndex, detectedPeriod);
     auto analysisWriteRange = getAnalysisWriteRange(analysisReadRange);
 
-    mGranulator->processTracking(
-        processBuffer,
+    mGranulator->placeGrains(
         *mCircularBuffer.get(),
         analysisReadRange,
         analysisWriteRange,
         getProcessCounterRange(),
         detectedPeriod,
-        shiftedPeriod);
+        detectedPeriod / mShiftRatio);
+}
+
+
+//=============================================================================
+void PluginProcessor::doCloud(juce::AudioBuffer<float>& processBuffer)
+{
+    // grains left from the last time would read from long overwritten audio
+    if(mLastProcessMode != ProcessMode::kCloud)
+        mGrainCloud->reset();
+
+    mGrainCloud->setEmissionRate(mEmissionRateHz.load());
+    mGrainCloud->setGrainSize(mCloudGrainMs.load());
+    mGrainCloud->setPositionJitter(mCloudPositionJitterMs.load());
+    mGrainCloud->setSizeJitter(mCloudSizeJitter.load());
+    mGrainCloud->process(processBuffer, *mCircularBuffer.get(), getProcessCounterRange());
 }
 
+//=============================================================================
+void PluginProcessor::doStretch(juce::AudioBuffer<float>& processBuffer)
+{
+    // the analysis starts again just behind the newest input
+    if(mLastProcessMode != ProcessMode::kStretch)
+        mTimeStretcher->reset();
+
+    mTimeStretcher->setStretchFactor(mStretchFactor.load());
+    mTimeStretcher->process(processBuffer, *mCircularBuffer.get(), getProcessCounterRange());
+}
 
 //==================================================================
 juce::int64 PluginProcessor::refineMarkByCorrelation(juce::int64 predictedMark, float detectedPeriod)
@@ -224,23 +559,30 @@ juce::int64 PluginProcessor::refineMarkByCorrelation(juce::int64 predictedMark,
     const int P = (int)std::llround(detectedPeriod);
     const int radius = std::max(1, P / 4);
 
+    // Everything any candidate reads, [predictedMark - P - radius, predictedMark + radius), in one copy.
+    // Longer than prepareToPlay() made room for means the period is outside every voice range, keep the prediction.
+    const int numSamples = P + 2 * radius;
+    if (P <= 0 || numSamples > mCorrelationBuffer.getNumSamples())
+        return predictedMark;
+
+    float* window = mCorrelationBuffer.getWritePointer(0);
+    CircularReadView(*mCircularBuffer, predictedMark - P - radius, numSamples).copyTo(0, window);
+
     // Reference cycle: one period ending at predictedMark (you can use prevMark instead if you store it)
-    std::vector<float> ref(P);
-    for (int i = 0; i < P; ++i)
-        ref[i] = readMonoSample(predictedMark - P + i);
+    const float* ref = window + radius;
 
     double bestScore = -1.0;
     juce::int64 bestMark = predictedMark;
 
     for (int off = -radius; off <= radius; ++off)
     {
-        const juce::int64 cand = predictedMark + off;
+        const float* candidate = window + radius + off; // compare same-relative cycle
 
         double num = 0.0, denA = 0.0, denB = 0.0;
         for (int i = 0; i < P; ++i)
         {
             const float a = ref[i];
-            const float b = readMonoSample(cand - P + i); // compare same-relative cycle
+            const float b = candidate[i];
             num  += (double)a * (double)b;
             denA += (double)a * (double)a;
             denB += (double)b * (double)b;
@@ -250,7 +592,7 @@ juce::int64 PluginProcessor::refineMarkByCorrelation(juce::int64 predictedMark,
         if (score > bestScore)
         {
             bestScore = score;
-            bestMark = cand;
+            bestMark = predictedMark + off;
         }
     }
 
@@ -292,17 +634,6 @@ juce::int64 PluginProcessor::chooseStablePitchMark( const juce::int64 endDetecti
 }
 
 
-//==============================================================================
-inline float PluginProcessor::readMonoSample(juce::int64 sampleIndex) const
-{
-    // If your CircularBuffer has a direct getter, use it.
-    // Otherwise adapt to however you read a single sample.
-    const int ch = 0;
-    const int wrapped = mCircularBuffer->getWrappedIndex(sampleIndex);
-    return mCircularBuffer->getBuffer().getSample(ch, wrapped);
-}
-
-
 //==============================================================================
 bool PluginProcessor::hasEditor() const
 {
@@ -367,11 +698,69 @@ void PluginProcessor::parameterChanged(const juce::String& parameterID, float ne
 {
     if(parameterID == "shift ratio")
     {
-        float clampedValue = juce::jlimit(0.5f, 1.5f, newValue);
+        float clampedValue = juce::jlimit(0.5f, MagicNumbers::maxShiftRatio, newValue);
 		mShiftRatio = clampedValue;
     }
     else if(parameterID == "emission rate")
     {
+        mEmissionRateHz.store(newValue);
+    }
+    else if(parameterID == "mode")
+    {
+        mProcessMode.store(static_cast<ProcessMode>(juce::jlimit(0, 2, (int)newValue)));
+    }
+    else if(parameterID == "stretch")
+    {
+        mStretchFactor.store(newValue);
+    }
+    else if(parameterID == "formant")
+    {
+        mFormantFactor.store(newValue);
+    }
+    else if(parameterID == "grain size")
+    {
+        mCloudGrainMs.store(newValue);
+    }
+    else if(parameterID == "position jitter")
+    {
+        mCloudPositionJitterMs.store(newValue);
+    }
+    else if(parameterID == "size jitter")
+    {
+        mCloudSizeJitter.store(newValue);
+    }
+    else if(parameterID == "voice range" || parameterID == "min frequency" || parameterID == "max frequency")
+    {
+        _updateFrequencyRange();
+    }
+    else if(parameterID == "harmony voices")
+    {
+        mNumHarmonyVoices.store(juce::jlimit(1, MagicNumbers::maxHarmonyVoices, (int)newValue));
+    }
+    else if(parameterID.startsWith("voice "))
+    {
+        // "voice <n> ratio" / "voice <n> gain", n counts from 1
+        const int voice = parameterID.fromFirstOccurrenceOf("voice ", false, false).getIntValue() - 1;
+        if(voice >= 0 && voice < MagicNumbers::maxHarmonyVoices)
+        {
+            if(parameterID.endsWith("ratio"))
+                mHarmonyShiftRatios[(size_t)voice].store(juce::jlimit(0.5f, MagicNumbers::maxShiftRatio, newValue));
+            else if(parameterID.endsWith("gain"))
+                mHarmonyGains[(size_t)voice].store(newValue);
+        }
+    }
+    else if(parameterID == "analysis window")
+    {
+        mAnalysisWindowMs.store(newValue);
+        mFrequencyRangeDirty.store(true); // only used by "Full", but applied the same way
+    }
+    else if(parameterID == "analysis hop")
+    {
+        mAnalysisHopMs.store(newValue); // read every block, no resize needed
+    }
+    else if(parameterID == "detection source")
+    {
+        mDetectionSource.store(static_cast<DetectionSource>(juce::jlimit(0, 2, (int)newValue)));
     }
 }
 
@@ -390,7 +779,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout PluginProcessor::_createPara
         "shift ratio",         // Parameter ID
         "Shift Ratio",         // Parameter name
         0.5,           // Min value
-        1.5f,           // Max value
+        MagicNumbers::maxShiftRatio, // Max value
         1.f));         // Default value
 
     params.push_back(std::make_unique<juce::AudioParameterFloat>(
@@ -399,7 +788,120 @@ juce::AudioProcessorValueTreeState::ParameterLayout PluginProcessor::_createPara
         1.f,           // Min value
         400.f,           // Max value
         1.f));         // Default value
-        
+
+    // "Cloud" ignores pitch and emits grains at the emission rate, "Stretch" changes the tempo
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        "mode",                // Parameter ID
+        "Mode",                // Parameter name
+        juce::StringArray { "Pitch", "Cloud", "Stretch" },
+        0));                   // Default index, Pitch
+
+    // how fast the input goes by in "Stretch", 2 is twice as fast, 0.5 half. 1 in the middle of the range.
+    juce::NormalisableRange<float> stretchRange(kMinStretchFactor, kMaxStretchFactor);
+    stretchRange.setSkewForCentre(1.f);
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "stretch",             // Parameter ID
+        "Stretch",             // Parameter name
+        stretchRange,
+        1.f));                 // Default value
+
+    // moves everything under the pitch in "Pitch", 2 is an octave up, 0.5 down. 1 in the middle leaves it alone.
+    juce::NormalisableRange<float> formantRange(kMinFormantFactor, kMaxFormantFactor);
+    formantRange.setSkewForCentre(1.f);
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "formant",             // Parameter ID
+        "Formant",             // Parameter name
+        formantRange,
+        1.f));                 // Default value
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "grain size",          // Parameter ID
+        "Grain Size",          // Parameter name
+        juce::NormalisableRange<float>(5.f, MagicNumbers::maxCloudGrainMs), // ms
+        100.f));
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "position jitter",     // Parameter ID
+        "Position Jitter",     // Parameter name
+        juce::NormalisableRange<float>(0.f, MagicNumbers::maxCloudJitterMs), // ms
+        10.f));
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "size jitter",         // Parameter ID
+        "Size Jitter",         // Parameter name
+        0.f,                   // Min value, a fraction of the grain size
+        0.5f,                  // Max value, kMaxSizeJitter
+        0.2f));                // Default value
+
+    // one analysis feeds every voice, the main voice follows "shift ratio"
+    params.push_back(std::make_unique<juce::AudioParameterInt>(
+        "harmony voices",      // Parameter ID
+        "Harmony Voices",      // Parameter name
+        1,                     // Min value
+        MagicNumbers::maxHarmonyVoices, // Max value
+        1));                   // Default value
+
+    // a third up, a fifth up, a fourth down
+    const std::array<float, 3> defaultHarmonyRatios { 1.25f, 1.5f, 0.75f };
+    for(int voice = 1; voice <= MagicNumbers::maxHarmonyVoices; ++voice)
+    {
+        const juce::String id = "voice " + juce::String(voice);
+        const juce::String name = "Voice " + juce::String(voice);
+        if(voice > 1)
+            params.push_back(std::make_unique<juce::AudioParameterFloat>(
+                id + " ratio", name + " Ratio",
+                0.5f, MagicNumbers::maxShiftRatio,
+                defaultHarmonyRatios[(size_t)(voice - 2) % defaultHarmonyRatios.size()]));
+        params.push_back(std::make_unique<juce::AudioParameterFloat>(
+            id + " gain", name + " Gain",
+            0.f, 1.f,
+            1.f));
+    }
+
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        "detection source",    // Parameter ID
+        "Detection Source",    // Parameter name
+        juce::StringArray { "Left", "Mid", "Max Energy" },
+        1));                   // Default index, Mid
+
+    // "Full" uses the analysis window, "Custom" uses min/max frequency, the rest come from VoiceRanges.h
+    juce::StringArray voiceRangeNames { "Full", "Custom" };
+    for(const auto& preset : VoiceRanges::kPresets)
+        voiceRangeNames.add(preset.name);
+
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        "voice range",         // Parameter ID
+        "Voice Range",         // Parameter name
+        voiceRangeNames,
+        0));                   // Default index, Full
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "min frequency",       // Parameter ID
+        "Min Frequency",       // Parameter name
+        MagicNumbers::minDetectableHz, // Min value
+        MagicNumbers::maxDetectableHz, // Max value
+        80.f));                // Default value
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "max frequency",       // Parameter ID
+        "Max Frequency",       // Parameter name
+        MagicNumbers::minDetectableHz, // Min value
+        MagicNumbers::maxDetectableHz, // Max value
+        1000.f));              // Default value
+
+    // detection cost per second of audio only depends on these, not the host block size
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "analysis window",     // Parameter ID
+        "Analysis Window",     // Parameter name
+        juce::NormalisableRange<float>(10.f, MagicNumbers::maxAnalysisMs), // ms
+        MagicNumbers::defaultAnalysisWindowMs));
+
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        "analysis hop",        // Parameter ID
+        "Analysis Hop",        // Parameter name
+        juce::NormalisableRange<float>(MagicNumbers::minAnalysisHopMs, MagicNumbers::maxAnalysisMs), // ms
+        MagicNumbers::defaultAnalysisHopMs));
+
     return { params.begin(), params.end() };
 }
 
@@ -413,11 +915,84 @@ juce::AudioProcessor::BusesProperties PluginProcessor::_getBusesProperties()
                 .withOutput("Output", juce::AudioChannelSet::stereo(), true);
 }
 
+//===================
+void PluginProcessor::_updateFrequencyRange()
+{
+    const int voiceRangeIndex = (int)apvts.getRawParameterValue("voice range")->load();
+    float minHz = 0.f;
+    float maxHz = 0.f;
+
+    if(voiceRangeIndex == 1)
+    {
+        minHz = apvts.getRawParameterValue("min frequency")->load();
+        maxHz = apvts.getRawParameterValue("max frequency")->load();
+    }
+    else if(voiceRangeIndex >= 2 && voiceRangeIndex - 2 < (int)VoiceRanges::kPresets.size())
+    {
+        const auto& preset = VoiceRanges::kPresets[(size_t)(voiceRangeIndex - 2)];
+        minHz = preset.minHz;
+        maxHz = preset.maxHz;
+    }
+
+    mFrequencyRangeMinHz.store(minHz);
+    mFrequencyRangeMaxHz.store(maxHz);
+    mFrequencyRangeDirty.store(true);
+}
+
+//===================
+void PluginProcessor::_applyFrequencyRange()
+{
+    const float minHz = mFrequencyRangeMinHz.load();
+    const float maxHz = mFrequencyRangeMaxHz.load();
+
+    // "Full" searches the whole analysis window
+    mFullDetectionNumSamples = juce::jlimit(4, mDetectionCapacity, _msToSamples(mAnalysisWindowMs.load()));
+
+    if(minHz > 0.f && maxHz > 0.f)
+        mPitchDetector->setFrequencyRange(minHz, maxHz);
+    else
+        mPitchDetector->setSearchRange(mFullDetectionNumSamples, 1);
+
+    // capacity was allocated in prepareToPlay(), this only changes how much of it we read
+    mDetectionBuffer.setSize(1, mPitchDetector->getWindowNumSamples(), false, false, true);
+}
+
 //===================
 void PluginProcessor::_initParameterListeners()
 {
     apvts.addParameterListener("shift ratio", this);
     apvts.addParameterListener("emission rate", this);
+    apvts.addParameterListener("detection source", this);
+    apvts.addParameterListener("voice range", this);
+    apvts.addParameterListener("min frequency", this);
+    apvts.addParameterListener("max frequency", this);
+    apvts.addParameterListener("analysis window", this);
+    apvts.addParameterListener("analysis hop", this);
+    apvts.addParameterListener("harmony voices", this);
+    apvts.addParameterListener("mode", this);
+    apvts.addParameterListener("stretch", this);
+    apvts.addParameterListener("formant", this);
+    apvts.addParameterListener("grain size", this);
+    apvts.addParameterListener("position jitter", this);
+    apvts.addParameterListener("size jitter", this);
+    for(int voice = 1; voice <= MagicNumbers::maxHarmonyVoices; ++voice)
+    {
+        if(voice > 1)
+            apvts.addParameterListener("voice " + juce::String(voice) + " ratio", this);
+        apvts.addParameterListener("voice " + juce::String(voice) + " gain", this);
+    }
+
+    // parameterChanged() only hears about changes, start from the defaults
+    for(int voice = 2; voice <= MagicNumbers::maxHarmonyVoices; ++voice)
+        mHarmonyShiftRatios[(size_t)(voice - 1)].store(apvts.getRawParameterValue("voice " + juce::String(voice) + " ratio")->load());
+}
+
+//===================
+void PluginProcessor::_applyHarmonyVoices()
+{
+    mGranulator->setNumVoices(mNumHarmonyVoices.load());
+    for(int voice = 0; voice < MagicNumbers::maxHarmonyVoices; ++voice)
+        mGranulator->setVoice(voice, mHarmonyShiftRatios[(size_t)voice].load(), mHarmonyGains[(size_t)voice].load());
 }
 
 //-------------------------------------------
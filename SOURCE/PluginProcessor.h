@@ -4,7 +4,10 @@
 
 class CircularBuffer;
 class PitchDetector;
+class AsyncPitchDetector;
 class Granulator;
+class GrainCloud;
+class TimeStretcher;
 class AnalysisMarker;
 class Window;
 
@@ -16,6 +19,17 @@ namespace MagicNumbers
 {
 	constexpr int minLookaheadSize = 512; // for synthesis
     constexpr int minDetectionSize = 1024; // for detection
+    constexpr float minDetectableHz = 60.f; // lowest "min frequency", sizes the detection capacity
+    constexpr float maxDetectableHz = 1500.f; // highest "max frequency", shortest period we make grains for
+    constexpr float maxShiftRatio = 1.5f; // with maxDetectableHz, sizes the grain pool
+    constexpr int maxHarmonyVoices = 4; // "harmony voices", the main voice counts as one
+    constexpr float maxCloudGrainMs = 250.f; // longest "grain size", sizes the cloud's grains and the circular buffer
+    constexpr float maxCloudJitterMs = 100.f; // longest "position jitter"
+    constexpr float maxStretchDelayMs = 1000.f; // how far "stretch" can fall behind the input before it jumps, sizes the circular buffer
+    constexpr float maxAnalysisMs = 50.f; // longest "analysis window" / "analysis hop"
+    constexpr float minAnalysisHopMs = 1.f; // shortest "analysis hop", sizes the per block hop estimates
+    constexpr float defaultAnalysisWindowMs = 1024.f / 48.f; // 1024 samples at 48k
+    constexpr float defaultAnalysisHopMs = 128.f / 48.f; // one detection per 128 sample block at 48k
 } // end namespace MagicNumbers
 class PluginProcessor : public juce::AudioProcessor
                       , public juce::AudioProcessorValueTreeState::Listener
@@ -31,9 +45,12 @@ public:
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
     float doDetection(juce::AudioBuffer<float>& processBuffer);
+    // Marks and makes grains for every hop estimate from doDetection(), oldest first, then the newest detectedPeriod
+    // at the end of the detection range.
     void doCorrection(juce::AudioBuffer<float>& processBuffer, float detectedPeriod);
+    void doCloud(juce::AudioBuffer<float>& processBuffer);
+    void doStretch(juce::AudioBuffer<float>& processBuffer);
     juce::int64 refineMarkByCorrelation(juce::int64 predictedMark, float detectedPeriod);
-    inline float readMonoSample(juce::int64 sampleIndex) const;
     juce::int64 chooseStablePitchMark(const juce::int64 endDetectionSample, const float detectedPeriod);
 
     juce::AudioProcessorEditor* createEditor() override;
@@ -93,19 +110,133 @@ public:
 
     ProcessState getCurrentState() { return mProcessState; }
 
+    // kPitch shifts on detected pitch marks. kCloud emits grains at "emission rate" and skips detection.
+    // kStretch changes the tempo by "stretch" and keeps the pitch, the stretcher detects on its own.
+    enum class ProcessMode
+    {
+        kPitch = 0,
+        kCloud = 1,
+        kStretch = 2
+    };
+
+    void setProcessMode(ProcessMode mode) { mProcessMode.store(mode); }
+    ProcessMode getProcessMode() const { return mProcessMode.load(); }
+    const GrainCloud& getGrainCloud() const { return *mGrainCloud; }
+    const TimeStretcher& getTimeStretcher() const { return *mTimeStretcher; }
+    const Granulator& getGranulator() const { return *mGranulator; }
+    const PitchDetector& getPitchDetector() const { return *mPitchDetector; }
+
+    // Streaming detection only feeds the newest block into the PitchDetector instead of the whole window
+    void setStreamingDetection(bool shouldStream) { mUseStreamingDetection.store(shouldStream); }
+    bool isStreamingDetection() const { return mUseStreamingDetection.load(); }
+
+    // Which signal YIN looks at. Detection is always done on a single channel.
+    enum class DetectionSource
+    {
+        kLeft = 0,
+        kMid = 1, // (L + R) / 2
+        kMaxEnergy = 2 // whichever channel is louder over the detection range
+    };
+
+    void setDetectionSource(DetectionSource source) { mDetectionSource.store(source); }
+    DetectionSource getDetectionSource() const { return mDetectionSource.load(); }
+
+    // Mixes the circular buffer down into the single channel of dest, starting at absolute sample startIndex
+    void readDetectionMono(juce::AudioBuffer<float>& dest, juce::int64 startIndex);
+
+    // Samples in the current detection window, 2x the longest period the voice range allows
+    int getDetectionWindowNumSamples() const { return mDetectionBuffer.getNumSamples(); }
+
+    // Detection runs every "analysis hop" ms of input, not once per host block. A block can run zero, one or several,
+    // and correction places an analysis mark for each new cycle they find.
+    int getAnalysisHopNumSamples() const;
+    int getNumDetectionsLastBlock() const { return mNumDetectionsLastBlock; }
+    int getNumAnalysisMarksLastBlock() const { return mNumAnalysisMarksLastBlock; }
+    // grains the granulator had no room for since prepareToPlay(), safe from the message thread
+    int getNumDroppedGrains() const;
+
+    // Runs detection on a worker thread, takes effect on the next prepareToPlay().
+    // Results older than minLookaheadSize (the slack we already have) plus the block that waited for them are ignored,
+    // every hop's result that's left is marked.
+    void setAsyncDetection(bool shouldRunAsync) { mUseAsyncDetection.store(shouldRunAsync); }
+    bool isAsyncDetection() const { return mAsyncDetectionActive; }
+    // False when the granulator's synthesis engine can't formant shift (kOutputRing), "formant" does nothing then
+    bool isFormantShiftingAvailable() const;
+
+    // windows the worker had no slot for since prepareToPlay(), 0 when async detection is off
+    int getNumDroppedDetectionWindows() const;
+
     private:
 	ProcessState mProcessState = ProcessState::kDetecting;
 
     float mShiftRatio = 1.f;
     std::unique_ptr<PitchDetector> mPitchDetector;
+    std::unique_ptr<AsyncPitchDetector> mAsyncPitchDetector;
     std::unique_ptr<Granulator> mGranulator;
+    std::unique_ptr<GrainCloud> mGrainCloud;
+    std::unique_ptr<TimeStretcher> mTimeStretcher;
     std::unique_ptr<CircularBuffer> mCircularBuffer;
 	std::unique_ptr<AnalysisMarker> mAnalysisMarker;
 
-	juce::AudioBuffer<float> mDetectionBuffer;
+	juce::AudioBuffer<float> mDetectionBuffer; // mono, see DetectionSource
+	juce::AudioBuffer<float> mDetectionHopBuffer; // newest block of the detection range, for streaming detection
+	juce::AudioBuffer<float> mCorrelationBuffer; // mono, the range refineMarkByCorrelation() searches, up to 1.5 longest periods
+	std::atomic<DetectionSource> mDetectionSource { DetectionSource::kMid };
+
+	std::atomic<bool> mUseStreamingDetection { false };
+	bool mWasStreamingDetection = false; // audio thread copy, so the stream restarts cleanly when toggled
+
+	// Harmony voices, written from parameterChanged() and handed to the granulator every block.
+	// Index 0 is the main voice, it follows "shift ratio" so only its gain is used.
+	std::atomic<int> mNumHarmonyVoices { 1 };
+	std::array<std::atomic<float>, MagicNumbers::maxHarmonyVoices> mHarmonyShiftRatios;
+	std::array<std::atomic<float>, MagicNumbers::maxHarmonyVoices> mHarmonyGains;
+
+	// Cloud, stretch and formant settings, written from parameterChanged() and handed over every block
+	std::atomic<ProcessMode> mProcessMode { ProcessMode::kPitch };
+	ProcessMode mLastProcessMode = ProcessMode::kPitch; // audio thread copy, so each mode starts clean when switched to
+	std::atomic<float> mStretchFactor { 1.f };
+	std::atomic<float> mFormantFactor { 1.f };
+	std::atomic<float> mEmissionRateHz { 1.f };
+	std::atomic<float> mCloudGrainMs { 100.f };
+	std::atomic<float> mCloudPositionJitterMs { 10.f };
+	std::atomic<float> mCloudSizeJitter { 0.2f };
+
+	// Voice range, written from parameterChanged() and picked up at the top of processBlock()
+	std::atomic<float> mFrequencyRangeMinHz { 0.f }; // 0 is "Full"
+	std::atomic<float> mFrequencyRangeMaxHz { 0.f };
+	std::atomic<bool> mFrequencyRangeDirty { false };
+	int mFullDetectionNumSamples = MagicNumbers::minDetectionSize;
+	int mDetectionCapacity = MagicNumbers::minDetectionSize; // what prepareToPlay() allocated, windows never grow past it
+
+	// Analysis hop and window, in ms so the cost per second doesn't depend on the host block size
+	std::atomic<float> mAnalysisWindowMs { MagicNumbers::defaultAnalysisWindowMs };
+	std::atomic<float> mAnalysisHopMs { MagicNumbers::defaultAnalysisHopMs };
+	// detection ends start out negative while the lookahead fills, so "none yet" can't be -1
+	static constexpr juce::int64 kNoSample = std::numeric_limits<juce::int64>::min();
+	juce::int64 mNextDetectionEnd = kNoSample; // last sample of the next hop (inclusive)
+	float mLastHopPeriod = -1.f; // newest estimate, held across blocks that don't reach a hop
+	int mNumDetectionsLastBlock = 0;
+
+	// this block's detections, oldest first, for doCorrection() to mark. Async ones are moved up to this block.
+	struct HopEstimate
+	{
+		juce::int64 hopEnd = -1; // last sample of the hop's window
+		float period = -1.f;
+	};
+	std::vector<HopEstimate> mHopEstimates; // reserved in prepareToPlay(), never grows on the audio thread
+	juce::int64 mLastAnalysisMark = kNoSample;
+	juce::int64 mLastMarkedDetectionEnd = kNoSample;
+	int mNumAnalysisMarksLastBlock = 0;
+
+	std::atomic<bool> mUseAsyncDetection { false };
+	bool mAsyncDetectionActive = false; // latched in prepareToPlay(), the worker owns mPitchDetector while this is true
+	float mLastAsyncPeriod = -1.f;
+	juce::int64 mLastAsyncSampleIndex = -1;
 
 	juce::int64 mSamplesProcessed = 0;
 	int mBlockSize = 0;
+	double mSampleRate = 48000.0; // from prepareToPlay(), getSampleRate() isn't set yet when tests call it directly
     juce::int64 mPredictedNextAnalysisMark = (juce::int64) -1;
 
 
@@ -113,6 +244,15 @@ public:
     juce::AudioProcessorValueTreeState::ParameterLayout _createParameterLayout();
 
     void _initParameterListeners();
+    void _updateFrequencyRange(); // any thread, reads the parameters
+    void _applyFrequencyRange(); // audio thread (or prepareToPlay), resizes within capacity
+    void _applyHarmonyVoices(); // audio thread
+    float _detectHop(juce::int64 hopEnd); // one detection on the window whose last sample is hopEnd
+    void _addHopEstimate(juce::int64 hopEnd, float period);
+    // Marks the cycle ending by endDetectionSample and places its grains. onlyIfNewCycle skips it unless the mark
+    // is past the last one, for the hops before the newest.
+    void _placeAnalysisMark(juce::int64 endDetectionSample, float detectedPeriod, bool onlyIfNewCycle);
+    int _msToSamples(float ms) const;
     // cleanup ugly code in PluginProcessor's constructor
     juce::AudioProcessor::BusesProperties _getBusesProperties();
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginProcessor)
@@ -0,0 +1,106 @@
+/**
+ * CircularReadView.h
+ * Created by Ryan Devens
+ *
+ * An absolute sample range of a CircularBuffer as at most two contiguous spans: the part up to the end of the
+ * buffer and the part that wrapped around to the start. A read that crosses the wrap point becomes one or two
+ * calls into FloatVectorOperations / SimdKernels instead of a getWrappedIndex() per sample.
+ * Only holds a reference to the buffer, cheap to make on the audio thread, don't keep one past a write.
+ */
+
+#pragma once
+#include "Juce_Header.h"
+#include "SimdKernels.h"
+#include "../SUBMODULES/RD/SOURCE/CircularBuffer.h"
+
+class CircularReadView
+{
+public:
+	// startIndex is an absolute sample count and can be negative (before anything was written).
+	// numSamples can't be more than the buffer holds. Nothing is written through the view, the buffer is only
+	// taken by non-const reference because that's how CircularBuffer hands out its samples.
+	CircularReadView(CircularBuffer& circularBuffer, juce::int64 startIndex, int numSamples)
+	: mBuffer(circularBuffer.getBuffer())
+	{
+		const int size = circularBuffer.getSize();
+		jassert (numSamples >= 0 && numSamples <= size);
+		numSamples = juce::jlimit(0, size, numSamples);
+
+		mFirstStart = size > 0 ? (int)(((startIndex % size) + size) % size) : 0;
+		mFirstLength = juce::jmin(numSamples, size - mFirstStart);
+		mSecondLength = numSamples - mFirstLength;
+	}
+
+	int getNumSamples() const { return mFirstLength + mSecondLength; }
+	int getNumSpans() const { return mSecondLength > 0 ? 2 : (mFirstLength > 0 ? 1 : 0); }
+
+	// the first span starts at getFirstStart() in the buffer, the second (if any) always starts at 0
+	int getFirstStart() const { return mFirstStart; }
+	int getFirstLength() const { return mFirstLength; }
+	int getSecondLength() const { return mSecondLength; }
+	const float* getFirstSpan(int channel) const { return mBuffer.getReadPointer(channel) + mFirstStart; }
+	const float* getSecondSpan(int channel) const { return mBuffer.getReadPointer(channel); }
+
+	// Calls fn(const float* source, int offset, int length) once per span, offset is where the span starts in the view
+	template <typename Fn>
+	void forEachSpan(int channel, Fn&& fn) const
+	{
+		if (mFirstLength > 0)
+			fn(getFirstSpan(channel), 0, mFirstLength);
+		if (mSecondLength > 0)
+			fn(getSecondSpan(channel), mFirstLength, mSecondLength);
+	}
+
+	// dest[i] = view[i]
+	void copyTo(int channel, float* dest) const
+	{
+		forEachSpan(channel, [dest](const float* source, int offset, int length)
+		{
+			juce::FloatVectorOperations::copy(dest + offset, source, length);
+		});
+	}
+
+	// dest[i] = view[i] * gain[i]
+	void multiplyTo(int channel, float* dest, const float* gain) const
+	{
+		forEachSpan(channel, [dest, gain](const float* source, int offset, int length)
+		{
+			SimdKernels::multiply(dest + offset, source, gain + offset, length);
+		});
+	}
+
+	// dest[i] += view[i] * gain[i]
+	void addWithMultiplyTo(int channel, float* dest, const float* gain) const
+	{
+		forEachSpan(channel, [dest, gain](const float* source, int offset, int length)
+		{
+			juce::FloatVectorOperations::addWithMultiply(dest + offset, source, gain + offset, length);
+		});
+	}
+
+	// Index into the view of the largest absolute sample, the first one on a tie. -1 if the view is empty.
+	int findPeak(int channel) const
+	{
+		int peakIndex = -1;
+		float peak = -1.f;
+		forEachSpan(channel, [&](const float* source, int offset, int length)
+		{
+			for (int i = 0; i < length; ++i)
+			{
+				const float magnitude = std::abs(source[i]);
+				if (magnitude > peak)
+				{
+					peak = magnitude;
+					peakIndex = offset + i;
+				}
+			}
+		});
+		return peakIndex;
+	}
+
+private:
+	const juce::AudioBuffer<float>& mBuffer;
+	int mFirstStart = 0;
+	int mFirstLength = 0;
+	int mSecondLength = 0;
+};
@@ -0,0 +1,88 @@
+/**
+ * PolyphaseResampler.cpp
+ * Created by Ryan Devens
+ */
+
+#include "PolyphaseResampler.h"
+#include "SimdKernels.h"
+#include <cmath>
+
+PolyphaseResampler::PolyphaseResampler()
+{
+	prepare(1.f);
+}
+
+PolyphaseResampler::~PolyphaseResampler()
+{
+}
+
+//=======================================
+void PolyphaseResampler::prepare(float minCutoff)
+{
+	minCutoff = juce::jlimit(0.05f, 1.f, minCutoff);
+	mNumCutoffs = 1 + (int)std::ceil((1.f - minCutoff) / kCutoffStep - 1.0e-4f);
+
+	mTables.assign(kTableSize * (size_t)mNumCutoffs, 0.f);
+	for (int i = 0; i < mNumCutoffs; ++i)
+		_fillTable(mTables.data() + kTableSize * (size_t)i, 1.f - (float)i * kCutoffStep);
+
+	mTableOffset = 0;
+	mCutoff = 1.f;
+}
+
+//=======================================
+void PolyphaseResampler::setCutoff(float cutoff)
+{
+	// rounding down, a little under the cutoff asked for rather than over it and aliasing
+	const int index = juce::jlimit(0, mNumCutoffs - 1, (int)std::ceil((1.f - cutoff) / kCutoffStep - 1.0e-4f));
+	mTableOffset = kTableSize * (size_t)index;
+	mCutoff = 1.f - (float)index * kCutoffStep;
+}
+
+//=======================================
+float PolyphaseResampler::getSampleAt(const float* input, double position) const
+{
+	const double base = std::floor(position);
+	const int phase = (int)std::lround((position - base) * (double)kNumPhases);
+	return SimdKernels::dotProduct(getPhase(phase), input + (std::ptrdiff_t)base - kPadding + 1, kNumTaps);
+}
+
+//=======================================
+void PolyphaseResampler::process(const float* input, double startPosition, double step, float* output, int numSamples) const
+{
+	// positions are worked out from the start every time, so a long run doesn't drift
+	for (int i = 0; i < numSamples; ++i)
+		output[i] = getSampleAt(input, startPosition + (double)i * step);
+}
+
+//=======================================
+void PolyphaseResampler::_fillTable(float* table, float cutoff)
+{
+	const double pi = juce::MathConstants<double>::pi;
+	for (int phase = 0; phase <= kNumPhases; ++phase)
+	{
+		const double fraction = (double)phase / (double)kNumPhases;
+		float* row = table + (size_t)phase * kNumTaps;
+
+		double sum = 0.0;
+		for (int tap = 0; tap < kNumTaps; ++tap)
+		{
+			// distance from the position to this tap's input sample, and where that is across the Blackman window
+			const double t = (double)(tap - kPadding + 1) - fraction;
+			const double x = (t + (double)kPadding) / (double)kNumTaps;
+			const double window = x <= 0.0 || x >= 1.0 ? 0.0 : 0.42 - 0.5 * std::cos(2.0 * pi * x) + 0.08 * std::cos(4.0 * pi * x);
+			const double sinc = t == 0.0 ? 1.0 : std::sin(pi * (double)cutoff * t) / (pi * (double)cutoff * t);
+			const double coefficient = (double)cutoff * sinc * window;
+			row[tap] = (float)coefficient;
+			sum += coefficient;
+		}
+
+		// a constant comes out as itself whatever the phase
+		if (sum != 0.0)
+		{
+			for (int tap = 0; tap < kNumTaps; ++tap)
+				row[tap] = (float)((double)row[tap] / sum);
+		}
+	}
+	mNumTableFills++;
+}
@@ -0,0 +1,69 @@
+/**
+ * PolyphaseResampler.h
+ * Created by Ryan Devens
+ *
+ * Windowed sinc resampling out of a table built ahead of time. The fractional positions between two samples are
+ * split into kNumPhases phases, each with a row of kNumTaps filter coefficients, so an output sample is the row for
+ * its nearest phase dotted with the kNumTaps input samples around it (SimdKernels::dotProduct), no sinc evaluated.
+ * Rows are normalized to unit DC gain. Reading faster than the input needs a lower cutoff, so prepare() tables a
+ * bank of cutoffs kCutoffStep apart and setCutoff() only picks one, nothing is built on the audio thread.
+ *
+ * RD's Interpolator (SUBMODULES/RD/SOURCE/Interpolator.h, listed in SOURCES.cmake with its tests in TESTS.cmake)
+ * is the obvious thing to build the phases on. The RD submodule isn't checked out in this tree and nothing else
+ * here includes it, so there's no API to read or build against, and the table is computed directly instead.
+ * Worth moving over once RD builds alongside it, the band limiting and SimdKernels::dotProduct stay as they are.
+ */
+
+#pragma once
+#include "Juce_Header.h"
+#include <vector>
+
+class PolyphaseResampler
+{
+public:
+	static constexpr int kNumTaps = 16; // a whole AVX2 pass, or four SSE2 / NEON ones
+	static constexpr int kNumPhases = 256;
+	static constexpr int kPadding = kNumTaps / 2; // input read either side of the samples being resampled
+	static constexpr float kCutoffStep = 1.f / 16.f; // between the tabled cutoffs, 16 KB of table each
+
+	// only tables a cutoff of 1, no band limiting past what interpolating needs
+	PolyphaseResampler();
+	~PolyphaseResampler();
+
+	// Tables every cutoff from 1 down to minCutoff (limited to 0.05..1) kCutoffStep apart and selects 1.
+	// Allocates and runs a few thousand sin() calls per table, so call it from prepare().
+	void prepare(float minCutoff);
+	int getNumCutoffs() const { return mNumCutoffs; }
+
+	// Cutoff as a fraction of the input's Nyquist, 1 / step when reading step > 1 input samples per output so
+	// it doesn't alias. Rounded down to the nearest tabled cutoff, and no lower than the lowest one. Only
+	// selects a table, safe to call every block.
+	void setCutoff(float cutoff);
+	float getCutoff() const { return mCutoff; }
+	int getNumTableFills() const { return mNumTableFills; }
+
+	// Input at fractional position, reading input[floor(position) - kPadding + 1 .. floor(position) + kPadding]
+	float getSampleAt(const float* input, double position) const;
+
+	// output[i] = getSampleAt(input, startPosition + i * step) for i < numSamples. The caller pads input with
+	// kPadding samples before startPosition and after the last position read.
+	void process(const float* input, double startPosition, double step, float* output, int numSamples) const;
+
+	// coefficients for phase, kNumTaps of them for input[floor(position) - kPadding + 1] onwards
+	const float* getPhase(int phase) const { return mTables.data() + mTableOffset + (size_t)phase * kNumTaps; }
+
+private:
+	friend class PolyphaseResamplerTester;
+
+	static constexpr size_t kTableSize = (size_t)(kNumPhases + 1) * kNumTaps;
+
+	// mNumCutoffs tables of kNumPhases + 1 rows, cutoff 1 first. The last row of each is phase 0 a sample on
+	// so rounding up needs no wrap.
+	std::vector<float> mTables;
+	size_t mTableOffset = 0; // start of the selected cutoff's table
+	int mNumCutoffs = 0;
+	float mCutoff = 0.f;
+	int mNumTableFills = 0;
+
+	void _fillTable(float* table, float cutoff);
+};
@@ -0,0 +1,680 @@
+/**
+ * SimdKernels.cpp
+ * Created by Ryan Devens
+ */
+
+#include "SimdKernels.h"
+#include "Juce_Header.h"
+#include <atomic>
+#include <initializer_list>
+
+// SSE2 is part of x86-64, AVX2 is compiled per function and only called if the CPU has it.
+// NEON is only used on AArch64, where it's always there (and has a real divide).
+#if defined(__x86_64__) || defined(_M_X64)
+ #define SIMD_KERNELS_X86 1
+ #include <immintrin.h>
+ #if defined(__GNUC__) || defined(__clang__)
+  #define SIMD_KERNELS_AVX2_TARGET __attribute__((target("avx2")))
+ #else
+  #define SIMD_KERNELS_AVX2_TARGET
+ #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #define SIMD_KERNELS_NEON 1
+ #include <arm_neon.h>
+#endif
+
+namespace SimdKernels
+{
+
+//=======================================
+// Scalar reference
+//=======================================
+namespace Scalar
+{
+	float sumSquaredDifference(const float* x, const float* y, int n)
+	{
+		float sum = 0.f;
+		for(int j = 0; j < n; ++j)
+		{
+			const float delta = x[j] - y[j];
+			sum += delta * delta;
+		}
+		return sum;
+	}
+
+	float dotProduct(const float* x, const float* y, int n)
+	{
+		float sum = 0.f;
+		for(int j = 0; j < n; ++j)
+			sum += x[j] * y[j];
+		return sum;
+	}
+
+	void yinDifference(const float* x, float* diff, int windowSize, int maxTau)
+	{
+		diff[0] = 0.f;
+		for(int tau = 1; tau <= maxTau; ++tau)
+			diff[tau] = sumSquaredDifference(x, x + tau, windowSize);
+	}
+
+	void yinNormalizedDifference(const float* diff, float* cmnd, int numSamples)
+	{
+		if(numSamples <= 0)
+			return;
+
+		cmnd[0] = 1.f;
+		double runningSum = 0.0;
+		for(int tau = 1; tau < numSamples; ++tau)
+		{
+			runningSum += (double)diff[tau];
+			cmnd[tau] = runningSum > 0.0 ? (float)((double)diff[tau] * (double)tau / runningSum) : 1.f;
+		}
+	}
+
+	void multiply(float* dst, const float* src, const float* gain, int n)
+	{
+		for(int i = 0; i < n; ++i)
+			dst[i] = src[i] * gain[i];
+	}
+
+	void add(float* dst, const float* src, int n)
+	{
+		for(int i = 0; i < n; ++i)
+			dst[i] += src[i];
+	}
+
+	void divideWhereAbove(float* dst, const float* num, const float* den, float floor, int n)
+	{
+		for(int i = 0; i < n; ++i)
+		{
+			if(den[i] > floor)
+				dst[i] = num[i] / den[i];
+		}
+	}
+
+	void guardedReciprocal(float* dst, const float* src, float floor, int n)
+	{
+		for(int i = 0; i < n; ++i)
+			dst[i] = src[i] > floor ? 1.f / src[i] : 0.f;
+	}
+
+	void multiplyWhereNonZero(float* dst, const float* src, const float* gain, int n)
+	{
+		for(int i = 0; i < n; ++i)
+		{
+			if(gain[i] != 0.f)
+				dst[i] = src[i] * gain[i];
+		}
+	}
+} // end namespace Scalar
+
+//=======================================
+// SSE2 / AVX2
+//=======================================
+#if SIMD_KERNELS_X86
+namespace
+{
+	inline float _horizontalSum(__m128 v)
+	{
+		__m128 high = _mm_movehl_ps(v, v);
+		__m128 sum = _mm_add_ps(v, high);
+		high = _mm_shuffle_ps(sum, sum, 1);
+		sum = _mm_add_ss(sum, high);
+		return _mm_cvtss_f32(sum);
+	}
+
+	float _sse2SumSquaredDifference(const float* x, const float* y, int n)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		int j = 0;
+		for(; j + 8 <= n; j += 8)
+		{
+			const __m128 d0 = _mm_sub_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(y + j));
+			const __m128 d1 = _mm_sub_ps(_mm_loadu_ps(x + j + 4), _mm_loadu_ps(y + j + 4));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+		}
+		float sum = _horizontalSum(_mm_add_ps(acc0, acc1));
+		for(; j < n; ++j)
+		{
+			const float delta = x[j] - y[j];
+			sum += delta * delta;
+		}
+		return sum;
+	}
+
+	float _sse2DotProduct(const float* x, const float* y, int n)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		int j = 0;
+		for(; j + 8 <= n; j += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(y + j)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + j + 4), _mm_loadu_ps(y + j + 4)));
+		}
+		float sum = _horizontalSum(_mm_add_ps(acc0, acc1));
+		for(; j < n; ++j)
+			sum += x[j] * y[j];
+		return sum;
+	}
+
+	void _sse2YinDifference(const float* x, float* diff, int windowSize, int maxTau)
+	{
+		diff[0] = 0.f;
+		for(int tau = 1; tau <= maxTau; ++tau)
+			diff[tau] = _sse2SumSquaredDifference(x, x + tau, windowSize);
+	}
+
+	// The running sum is a prefix scan, done 4 lags at a time in registers. The carry between
+	// chunks is kept in double like the scalar version so long windows don't drift.
+	void _sse2YinNormalizedDifference(const float* diff, float* cmnd, int numSamples)
+	{
+		if(numSamples <= 0)
+			return;
+
+		cmnd[0] = 1.f;
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 four = _mm_set1_ps(4.f);
+		__m128 tauVec = _mm_setr_ps(1.f, 2.f, 3.f, 4.f);
+		double carry = 0.0;
+
+		int tau = 1;
+		for(; tau + 4 <= numSamples; tau += 4)
+		{
+			const __m128 d = _mm_loadu_ps(diff + tau);
+			__m128 scan = _mm_add_ps(d, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(d), 4)));
+			scan = _mm_add_ps(scan, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(scan), 8)));
+
+			const __m128 running = _mm_add_ps(_mm_set1_ps((float)carry), scan);
+			const __m128 quotient = _mm_div_ps(_mm_mul_ps(d, tauVec), running);
+			const __m128 valid = _mm_cmpgt_ps(running, zero);
+			_mm_storeu_ps(cmnd + tau, _mm_or_ps(_mm_and_ps(valid, quotient), _mm_andnot_ps(valid, one)));
+
+			carry += (double)_mm_cvtss_f32(_mm_shuffle_ps(scan, scan, _MM_SHUFFLE(3, 3, 3, 3)));
+			tauVec = _mm_add_ps(tauVec, four);
+		}
+		for(; tau < numSamples; ++tau)
+		{
+			carry += (double)diff[tau];
+			cmnd[tau] = carry > 0.0 ? (float)((double)diff[tau] * (double)tau / carry) : 1.f;
+		}
+	}
+
+	void _sse2Multiply(float* dst, const float* src, const float* gain, int n)
+	{
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), _mm_loadu_ps(gain + i)));
+		for(; i < n; ++i)
+			dst[i] = src[i] * gain[i];
+	}
+
+	void _sse2Add(float* dst, const float* src, int n)
+	{
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+		for(; i < n; ++i)
+			dst[i] += src[i];
+	}
+
+	void _sse2DivideWhereAbove(float* dst, const float* num, const float* den, float floor, int n)
+	{
+		const __m128 floorVec = _mm_set1_ps(floor);
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			const __m128 d = _mm_loadu_ps(den + i);
+			const __m128 valid = _mm_cmpgt_ps(d, floorVec);
+			const __m128 quotient = _mm_div_ps(_mm_loadu_ps(num + i), d);
+			const __m128 old = _mm_loadu_ps(dst + i);
+			_mm_storeu_ps(dst + i, _mm_or_ps(_mm_and_ps(valid, quotient), _mm_andnot_ps(valid, old)));
+		}
+		for(; i < n; ++i)
+		{
+			if(den[i] > floor)
+				dst[i] = num[i] / den[i];
+		}
+	}
+
+	void _sse2GuardedReciprocal(float* dst, const float* src, float floor, int n)
+	{
+		const __m128 floorVec = _mm_set1_ps(floor);
+		const __m128 one = _mm_set1_ps(1.f);
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			const __m128 v = _mm_loadu_ps(src + i);
+			_mm_storeu_ps(dst + i, _mm_and_ps(_mm_cmpgt_ps(v, floorVec), _mm_div_ps(one, v)));
+		}
+		for(; i < n; ++i)
+			dst[i] = src[i] > floor ? 1.f / src[i] : 0.f;
+	}
+
+	void _sse2MultiplyWhereNonZero(float* dst, const float* src, const float* gain, int n)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			const __m128 g = _mm_loadu_ps(gain + i);
+			const __m128 keep = _mm_cmpeq_ps(g, zero);
+			const __m128 product = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+			_mm_storeu_ps(dst + i, _mm_or_ps(_mm_andnot_ps(keep, product), _mm_and_ps(keep, _mm_loadu_ps(dst + i))));
+		}
+		for(; i < n; ++i)
+		{
+			if(gain[i] != 0.f)
+				dst[i] = src[i] * gain[i];
+		}
+	}
+
+	SIMD_KERNELS_AVX2_TARGET float _avx2SumSquaredDifference(const float* x, const float* y, int n)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		int j = 0;
+		for(; j + 16 <= n; j += 16)
+		{
+			const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j));
+			const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(y + j + 8));
+			acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+			acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+		}
+		const __m256 acc = _mm256_add_ps(acc0, acc1);
+		float sum = _horizontalSum(_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+		for(; j < n; ++j)
+		{
+			const float delta = x[j] - y[j];
+			sum += delta * delta;
+		}
+		return sum;
+	}
+
+	SIMD_KERNELS_AVX2_TARGET float _avx2DotProduct(const float* x, const float* y, int n)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		int j = 0;
+		for(; j + 16 <= n; j += 16)
+		{
+			acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+			acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(y + j + 8)));
+		}
+		// a 16 tap filter is one pass, shorter ones finish 8 wide before the scalar tail
+		for(; j + 8 <= n; j += 8)
+			acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+		const __m256 acc = _mm256_add_ps(acc0, acc1);
+		float sum = _horizontalSum(_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+		for(; j < n; ++j)
+			sum += x[j] * y[j];
+		return sum;
+	}
+
+	SIMD_KERNELS_AVX2_TARGET void _avx2YinDifference(const float* x, float* diff, int windowSize, int maxTau)
+	{
+		diff[0] = 0.f;
+		for(int tau = 1; tau <= maxTau; ++tau)
+			diff[tau] = _avx2SumSquaredDifference(x, x + tau, windowSize);
+	}
+
+	SIMD_KERNELS_AVX2_TARGET void _avx2Multiply(float* dst, const float* src, const float* gain, int n)
+	{
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), _mm256_loadu_ps(gain + i)));
+		for(; i < n; ++i)
+			dst[i] = src[i] * gain[i];
+	}
+
+	SIMD_KERNELS_AVX2_TARGET void _avx2Add(float* dst, const float* src, int n)
+	{
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+		for(; i < n; ++i)
+			dst[i] += src[i];
+	}
+
+	SIMD_KERNELS_AVX2_TARGET void _avx2DivideWhereAbove(float* dst, const float* num, const float* den, float floor, int n)
+	{
+		const __m256 floorVec = _mm256_set1_ps(floor);
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+		{
+			const __m256 d = _mm256_loadu_ps(den + i);
+			const __m256 valid = _mm256_cmp_ps(d, floorVec, _CMP_GT_OQ);
+			const __m256 quotient = _mm256_div_ps(_mm256_loadu_ps(num + i), d);
+			_mm256_storeu_ps(dst + i, _mm256_blendv_ps(_mm256_loadu_ps(dst + i), quotient, valid));
+		}
+		for(; i < n; ++i)
+		{
+			if(den[i] > floor)
+				dst[i] = num[i] / den[i];
+		}
+	}
+
+	SIMD_KERNELS_AVX2_TARGET void _avx2GuardedReciprocal(float* dst, const float* src, float floor, int n)
+	{
+		const __m256 floorVec = _mm256_set1_ps(floor);
+		const __m256 one = _mm256_set1_ps(1.f);
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+		{
+			const __m256 v = _mm256_loadu_ps(src + i);
+			_mm256_storeu_ps(dst + i, _mm256_and_ps(_mm256_cmp_ps(v, floorVec, _CMP_GT_OQ), _mm256_div_ps(one, v)));
+		}
+		for(; i < n; ++i)
+			dst[i] = src[i] > floor ? 1.f / src[i] : 0.f;
+	}
+
+	SIMD_KERNELS_AVX2_TARGET void _avx2MultiplyWhereNonZero(float* dst, const float* src, const float* gain, int n)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		int i = 0;
+		for(; i + 8 <= n; i += 8)
+		{
+			const __m256 g = _mm256_loadu_ps(gain + i);
+			const __m256 product = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+			_mm256_storeu_ps(dst + i, _mm256_blendv_ps(product, _mm256_loadu_ps(dst + i), _mm256_cmp_ps(g, zero, _CMP_EQ_OQ)));
+		}
+		for(; i < n; ++i)
+		{
+			if(gain[i] != 0.f)
+				dst[i] = src[i] * gain[i];
+		}
+	}
+} // end anonymous namespace
+#endif
+
+//=======================================
+// NEON
+//=======================================
+#if SIMD_KERNELS_NEON
+namespace
+{
+	float _neonSumSquaredDifference(const float* x, const float* y, int n)
+	{
+		float32x4_t acc0 = vdupq_n_f32(0.f);
+		float32x4_t acc1 = vdupq_n_f32(0.f);
+		int j = 0;
+		for(; j + 8 <= n; j += 8)
+		{
+			const float32x4_t d0 = vsubq_f32(vld1q_f32(x + j), vld1q_f32(y + j));
+			const float32x4_t d1 = vsubq_f32(vld1q_f32(x + j + 4), vld1q_f32(y + j + 4));
+			acc0 = vmlaq_f32(acc0, d0, d0);
+			acc1 = vmlaq_f32(acc1, d1, d1);
+		}
+		float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+		for(; j < n; ++j)
+		{
+			const float delta = x[j] - y[j];
+			sum += delta * delta;
+		}
+		return sum;
+	}
+
+	float _neonDotProduct(const float* x, const float* y, int n)
+	{
+		float32x4_t acc0 = vdupq_n_f32(0.f);
+		float32x4_t acc1 = vdupq_n_f32(0.f);
+		int j = 0;
+		for(; j + 8 <= n; j += 8)
+		{
+			acc0 = vmlaq_f32(acc0, vld1q_f32(x + j), vld1q_f32(y + j));
+			acc1 = vmlaq_f32(acc1, vld1q_f32(x + j + 4), vld1q_f32(y + j + 4));
+		}
+		float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+		for(; j < n; ++j)
+			sum += x[j] * y[j];
+		return sum;
+	}
+
+	void _neonYinDifference(const float* x, float* diff, int windowSize, int maxTau)
+	{
+		diff[0] = 0.f;
+		for(int tau = 1; tau <= maxTau; ++tau)
+			diff[tau] = _neonSumSquaredDifference(x, x + tau, windowSize);
+	}
+
+	void _neonYinNormalizedDifference(const float* diff, float* cmnd, int numSamples)
+	{
+		if(numSamples <= 0)
+			return;
+
+		cmnd[0] = 1.f;
+		const float32x4_t zero = vdupq_n_f32(0.f);
+		const float32x4_t one = vdupq_n_f32(1.f);
+		const float32x4_t four = vdupq_n_f32(4.f);
+		const float tauStart[4] = { 1.f, 2.f, 3.f, 4.f };
+		float32x4_t tauVec = vld1q_f32(tauStart);
+		double carry = 0.0;
+
+		int tau = 1;
+		for(; tau + 4 <= numSamples; tau += 4)
+		{
+			const float32x4_t d = vld1q_f32(diff + tau);
+			float32x4_t scan = vaddq_f32(d, vextq_f32(zero, d, 3));
+			scan = vaddq_f32(scan, vextq_f32(zero, scan, 2));
+
+			const float32x4_t running = vaddq_f32(vdupq_n_f32((float)carry), scan);
+			const float32x4_t quotient = vdivq_f32(vmulq_f32(d, tauVec), running);
+			vst1q_f32(cmnd + tau, vbslq_f32(vcgtq_f32(running, zero), quotient, one));
+
+			carry += (double)vgetq_lane_f32(scan, 3);
+			tauVec = vaddq_f32(tauVec, four);
+		}
+		for(; tau < numSamples; ++tau)
+		{
+			carry += (double)diff[tau];
+			cmnd[tau] = carry > 0.0 ? (float)((double)diff[tau] * (double)tau / carry) : 1.f;
+		}
+	}
+
+	void _neonMultiply(float* dst, const float* src, const float* gain, int n)
+	{
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+			vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i), vld1q_f32(gain + i)));
+		for(; i < n; ++i)
+			dst[i] = src[i] * gain[i];
+	}
+
+	void _neonAdd(float* dst, const float* src, int n)
+	{
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+			vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+		for(; i < n; ++i)
+			dst[i] += src[i];
+	}
+
+	void _neonDivideWhereAbove(float* dst, const float* num, const float* den, float floor, int n)
+	{
+		const float32x4_t floorVec = vdupq_n_f32(floor);
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			const float32x4_t d = vld1q_f32(den + i);
+			const float32x4_t quotient = vdivq_f32(vld1q_f32(num + i), d);
+			vst1q_f32(dst + i, vbslq_f32(vcgtq_f32(d, floorVec), quotient, vld1q_f32(dst + i)));
+		}
+		for(; i < n; ++i)
+		{
+			if(den[i] > floor)
+				dst[i] = num[i] / den[i];
+		}
+	}
+
+	void _neonGuardedReciprocal(float* dst, const float* src, float floor, int n)
+	{
+		const float32x4_t floorVec = vdupq_n_f32(floor);
+		const float32x4_t one = vdupq_n_f32(1.f);
+		const float32x4_t zero = vdupq_n_f32(0.f);
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			const float32x4_t v = vld1q_f32(src + i);
+			vst1q_f32(dst + i, vbslq_f32(vcgtq_f32(v, floorVec), vdivq_f32(one, v), zero));
+		}
+		for(; i < n; ++i)
+			dst[i] = src[i] > floor ? 1.f / src[i] : 0.f;
+	}
+
+	void _neonMultiplyWhereNonZero(float* dst, const float* src, const float* gain, int n)
+	{
+		const float32x4_t zero = vdupq_n_f32(0.f);
+		int i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			const float32x4_t g = vld1q_f32(gain + i);
+			const float32x4_t product = vmulq_f32(vld1q_f32(src + i), g);
+			vst1q_f32(dst + i, vbslq_f32(vceqq_f32(g, zero), vld1q_f32(dst + i), product));
+		}
+		for(; i < n; ++i)
+		{
+			if(gain[i] != 0.f)
+				dst[i] = src[i] * gain[i];
+		}
+	}
+} // end anonymous namespace
+#endif
+
+//=======================================
+// Dispatch
+//=======================================
+namespace
+{
+	struct KernelTable
+	{
+		Isa isa;
+		float (*sumSquaredDifference)(const float*, const float*, int);
+		float (*dotProduct)(const float*, const float*, int);
+		void (*yinDifference)(const float*, float*, int, int);
+		void (*yinNormalizedDifference)(const float*, float*, int);
+		void (*multiply)(float*, const float*, const float*, int);
+		void (*add)(float*, const float*, int);
+		void (*divideWhereAbove)(float*, const float*, const float*, float, int);
+		void (*guardedReciprocal)(float*, const float*, float, int);
+		void (*multiplyWhereNonZero)(float*, const float*, const float*, int);
+	};
+
+	const KernelTable kScalarTable { Isa::kScalar, Scalar::sumSquaredDifference, Scalar::dotProduct, Scalar::yinDifference,
+									 Scalar::yinNormalizedDifference, Scalar::multiply, Scalar::add, Scalar::divideWhereAbove,
+									 Scalar::guardedReciprocal, Scalar::multiplyWhereNonZero };
+#if SIMD_KERNELS_X86
+	const KernelTable kSSE2Table { Isa::kSSE2, _sse2SumSquaredDifference, _sse2DotProduct, _sse2YinDifference,
+								   _sse2YinNormalizedDifference, _sse2Multiply, _sse2Add, _sse2DivideWhereAbove,
+								   _sse2GuardedReciprocal, _sse2MultiplyWhereNonZero };
+	// the cmnd scan is 4 wide either way, 8 lanes would only add shuffles
+	const KernelTable kAVX2Table { Isa::kAVX2, _avx2SumSquaredDifference, _avx2DotProduct, _avx2YinDifference,
+								   _sse2YinNormalizedDifference, _avx2Multiply, _avx2Add, _avx2DivideWhereAbove,
+								   _avx2GuardedReciprocal, _avx2MultiplyWhereNonZero };
+#endif
+#if SIMD_KERNELS_NEON
+	const KernelTable kNEONTable { Isa::kNEON, _neonSumSquaredDifference, _neonDotProduct, _neonYinDifference,
+								   _neonYinNormalizedDifference, _neonMultiply, _neonAdd, _neonDivideWhereAbove,
+								   _neonGuardedReciprocal, _neonMultiplyWhereNonZero };
+#endif
+
+	const KernelTable* _tableFor(Isa isa)
+	{
+		if(!isIsaSupported(isa))
+			return &kScalarTable;
+
+		switch(isa)
+		{
+#if SIMD_KERNELS_X86
+			case Isa::kSSE2: return &kSSE2Table;
+			case Isa::kAVX2: return &kAVX2Table;
+#endif
+#if SIMD_KERNELS_NEON
+			case Isa::kNEON: return &kNEONTable;
+#endif
+			default: return &kScalarTable;
+		}
+	}
+
+	Isa _detectBestIsa()
+	{
+		for(Isa isa : { Isa::kAVX2, Isa::kNEON, Isa::kSSE2 })
+		{
+			if(isIsaSupported(isa))
+				return isa;
+		}
+		return Isa::kScalar;
+	}
+
+	std::atomic<const KernelTable*> sActiveTable { nullptr };
+
+	const KernelTable& _activeTable()
+	{
+		const KernelTable* table = sActiveTable.load(std::memory_order_acquire);
+		if(table == nullptr)
+		{
+			// racing first calls all pick the same table, so a plain store is fine
+			table = _tableFor(_detectBestIsa());
+			sActiveTable.store(table, std::memory_order_release);
+		}
+		return *table;
+	}
+} // end anonymous namespace
+
+//=======================================
+bool isIsaSupported(Isa isa)
+{
+	switch(isa)
+	{
+		case Isa::kScalar: return true;
+#if SIMD_KERNELS_X86
+		case Isa::kSSE2: return juce::SystemStats::hasSSE2();
+		case Isa::kAVX2: return juce::SystemStats::hasAVX2();
+#endif
+#if SIMD_KERNELS_NEON
+		case Isa::kNEON: return true;
+#endif
+		default: return false;
+	}
+}
+
+const char* getIsaName(Isa isa)
+{
+	switch(isa)
+	{
+		case Isa::kScalar: return "Scalar";
+		case Isa::kSSE2: return "SSE2";
+		case Isa::kAVX2: return "AVX2";
+		case Isa::kNEON: return "NEON";
+	}
+	return "Unknown";
+}
+
+Isa getActiveIsa() { return _activeTable().isa; }
+
+void setIsaOverride(Isa isa) { sActiveTable.store(_tableFor(isa), std::memory_order_release); }
+
+void clearIsaOverride() { sActiveTable.store(_tableFor(_detectBestIsa()), std::memory_order_release); }
+
+//=======================================
+float sumSquaredDifference(const float* x, const float* y, int n) { return _activeTable().sumSquaredDifference(x, y, n); }
+
+float dotProduct(const float* x, const float* y, int n) { return _activeTable().dotProduct(x, y, n); }
+
+void yinDifference(const float* x, float* diff, int windowSize, int maxTau) { _activeTable().yinDifference(x, diff, windowSize, maxTau); }
+
+void yinNormalizedDifference(const float* diff, float* cmnd, int numSamples) { _activeTable().yinNormalizedDifference(diff, cmnd, numSamples); }
+
+void multiply(float* dst, const float* src, const float* gain, int n) { _activeTable().multiply(dst, src, gain, n); }
+
+void add(float* dst, const float* src, int n) { _activeTable().add(dst, src, n); }
+
+void divideWhereAbove(float* dst, const float* num, const float* den, float floor, int n) { _activeTable().divideWhereAbove(dst, num, den, floor, n); }
+
+void guardedReciprocal(float* dst, const float* src, float floor, int n) { _activeTable().guardedReciprocal(dst, src, floor, n); }
+
+void multiplyWhereNonZero(float* dst, const float* src, const float* gain, int n) { _activeTable().multiplyWhereNonZero(dst, src, gain, n); }
+
+} // end namespace SimdKernels
@@ -0,0 +1,75 @@
+/**
+ * SimdKernels.h
+ * Created by Ryan Devens
+ *
+ * Vectorized versions of the hot inner loops (YIN difference / cmnd, grain windowing and overlap-add,
+ * resampling filters).
+ * The best instruction set the CPU supports is picked once at runtime, SimdKernels::Scalar is the
+ * plain reference the others are tested against.
+ */
+
+#pragma once
+
+namespace SimdKernels
+{
+	enum class Isa
+	{
+		kScalar = 0,
+		kSSE2,
+		kAVX2,
+		kNEON
+	};
+
+	// Best supported ISA, unless overridden
+	Isa getActiveIsa();
+	bool isIsaSupported(Isa isa);
+	const char* getIsaName(Isa isa);
+
+	// For tests and benchmarks. Falls back to kScalar if the ISA isn't supported here.
+	// Not thread safe with respect to audio processing, set it before running anything.
+	void setIsaOverride(Isa isa);
+	void clearIsaOverride();
+
+	// sum over j < n of (x[j] - y[j])^2
+	float sumSquaredDifference(const float* x, const float* y, int n);
+
+	// sum over j < n of x[j] * y[j]
+	float dotProduct(const float* x, const float* y, int n);
+
+	// YIN difference, diff[tau] = sumSquaredDifference(x, x + tau, windowSize) for tau in [1, maxTau], diff[0] = 0.
+	// x needs windowSize + maxTau samples.
+	void yinDifference(const float* x, float* diff, int windowSize, int maxTau);
+
+	// Cumulative mean normalized difference, cmnd[0] = 1 and cmnd[tau] = diff[tau] * tau / sum(diff[1..tau])
+	void yinNormalizedDifference(const float* diff, float* cmnd, int numSamples);
+
+	// dst[i] = src[i] * gain[i]
+	void multiply(float* dst, const float* src, const float* gain, int n);
+
+	// dst[i] += src[i]
+	void add(float* dst, const float* src, int n);
+
+	// dst[i] = num[i] / den[i] where den[i] > floor, dst[i] is left alone elsewhere
+	void divideWhereAbove(float* dst, const float* num, const float* den, float floor, int n);
+
+	// dst[i] = 1 / src[i] where src[i] > floor, 0 elsewhere. dst may be src.
+	void guardedReciprocal(float* dst, const float* src, float floor, int n);
+
+	// dst[i] = src[i] * gain[i] where gain[i] != 0, dst[i] is left alone elsewhere.
+	// With guardedReciprocal() this is divideWhereAbove() with one divide shared by every channel.
+	void multiplyWhereNonZero(float* dst, const float* src, const float* gain, int n);
+
+	// Reference implementations, always available
+	namespace Scalar
+	{
+		float sumSquaredDifference(const float* x, const float* y, int n);
+		float dotProduct(const float* x, const float* y, int n);
+		void yinDifference(const float* x, float* diff, int windowSize, int maxTau);
+		void yinNormalizedDifference(const float* diff, float* cmnd, int numSamples);
+		void multiply(float* dst, const float* src, const float* gain, int n);
+		void add(float* dst, const float* src, int n);
+		void divideWhereAbove(float* dst, const float* num, const float* den, float floor, int n);
+		void guardedReciprocal(float* dst, const float* src, float floor, int n);
+		void multiplyWhereNonZero(float* dst, const float* src, const float* gain, int n);
+	} // end namespace Scalar
+} // end namespace SimdKernels
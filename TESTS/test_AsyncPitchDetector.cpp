@@ -0,0 +1,144 @@
+/**
+ * test_AsyncPitchDetector.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for the worker thread detection handoff
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include "../SOURCE/PITCH/AsyncPitchDetector.h"
+#include "../SOURCE/PITCH/PitchDetector.h"
+#include "../SUBMODULES/RD/SOURCE/BufferFiller.h"
+
+namespace
+{
+	// audio thread side never blocks, so the test polls until the worker catches up
+	bool waitForResult(AsyncPitchDetector& asyncDetector, AsyncPitchDetector::Result& result, int timeoutMs = 2000)
+	{
+		const auto start = juce::Time::getMillisecondCounter();
+		while (juce::Time::getMillisecondCounter() - start < (juce::uint32)timeoutMs)
+		{
+			if (asyncDetector.popLatestResult(result))
+				return true;
+			juce::Thread::sleep(1);
+		}
+		return false;
+	}
+}
+
+TEST_CASE("AsyncPitchDetector returns period and sample index from the worker", "[AsyncPitchDetector]")
+{
+	constexpr int windowSize = 2048;
+	constexpr int sinePeriod = 256;
+
+	PitchDetector detector;
+	detector.prepareToPlay(48000.0, windowSize);
+
+	AsyncPitchDetector asyncDetector(detector);
+	asyncDetector.prepare(2, windowSize);
+	asyncDetector.start();
+	REQUIRE(asyncDetector.isRunning());
+
+	juce::AudioBuffer<float> sineBuffer(2, windowSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	REQUIRE(asyncDetector.pushWindow(sineBuffer, 4095));
+
+	AsyncPitchDetector::Result result;
+	REQUIRE(waitForResult(asyncDetector, result));
+
+	CHECK(result.period == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+	CHECK(result.sampleIndex == 4095);
+	CHECK(result.probability > 0.5f);
+
+	asyncDetector.stop();
+	CHECK_FALSE(asyncDetector.isRunning());
+}
+
+TEST_CASE("AsyncPitchDetector drops windows instead of blocking when the worker is behind", "[AsyncPitchDetector]")
+{
+	constexpr int windowSize = 1024;
+
+	PitchDetector detector;
+	detector.prepareToPlay(48000.0, windowSize);
+
+	// worker never started, so nothing is consumed
+	AsyncPitchDetector asyncDetector(detector);
+	asyncDetector.prepare(1, windowSize);
+
+	juce::AudioBuffer<float> window(1, windowSize);
+	window.clear();
+
+	int numAccepted = 0;
+	for (int i = 0; i < 10; ++i)
+		if (asyncDetector.pushWindow(window, i))
+			numAccepted++;
+
+	CHECK(numAccepted > 0);
+	CHECK(numAccepted < 10);
+	CHECK(asyncDetector.getNumDroppedWindows() == 10 - numAccepted);
+
+	AsyncPitchDetector::Result result;
+	CHECK_FALSE(asyncDetector.popLatestResult(result));
+}
+
+TEST_CASE("AsyncPitchDetector keeps only the newest of several results", "[AsyncPitchDetector]")
+{
+	constexpr int windowSize = 2048;
+
+	PitchDetector detector;
+	detector.prepareToPlay(48000.0, windowSize);
+
+	AsyncPitchDetector asyncDetector(detector);
+	asyncDetector.prepare(1, windowSize);
+	asyncDetector.start();
+
+	juce::AudioBuffer<float> sineBuffer(1, windowSize);
+	BufferFiller::generateSineCycles(sineBuffer, 200);
+
+	asyncDetector.pushWindow(sineBuffer, 100);
+	asyncDetector.pushWindow(sineBuffer, 200);
+
+	// let both land before draining
+	juce::Thread::sleep(200);
+
+	AsyncPitchDetector::Result result;
+	REQUIRE(asyncDetector.popLatestResult(result));
+	CHECK(result.sampleIndex == 200);
+	CHECK_FALSE(asyncDetector.popLatestResult(result));
+}
+
+TEST_CASE("AsyncPitchDetector hands back every result in order when there's room for them", "[AsyncPitchDetector]")
+{
+	constexpr int windowSize = 2048;
+	constexpr int numWindows = 8;
+
+	PitchDetector detector;
+	detector.prepareToPlay(48000.0, windowSize);
+
+	AsyncPitchDetector asyncDetector(detector);
+	asyncDetector.prepare(1, windowSize, numWindows);
+	CHECK(asyncDetector.getNumWindows() == numWindows);
+
+	juce::AudioBuffer<float> sineBuffer(1, windowSize);
+	BufferFiller::generateSineCycles(sineBuffer, 200);
+
+	// all of them queue up before the worker starts
+	for (int i = 0; i < numWindows; ++i)
+		REQUIRE(asyncDetector.pushWindow(sineBuffer, 100 * (i + 1)));
+	CHECK_FALSE(asyncDetector.pushWindow(sineBuffer, 0));
+	CHECK(asyncDetector.getNumDroppedWindows() == 1);
+
+	asyncDetector.start();
+	juce::Thread::sleep(500);
+
+	AsyncPitchDetector::Result result;
+	for (int i = 0; i < numWindows; ++i)
+	{
+		REQUIRE(asyncDetector.popResult(result));
+		CHECK(result.sampleIndex == 100 * (i + 1));
+		CHECK(result.period == Catch::Approx(200.f).margin(1.0f));
+	}
+	CHECK_FALSE(asyncDetector.popResult(result));
+}
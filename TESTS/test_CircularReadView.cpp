@@ -0,0 +1,147 @@
+/**
+ * test_CircularReadView.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for splitting absolute circular buffer ranges into contiguous spans
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <vector>
+#include "../SOURCE/Util/CircularReadView.h"
+#include "../SUBMODULES/RD/SOURCE/CircularBuffer.h"
+
+namespace
+{
+	constexpr int kCircularBufferSize = 2048;
+
+	// sample i of the stream is i, on channel 1 it's -i
+	void fillIncremental(CircularBuffer& circularBuffer)
+	{
+		juce::AudioBuffer<float> incremental(2, kCircularBufferSize);
+		for (int i = 0; i < kCircularBufferSize; ++i)
+		{
+			incremental.setSample(0, i, (float)i);
+			incremental.setSample(1, i, -(float)i);
+		}
+		circularBuffer.setSize(2, kCircularBufferSize);
+		circularBuffer.pushBuffer(incremental);
+	}
+}
+
+TEST_CASE("CircularReadView splits ranges at the wrap point", "[CircularReadView]")
+{
+	CircularBuffer circularBuffer;
+	fillIncremental(circularBuffer);
+
+	SECTION("A range inside the buffer is one span")
+	{
+		const CircularReadView view(circularBuffer, 100, 512);
+		CHECK(view.getNumSpans() == 1);
+		CHECK(view.getFirstStart() == 100);
+		CHECK(view.getFirstLength() == 512);
+		CHECK(view.getSecondLength() == 0);
+	}
+
+	SECTION("A range ending exactly at the end of the buffer is one span")
+	{
+		const CircularReadView view(circularBuffer, kCircularBufferSize - 256, 256);
+		CHECK(view.getNumSpans() == 1);
+		CHECK(view.getFirstLength() == 256);
+	}
+
+	SECTION("A range across the end of the buffer is two spans")
+	{
+		const CircularReadView view(circularBuffer, kCircularBufferSize - 100, 300);
+		CHECK(view.getNumSpans() == 2);
+		CHECK(view.getFirstStart() == kCircularBufferSize - 100);
+		CHECK(view.getFirstLength() == 100);
+		CHECK(view.getSecondLength() == 200);
+	}
+
+	SECTION("Absolute indices past the buffer size wrap, including around 4096")
+	{
+		const CircularReadView view(circularBuffer, 3900, 400);
+		CHECK(view.getFirstStart() == 3900 - kCircularBufferSize);
+		CHECK(view.getFirstLength() == 2 * kCircularBufferSize - 3900);
+		CHECK(view.getSecondLength() == 400 - view.getFirstLength());
+	}
+
+	SECTION("Negative indices wrap from the end")
+	{
+		const CircularReadView view(circularBuffer, -10, 30);
+		CHECK(view.getFirstStart() == kCircularBufferSize - 10);
+		CHECK(view.getFirstLength() == 10);
+		CHECK(view.getSecondLength() == 20);
+	}
+
+	SECTION("The whole buffer fits")
+	{
+		const CircularReadView view(circularBuffer, 5000, kCircularBufferSize);
+		CHECK(view.getNumSamples() == kCircularBufferSize);
+	}
+
+	SECTION("An empty range has no spans")
+	{
+		const CircularReadView view(circularBuffer, 1234, 0);
+		CHECK(view.getNumSpans() == 0);
+		CHECK(view.findPeak(0) == -1);
+	}
+}
+
+TEST_CASE("CircularReadView reads the same samples as wrapping every index", "[CircularReadView]")
+{
+	CircularBuffer circularBuffer;
+	fillIncremental(circularBuffer);
+
+	const juce::int64 start = GENERATE(as<juce::int64>(), -700, 0, 1500, 2047, 3900, 4096, 10000);
+	constexpr int numSamples = 700;
+	const CircularReadView view(circularBuffer, start, numSamples);
+
+	std::vector<float> gain((size_t)numSamples);
+	for (int i = 0; i < numSamples; ++i)
+		gain[(size_t)i] = 0.5f + (float)(i % 7);
+
+	for (int ch = 0; ch < 2; ++ch)
+	{
+		std::vector<float> copied((size_t)numSamples, 0.f);
+		std::vector<float> multiplied((size_t)numSamples, 0.f);
+		std::vector<float> accumulated((size_t)numSamples, 1.f);
+		view.copyTo(ch, copied.data());
+		view.multiplyTo(ch, multiplied.data(), gain.data());
+		view.addWithMultiplyTo(ch, accumulated.data(), gain.data());
+
+		int mismatchCount = 0;
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const float expected = circularBuffer.getBuffer().getSample(ch, circularBuffer.getWrappedIndex(start + i));
+			if (copied[(size_t)i] != expected
+				|| multiplied[(size_t)i] != expected * gain[(size_t)i]
+				|| accumulated[(size_t)i] != 1.f + expected * gain[(size_t)i])
+				mismatchCount++;
+		}
+		INFO("Start: " << start << " channel: " << ch);
+		CHECK(mismatchCount == 0);
+	}
+}
+
+TEST_CASE("CircularReadView finds the peak across the wrap point", "[CircularReadView]")
+{
+	CircularBuffer circularBuffer;
+	fillIncremental(circularBuffer);
+
+	// the largest sample is the last one in the buffer, on both channels
+	const CircularReadView view(circularBuffer, kCircularBufferSize - 50, 100);
+	CHECK(view.findPeak(0) == 49);
+	CHECK(view.findPeak(1) == 49);
+
+	SECTION("Ties go to the first one")
+	{
+		juce::AudioBuffer<float> flat(1, kCircularBufferSize);
+		flat.clear();
+		CircularBuffer flatBuffer;
+		flatBuffer.setSize(1, kCircularBufferSize);
+		flatBuffer.pushBuffer(flat);
+		CHECK(CircularReadView(flatBuffer, -20, 40).findPeak(0) == 0);
+	}
+}
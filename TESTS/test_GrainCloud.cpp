@@ -0,0 +1,270 @@
+/**
+ * test_GrainCloud.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for the asynchronous grain cloud
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <set>
+#include "../SOURCE/GRAIN/GrainCloud.h"
+#include "../SUBMODULES/RD/SOURCE/BufferFiller.h"
+
+//==============================================================================
+// Test Access Class - Provides access to private members for testing
+//==============================================================================
+class GrainCloudTester
+{
+public:
+	static juce::int64 getReadStart(const GrainCloud& cloud, int grainIndex) { return cloud.mGrains[(size_t)grainIndex].readStart; }
+	static int getGrainSize(const GrainCloud& cloud, int grainIndex) { return cloud.mGrains[(size_t)grainIndex].grainSize; }
+};
+
+namespace
+{
+	constexpr double kSampleRate = 48000.0;
+	constexpr int kCircularBufferSize = 48000;
+
+	// pushes one block of the stream into the circular buffer and runs the cloud over it, like the processor does
+	void processBlock(GrainCloud& cloud, CircularBuffer& circularBuffer, juce::AudioBuffer<float>& input,
+					  juce::AudioBuffer<float>& output, juce::int64 blockStart)
+	{
+		circularBuffer.pushBuffer(input);
+		output.clear();
+		cloud.process(output, circularBuffer, {blockStart, blockStart + output.getNumSamples() - 1});
+	}
+}
+
+TEST_CASE("GrainCloud emits grains at the emission rate", "[GrainCloud]")
+{
+	constexpr int blockSize = 480;
+	GrainCloud cloud;
+	cloud.setEmissionRate(100.f); // one every 480 samples
+	cloud.setGrainSize(20.f);
+	cloud.prepare(kSampleRate, blockSize, 2, 100.f, 0.f);
+	REQUIRE(cloud.getGrainSize() == 960);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, kCircularBufferSize);
+	juce::AudioBuffer<float> input(2, blockSize);
+	juce::AudioBuffer<float> output(2, blockSize);
+	input.clear();
+
+	for (int block = 0; block < 10; ++block)
+		processBlock(cloud, circularBuffer, input, output, (juce::int64)block * blockSize);
+
+	CHECK(cloud.getNumEmittedGrains() == 10);
+	CHECK(cloud.getNumDroppedGrains() == 0);
+
+	// 960 sample grains a block apart, the one before finished with this block, the last is still playing
+	REQUIRE(cloud.getNumActiveGrains() == 1);
+	CHECK(cloud.getSchedule()[0].synthStart == 9 * blockSize);
+
+	SECTION("A fractional interval doesn't drift")
+	{
+		cloud.reset();
+		CHECK(cloud.getNumActiveGrains() == 0);
+		cloud.setEmissionRate(7.f); // 6857.14... samples apart
+		const juce::int64 emittedBefore = cloud.getNumEmittedGrains();
+		for (int block = 0; block < 960; ++block)
+			processBlock(cloud, circularBuffer, input, output, (juce::int64)(block + 10) * blockSize);
+		CHECK(cloud.getNumEmittedGrains() - emittedBefore == 68); // ceil(460800 / 6857.14)
+	}
+}
+
+TEST_CASE("GrainCloud grains play the source a grain length back", "[GrainCloud]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 256;
+	GrainCloud cloud;
+	cloud.setEmissionRate(1.f);
+	cloud.setGrainSize(1000.f * (float)grainSize / (float)kSampleRate);
+	cloud.prepare(kSampleRate, blockSize, 2, 100.f, 0.f);
+	REQUIRE(cloud.getGrainSize() == grainSize);
+	CHECK(cloud.getDensityGain() == 1.f);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, kCircularBufferSize);
+	juce::AudioBuffer<float> input(2, blockSize);
+	juce::AudioBuffer<float> output(2, blockSize);
+
+	Window window;
+	window.setSizeShapePeriod(48000, Window::Shape::kHanning, grainSize);
+
+	// sample n of the stream is n on the left and -n on the right
+	int mismatchCount = 0;
+	for (juce::int64 blockStart = 0; blockStart < 1024 + 3 * blockSize; blockStart += blockSize)
+	{
+		for (int i = 0; i < blockSize; ++i)
+		{
+			input.setSample(0, i, (float)(blockStart + i));
+			input.setSample(1, i, -(float)(blockStart + i));
+		}
+
+		// the next grain starts at 1024 and plays [768, 1024)
+		if (blockStart == 1024)
+			cloud.reset();
+		processBlock(cloud, circularBuffer, input, output, blockStart);
+		if (blockStart < 1024)
+			continue;
+
+		for (int i = 0; i < blockSize; ++i)
+		{
+			const int grainIndex = (int)(blockStart + i - 1024);
+			const float expected = grainIndex < grainSize ? window.getValueAtIndexInPeriod(grainIndex) * (float)(768 + grainIndex) : 0.f;
+			if (output.getSample(0, i) != Catch::Approx(expected).margin(1.0e-2f)
+				|| output.getSample(1, i) != Catch::Approx(-expected).margin(1.0e-2f))
+				mismatchCount++;
+		}
+	}
+	CHECK(mismatchCount == 0);
+	CHECK(cloud.getNumActiveGrains() == 0);
+}
+
+TEST_CASE("GrainCloud jitter stays within its bounds", "[GrainCloud]")
+{
+	constexpr int blockSize = 256;
+	constexpr int grainSize = 4800;
+	constexpr int positionJitter = 480;
+	constexpr float sizeJitter = 0.25f;
+	GrainCloud cloud;
+	cloud.setEmissionRate(200.f);
+	cloud.setGrainSize(100.f);
+	cloud.setPositionJitter(10.f);
+	cloud.setSizeJitter(sizeJitter);
+	cloud.setSeed(1234);
+	cloud.prepare(kSampleRate, blockSize, 2, 150.f, 20.f);
+	REQUIRE(cloud.getGrainSize() == grainSize);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, juce::jmax(kCircularBufferSize, cloud.getRequiredBufferSize()));
+	juce::AudioBuffer<float> input(2, blockSize);
+	juce::AudioBuffer<float> output(2, blockSize);
+	input.clear();
+
+	std::set<int> lengths;
+	std::set<juce::int64> readOffsets;
+	int outOfBoundsCount = 0;
+	for (juce::int64 blockStart = 0; blockStart < 48000; blockStart += blockSize)
+	{
+		processBlock(cloud, circularBuffer, input, output, blockStart);
+
+		// the newest grain was emitted this block
+		const auto& schedule = cloud.getSchedule();
+		const GrainSchedule::Entry& newest = schedule[schedule.size() - 1];
+		const int length = GrainCloudTester::getGrainSize(cloud, newest.grainIndex);
+		const juce::int64 readOffset = newest.synthStart - GrainCloudTester::getReadStart(cloud, newest.grainIndex) - length;
+		lengths.insert(length);
+		readOffsets.insert(readOffset);
+
+		if (length < (int)(grainSize * (1.f - sizeJitter)) || length > (int)(grainSize * (1.f + sizeJitter))
+			|| newest.synthEnd - newest.synthStart + 1 != length || readOffset < 0 || readOffset > positionJitter)
+			outOfBoundsCount++;
+	}
+
+	CHECK(outOfBoundsCount == 0);
+	CHECK(lengths.size() > 1);
+	CHECK((int)lengths.size() <= kNumCloudGrainLengths);
+	CHECK(readOffsets.size() > 1);
+	CHECK(cloud.getNumDroppedGrains() == 0);
+}
+
+TEST_CASE("GrainCloud capacity covers the fastest rate at the longest grains", "[GrainCloud]")
+{
+	constexpr int blockSize = 512;
+	GrainCloud cloud;
+	cloud.setEmissionRate(kMaxEmissionRateHz);
+	cloud.setGrainSize(250.f);
+	cloud.prepare(kSampleRate, blockSize, 2, 250.f, 0.f);
+
+	// hundreds of grains overlapping
+	CHECK(cloud.getGrainCapacity() == GrainCloud::computeGrainCapacity(kSampleRate, blockSize, 12000));
+	CHECK(cloud.getGrainCapacity() > 100);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, cloud.getRequiredBufferSize());
+	juce::AudioBuffer<float> input(2, blockSize);
+	juce::AudioBuffer<float> output(2, blockSize);
+	input.clear();
+
+	int mostActive = 0;
+	for (juce::int64 blockStart = 0; blockStart < 96000; blockStart += blockSize)
+	{
+		processBlock(cloud, circularBuffer, input, output, blockStart);
+		mostActive = juce::jmax(mostActive, cloud.getNumActiveGrains());
+	}
+	CHECK(cloud.getNumDroppedGrains() == 0);
+	CHECK(mostActive >= 100);
+	CHECK(mostActive <= cloud.getGrainCapacity());
+}
+
+/**
+ * A dense regular cloud of a constant signal should come out at the input level, not the number of grains overlapping
+ */
+TEST_CASE("GrainCloud scales dense clouds by their overlap", "[GrainCloud]")
+{
+	constexpr int blockSize = 128;
+	GrainCloud cloud;
+	cloud.setEmissionRate(400.f); // 120 samples apart
+	cloud.setGrainSize(100.f); // 4800 samples, 40 grains overlapping
+	cloud.prepare(kSampleRate, blockSize, 2, 100.f, 0.f);
+	CHECK(cloud.getDensityGain() == Catch::Approx(1.f / 20.f));
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, cloud.getRequiredBufferSize());
+	juce::AudioBuffer<float> input(2, blockSize);
+	juce::AudioBuffer<float> output(2, blockSize);
+	BufferFiller::fillWithValue(input, 0.5f);
+
+	int mismatchCount = 0;
+	for (juce::int64 blockStart = 0; blockStart < 24000; blockStart += blockSize)
+	{
+		processBlock(cloud, circularBuffer, input, output, blockStart);
+
+		// once the source is all signal and the cloud is full
+		if (blockStart < 3 * 4800)
+			continue;
+		for (int i = 0; i < blockSize; ++i)
+		{
+			if (output.getSample(0, i) != Catch::Approx(0.5f).margin(0.02f))
+				mismatchCount++;
+		}
+	}
+	CHECK(mismatchCount == 0);
+}
+
+TEST_CASE("GrainCloud benchmark", "[.benchmark][GrainCloud]")
+{
+	constexpr int blockSize = 128;
+	GrainCloud cloud;
+	cloud.setEmissionRate(400.f);
+	cloud.setGrainSize(100.f);
+	cloud.setPositionJitter(20.f);
+	cloud.setSizeJitter(0.2f);
+	cloud.prepare(kSampleRate, blockSize, 2, 250.f, 50.f);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, cloud.getRequiredBufferSize());
+	juce::AudioBuffer<float> input(2, blockSize);
+	juce::AudioBuffer<float> output(2, blockSize);
+	BufferFiller::generateSineCycles(input, 100);
+
+	// fill the cloud up first
+	juce::int64 blockStart = 0;
+	for (; blockStart < 9600; blockStart += blockSize)
+		processBlock(cloud, circularBuffer, input, output, blockStart);
+
+	CHECK(cloud.getNumDroppedGrains() == 0);
+	CHECK(cloud.getNumActiveGrains() <= cloud.getGrainCapacity());
+
+	BENCHMARK("400 Hz emission, 100 ms grains, one 128 sample stereo block")
+	{
+		processBlock(cloud, circularBuffer, input, output, blockStart);
+		blockStart += blockSize;
+		return output.getSample(0, 0);
+	};
+
+	CHECK(cloud.getNumDroppedGrains() == 0);
+}
@@ -0,0 +1,87 @@
+/**
+ * test_GrainPool.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for the grain sample arena's layout
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include "../SOURCE/GRAIN/GrainPool.h"
+
+//==============================================================================
+// Test Access Class - Provides access to private members for testing
+//==============================================================================
+class GrainPoolTester
+{
+public:
+	static const float* getData(const GrainPool& pool) { return pool.mData; }
+};
+
+namespace
+{
+	constexpr int kPoolGrains = 4;
+	constexpr int kPoolChannels = 2;
+
+	bool isAligned(const float* pointer)
+	{
+		return reinterpret_cast<juce::pointer_sized_uint>(pointer) % GrainPool::kAlignment == 0;
+	}
+}
+
+TEST_CASE("GrainPool lays grains out in aligned lanes", "[GrainPool]")
+{
+	const int maxGrainSize = GENERATE(100, 512, 1602);
+
+	GrainPool pool;
+	pool.prepare(kPoolGrains, kPoolChannels, maxGrainSize);
+	REQUIRE(pool.isAllocated());
+
+	const int stride = pool.getGrainStride();
+	CHECK(stride >= maxGrainSize);
+	CHECK(stride % (GrainPool::kAlignment / (int)sizeof(float)) == 0);
+
+	SECTION("Every grain's slice starts on a cache line")
+	{
+		for (int grain = 0; grain < kPoolGrains; ++grain)
+		{
+			for (int ch = 0; ch < kPoolChannels; ++ch)
+				CHECK(isAligned(pool.getSamples(grain, ch)));
+			CHECK(isAligned(pool.getWindow(grain)));
+		}
+	}
+
+	SECTION("A channel's lane holds every grain back to back, the window lane comes last")
+	{
+		const float* data = GrainPoolTester::getData(pool);
+		for (int grain = 0; grain < kPoolGrains; ++grain)
+		{
+			CHECK(pool.getSamples(grain, 0) == data + grain * stride);
+			CHECK(pool.getSamples(grain, 1) == data + (kPoolGrains + grain) * stride);
+			CHECK(pool.getWindow(grain) == data + (kPoolChannels * kPoolGrains + grain) * stride);
+		}
+	}
+
+	SECTION("Grain buffers are views into the pool")
+	{
+		pool.getSamples(2, 1)[7] = 0.5f;
+
+		const auto grainBuffer = pool.getGrainBuffer(2);
+		CHECK(grainBuffer.getNumChannels() == kPoolChannels);
+		CHECK(grainBuffer.getNumSamples() == maxGrainSize);
+		CHECK(grainBuffer.getReadPointer(0) == pool.getSamples(2, 0));
+		CHECK(grainBuffer.getSample(1, 7) == 0.5f);
+		CHECK(grainBuffer.getSample(0, 7) == 0.f);
+	}
+}
+
+TEST_CASE("GrainPool with no samples allocates nothing", "[GrainPool]")
+{
+	GrainPool pool;
+	pool.prepare(kPoolGrains, kPoolChannels, 512);
+	pool.prepare(kPoolGrains, kPoolChannels, 0);
+
+	CHECK_FALSE(pool.isAllocated());
+	CHECK(pool.getGrainBuffer(0).getNumSamples() == 0);
+	CHECK(pool.getGrainBuffer(0).getNumChannels() == 0);
+}
@@ -0,0 +1,140 @@
+/**
+ * test_GrainSchedule.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for the synth ordered ring of active grains
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+#include "../SOURCE/GRAIN/GrainSchedule.h"
+
+//==============================================================================
+// Test Access Class - Provides access to private members for testing
+//==============================================================================
+class GrainScheduleTester
+{
+public:
+	static int getHead(const GrainSchedule& schedule) { return schedule.mHead; }
+};
+
+namespace
+{
+	constexpr int kCapacity = 6;
+
+	std::vector<int> getGrainOrder(const GrainSchedule& schedule)
+	{
+		std::vector<int> order;
+		for (int i = 0; i < schedule.size(); ++i)
+			order.push_back(schedule[i].grainIndex);
+		return order;
+	}
+}
+
+TEST_CASE("GrainSchedule keeps grains in synth order", "[GrainSchedule]")
+{
+	GrainSchedule schedule;
+	schedule.prepare(kCapacity);
+	REQUIRE(schedule.isEmpty());
+	CHECK(schedule.getCapacity() == kCapacity);
+
+	CHECK(schedule.add(0, 100, 355));
+	CHECK(schedule.add(1, 228, 483));
+	CHECK(schedule.add(2, 50, 305)); // resynced backwards
+	CHECK(schedule.add(3, 228, 400)); // ties stay in the order they were added
+
+	CHECK(getGrainOrder(schedule) == std::vector<int> { 2, 0, 1, 3 });
+	CHECK(schedule[0].synthStart == 50);
+	CHECK(schedule[0].synthEnd == 305);
+
+	SECTION("Full is full")
+	{
+		CHECK(schedule.add(4, 300, 500));
+		CHECK(schedule.add(5, 400, 600));
+		CHECK_FALSE(schedule.add(6, 500, 700));
+		CHECK(schedule.size() == kCapacity);
+	}
+
+	SECTION("clear() empties it")
+	{
+		schedule.clear();
+		CHECK(schedule.isEmpty());
+	}
+}
+
+TEST_CASE("GrainSchedule only visits grains that have started", "[GrainSchedule]")
+{
+	GrainSchedule schedule;
+	schedule.prepare(kCapacity);
+	for (int i = 0; i < 5; ++i)
+		schedule.add(i, i * 100, i * 100 + 199);
+
+	std::vector<int> visited;
+	schedule.processStartedBy(250, [&](const GrainSchedule::Entry& entry)
+	{
+		visited.push_back(entry.grainIndex);
+		return entry.synthEnd > 250; // grain 0 is done
+	});
+
+	CHECK(visited == std::vector<int> { 0, 1, 2 });
+	CHECK(getGrainOrder(schedule) == std::vector<int> { 1, 2, 3, 4 });
+
+	SECTION("Removing from the middle keeps the rest in order")
+	{
+		schedule.processStartedBy(1000, [](const GrainSchedule::Entry& entry)
+		{
+			return entry.grainIndex != 2 && entry.grainIndex != 3;
+		});
+		CHECK(getGrainOrder(schedule) == std::vector<int> { 1, 4 });
+	}
+
+	SECTION("Nothing started visits nothing")
+	{
+		visited.clear();
+		schedule.processStartedBy(50, [&](const GrainSchedule::Entry& entry)
+		{
+			visited.push_back(entry.grainIndex);
+			return false;
+		});
+		CHECK(visited.empty());
+		CHECK(schedule.size() == 4);
+	}
+}
+
+TEST_CASE("GrainSchedule wraps around its ring", "[GrainSchedule]")
+{
+	GrainSchedule schedule;
+	schedule.prepare(kCapacity);
+
+	// a steady train, three alive at a time, far more grains than the ring holds
+	juce::int64 nextStart = 0;
+	int nextGrain = 0;
+	bool headWrapped = false;
+	int previousHead = 0;
+	for (juce::int64 blockStart = 0; blockStart < 5000; blockStart += 64)
+	{
+		const juce::int64 blockEnd = blockStart + 63;
+		while (nextStart <= blockEnd)
+		{
+			REQUIRE(schedule.add(nextGrain++ % kCapacity, nextStart, nextStart + 255));
+			nextStart += 128;
+		}
+
+		juce::int64 previousStart = -1;
+		bool ordered = true;
+		schedule.processStartedBy(blockEnd, [&](const GrainSchedule::Entry& entry)
+		{
+			ordered = ordered && entry.synthStart > previousStart;
+			previousStart = entry.synthStart;
+			return entry.synthEnd > blockEnd;
+		});
+		CHECK(ordered);
+		CHECK(schedule.size() <= 3);
+		headWrapped = headWrapped || GrainScheduleTester::getHead(schedule) < previousHead;
+		previousHead = GrainScheduleTester::getHead(schedule);
+	}
+
+	CHECK(headWrapped);
+	for (int i = 1; i < schedule.size(); ++i)
+		CHECK(schedule[i].synthStart > schedule[i - 1].synthStart);
+}
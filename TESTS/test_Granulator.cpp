@@ -12,6 +12,8 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include "../SOURCE/GRAIN/Granulator.h"
 #include "../SUBMODULES/RD/SOURCE/BufferFiller.h"
 #include "../SUBMODULES/RD/SOURCE/BufferHelper.h"
@@ -1796,3 +1798,1032 @@ TEST_CASE("Granulator grain buffers contain correctly phase-shifted sine waves",
 		}
 	}
 }
+
+//=======================================================================================
+//=======================================================================================
+// GRAIN STORAGE
+//=======================================================================================
+/**
+ * kReference grains don't copy anything, they window the CircularBuffer during overlap-add.
+ * Output has to match kCopy for the same calls, including when grains overlap and shift.
+ */
+TEST_CASE("Granulator kReference grain storage matches kCopy output", "[Granulator][processTracking][grainStorage]")
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr int blockSize = 128;
+	constexpr int circularBufferSize = 4096;
+	constexpr float detectedPeriod = 256.0f;
+	const float shiftedPeriod = GENERATE(256.0f, 200.0f, 320.0f);
+	const int maxGrainSize = static_cast<int>(detectedPeriod * 2);
+
+	Granulator copyGranulator;
+	copyGranulator.prepare(sampleRate, blockSize, maxGrainSize);
+	REQUIRE(copyGranulator.getGrainStorage() == Granulator::GrainStorage::kCopy);
+
+	Granulator referenceGranulator;
+	referenceGranulator.setGrainStorage(Granulator::GrainStorage::kReference);
+	CHECK(referenceGranulator.getGrainStorage() == Granulator::GrainStorage::kCopy); // not until prepare()
+	referenceGranulator.prepare(sampleRate, blockSize, maxGrainSize);
+	REQUIRE(referenceGranulator.getGrainStorage() == Granulator::GrainStorage::kReference);
+
+	// referencing grains own no sample memory
+	for (auto& grain : referenceGranulator.getGrains())
+		CHECK(grain.getBuffer().getNumSamples() == 0);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, circularBufferSize);
+	juce::AudioBuffer<float> sineBuffer(2, circularBufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(detectedPeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+
+	juce::AudioBuffer<float> copyOutput(2, blockSize);
+	juce::AudioBuffer<float> referenceOutput(2, blockSize);
+
+	int mismatchCount = 0;
+	for (juce::int64 call = 0; call < 6; ++call)
+	{
+		const juce::int64 analysisMark = 1000 + call * 256;
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange = {analysisMark - 256, analysisMark, analysisMark + 255};
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisWriteRange = {analysisMark + 536, analysisMark + 792, analysisMark + 1047};
+		std::tuple<juce::int64, juce::int64> processCounterRange = {1536 + call * blockSize, 1663 + call * blockSize};
+
+		copyOutput.clear();
+		referenceOutput.clear();
+		copyGranulator.processTracking(copyOutput, circularBuffer, analysisReadRange, analysisWriteRange,
+									   processCounterRange, detectedPeriod, shiftedPeriod);
+		referenceGranulator.processTracking(referenceOutput, circularBuffer, analysisReadRange, analysisWriteRange,
+											processCounterRange, detectedPeriod, shiftedPeriod);
+
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			for (int i = 0; i < blockSize; ++i)
+			{
+				if (referenceOutput.getSample(ch, i) != Catch::Approx(copyOutput.getSample(ch, i)).margin(1.0e-3f))
+					mismatchCount++;
+			}
+		}
+	}
+
+	INFO("Shifted period: " << shiftedPeriod);
+	CHECK(mismatchCount == 0);
+	CHECK(referenceGranulator.getSynthMark() == copyGranulator.getSynthMark());
+}
+
+/**
+ * kOutputRing adds each grain once, when it's made, into a ring that blocks read their slice out of.
+ * It has to sound the same as overlap-adding active grains block by block, for short blocks under long grains too.
+ */
+TEST_CASE("Granulator kOutputRing synthesis matches kPerBlock output", "[Granulator][processTracking][outputRing]")
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr int circularBufferSize = 4096;
+	constexpr int lookahead = 512;
+	constexpr float detectedPeriod = 256.0f;
+	const int blockSize = GENERATE(32, 128, 480);
+	const float shiftedPeriod = GENERATE(256.0f, 170.0f, 320.0f);
+	const int maxGrainSize = static_cast<int>(detectedPeriod * 2);
+
+	Granulator perBlockGranulator;
+	perBlockGranulator.prepare(sampleRate, blockSize, maxGrainSize, 0, 1.5f);
+
+	Granulator ringGranulator;
+	ringGranulator.setSynthesisEngine(Granulator::SynthesisEngine::kOutputRing);
+	CHECK(ringGranulator.getSynthesisEngine() == Granulator::SynthesisEngine::kPerBlock); // not until prepare()
+	ringGranulator.prepare(sampleRate, blockSize, maxGrainSize, 0, 1.5f);
+	REQUIRE(ringGranulator.getSynthesisEngine() == Granulator::SynthesisEngine::kOutputRing);
+	CHECK(ringGranulator.getOutputRingSize() == blockSize + 2 * maxGrainSize);
+
+	// nothing is kept per grain
+	CHECK_FALSE(ringGranulator.getGrainPool().isAllocated());
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, circularBufferSize);
+	juce::AudioBuffer<float> sineBuffer(2, circularBufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(detectedPeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+
+	juce::AudioBuffer<float> perBlockOutput(2, blockSize);
+	juce::AudioBuffer<float> ringOutput(2, blockSize);
+
+	int mismatchCount = 0;
+	int numGrainSamples = 0;
+	auto compareOutputs = [&]()
+	{
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			for (int i = 0; i < blockSize; ++i)
+			{
+				if (ringOutput.getSample(ch, i) != Catch::Approx(perBlockOutput.getSample(ch, i)).margin(1.0e-3f))
+					mismatchCount++;
+				if (ringOutput.getSample(ch, i) != -1.f)
+					numGrainSamples++;
+			}
+		}
+	};
+
+	// analysis marks a period apart, written out by the end of the block like the processor does.
+	// Grains are only made when there's a new mark, blocks in between just play what's there.
+	juce::int64 analysisMark = 1000;
+	const int numBlocks = 3000 / blockSize;
+	for (int call = 0; call < numBlocks; ++call)
+	{
+		const juce::int64 blockStart = 1536 + (juce::int64)call * blockSize;
+		const juce::int64 blockEnd = blockStart + blockSize - 1;
+		const juce::int64 previousMark = analysisMark;
+		while (analysisMark + lookahead + (juce::int64)detectedPeriod <= blockEnd)
+			analysisMark += (juce::int64)detectedPeriod;
+
+		if (call > 0 && analysisMark == previousMark)
+		{
+			BufferFiller::fillWithValue(perBlockOutput, -1.f);
+			BufferFiller::fillWithValue(ringOutput, -1.f);
+			perBlockGranulator.processActiveGrains(perBlockOutput, {blockStart, blockEnd});
+			ringGranulator.processActiveGrains(ringOutput, {blockStart, blockEnd});
+			compareOutputs();
+			continue;
+		}
+
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange = {analysisMark - 256, analysisMark, analysisMark + 255};
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisWriteRange = {analysisMark + lookahead - 256, analysisMark + lookahead, analysisMark + lookahead + 255};
+		std::tuple<juce::int64, juce::int64> processCounterRange = {blockStart, blockEnd};
+
+		BufferFiller::fillWithValue(perBlockOutput, -1.f);
+		BufferFiller::fillWithValue(ringOutput, -1.f);
+		perBlockGranulator.processTracking(perBlockOutput, circularBuffer, analysisReadRange, analysisWriteRange,
+										   processCounterRange, detectedPeriod, shiftedPeriod);
+		ringGranulator.processTracking(ringOutput, circularBuffer, analysisReadRange, analysisWriteRange,
+									   processCounterRange, detectedPeriod, shiftedPeriod);
+		compareOutputs();
+	}
+
+	// the last grains play out the same way with nothing new being made
+	for (int call = numBlocks; call < numBlocks + 1024 / blockSize + 1; ++call)
+	{
+		const juce::int64 blockStart = 1536 + (juce::int64)call * blockSize;
+		std::tuple<juce::int64, juce::int64> processCounterRange = {blockStart, blockStart + blockSize - 1};
+
+		BufferFiller::fillWithValue(perBlockOutput, -1.f);
+		BufferFiller::fillWithValue(ringOutput, -1.f);
+		perBlockGranulator.processActiveGrains(perBlockOutput, processCounterRange);
+		ringGranulator.processActiveGrains(ringOutput, processCounterRange);
+		compareOutputs();
+	}
+
+	INFO("Block size: " << blockSize << " shifted period: " << shiftedPeriod);
+	CHECK(mismatchCount == 0);
+	CHECK(numGrainSamples > 0);
+	CHECK(ringGranulator.getNumDroppedGrains() == 0);
+	CHECK(perBlockGranulator.getNumDroppedGrains() == 0);
+	CHECK(perBlockGranulator.getNumActiveGrains() == 0);
+	CHECK(ringGranulator.getNumActiveGrains() == 0);
+}
+
+/**
+ * The ring only reaches a grain and a block past the read position. A grain ending further out than that
+ * is dropped, and whatever part of a grain was already played isn't added.
+ */
+TEST_CASE("Granulator kOutputRing drops grains past its horizon", "[Granulator][makeGrain][outputRing]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 256;
+
+	Granulator granulator;
+	granulator.setSynthesisEngine(Granulator::SynthesisEngine::kOutputRing);
+	granulator.prepare(48000.0, blockSize, grainSize);
+	const int ringSize = granulator.getOutputRingSize();
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> valueBuffer(2, 4096);
+	BufferFiller::fillWithValue(valueBuffer, 0.25f);
+	circularBuffer.pushBuffer(valueBuffer);
+
+	juce::AudioBuffer<float> processBuffer(2, blockSize);
+	processBuffer.clear();
+	granulator.processActiveGrains(processBuffer, {0, blockSize - 1});
+
+	// ends on the last sample the ring covers, then one past it
+	granulator.makeGrain(circularBuffer, {0, 128, 255}, {blockSize + ringSize - grainSize, 0, blockSize + ringSize - 1}, 128.0f, 128.0f);
+	CHECK(granulator.getNumDroppedGrains() == 0);
+	granulator.makeGrain(circularBuffer, {0, 128, 255}, {blockSize + ringSize - grainSize + 1, 0, blockSize + ringSize}, 128.0f, 128.0f);
+	CHECK(granulator.getNumDroppedGrains() == 1);
+
+	SECTION("Only the part that hasn't played yet is added")
+	{
+		// started half a block ago, a constant source normalizes back to itself
+		granulator.makeGrain(circularBuffer, {0, 128, 255}, {blockSize - 64, blockSize + 64, blockSize + 191}, 128.0f, 128.0f);
+		BufferFiller::fillWithValue(processBuffer, -1.f);
+		granulator.processActiveGrains(processBuffer, {blockSize, 2 * blockSize - 1});
+
+		int mismatchCount = 0;
+		for (int i = 0; i < blockSize; ++i)
+			if (processBuffer.getSample(0, i) != Catch::Approx(0.25f).margin(1.0e-4f))
+				mismatchCount++;
+		CHECK(mismatchCount == 0);
+	}
+}
+
+/**
+ * prepare() compiles the per block loop for mono or stereo. It has to sound exactly like the generic loop,
+ * and a block with fewer channels than prepare() was given falls back to the generic one.
+ */
+TEST_CASE("Granulator channel specialized loop matches the generic one", "[Granulator][processActiveGrains][channels]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 512;
+	const int numChannels = GENERATE(1, 2);
+	const auto storage = GENERATE(Granulator::GrainStorage::kCopy, Granulator::GrainStorage::kReference);
+	const int numBlockChannels = GENERATE(1, 2);
+
+	Granulator specialized;
+	specialized.setGrainStorage(storage);
+	specialized.prepare(48000.0, blockSize, grainSize, 0, 1.f, numChannels);
+	CHECK(specialized.isChannelSpecialized());
+	CHECK(specialized.getNumChannels() == numChannels);
+	if (storage == Granulator::GrainStorage::kCopy)
+		CHECK(specialized.getGrainPool().getNumChannels() == numChannels);
+
+	Granulator generic;
+	generic.setGrainStorage(storage);
+	generic.setChannelSpecialization(false);
+	generic.prepare(48000.0, blockSize, grainSize, 0, 1.f, numChannels);
+	CHECK_FALSE(generic.isChannelSpecialized());
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> sineBuffer(2, 4096);
+	BufferFiller::generateSineCycles(sineBuffer, 256);
+	circularBuffer.pushBuffer(sineBuffer);
+
+	for (juce::int64 i = 0; i < 3; ++i)
+	{
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange = {i * 200, i * 200 + 256, i * 200 + 511};
+		std::tuple<juce::int64, juce::int64, juce::int64> synthRange = {1000 + i * 200, 1256 + i * 200, 1511 + i * 200};
+		specialized.makeGrain(circularBuffer, analysisReadRange, synthRange, 256.0f, 256.0f);
+		generic.makeGrain(circularBuffer, analysisReadRange, synthRange, 256.0f, 256.0f);
+	}
+
+	juce::AudioBuffer<float> specializedOutput(numBlockChannels, blockSize);
+	juce::AudioBuffer<float> genericOutput(numBlockChannels, blockSize);
+	int mismatchCount = 0;
+	for (juce::int64 blockStart = 1000; blockStart < 2000; blockStart += blockSize)
+	{
+		BufferFiller::fillWithValue(specializedOutput, -1.f);
+		BufferFiller::fillWithValue(genericOutput, -1.f);
+		specialized.processActiveGrains(specializedOutput, {blockStart, blockStart + blockSize - 1});
+		generic.processActiveGrains(genericOutput, {blockStart, blockStart + blockSize - 1});
+
+		for (int ch = 0; ch < numBlockChannels; ++ch)
+			for (int i = 0; i < blockSize; ++i)
+				if (specializedOutput.getSample(ch, i) != genericOutput.getSample(ch, i))
+					mismatchCount++;
+	}
+
+	INFO("Granulator channels: " << numChannels << " block channels: " << numBlockChannels);
+	CHECK(mismatchCount == 0);
+	CHECK(specialized.getNumActiveGrains() == 0);
+}
+
+/**
+ * Grains of a length we've already seen take their window from the cache instead of generating it.
+ */
+TEST_CASE("Granulator makeGrain() generates each window length once", "[Granulator][makeGrain][windowCache]")
+{
+	constexpr int grainSize = 512;
+
+	Granulator granulator;
+	granulator.prepare(48000.0, 128, grainSize);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> onesBuffer(2, 4096);
+	BufferFiller::fillWithAllOnes(onesBuffer);
+	circularBuffer.pushBuffer(onesBuffer);
+
+	for (juce::int64 i = 0; i < kNumGrains; ++i)
+	{
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange = {i * 256, i * 256 + 256, i * 256 + 511};
+		std::tuple<juce::int64, juce::int64, juce::int64> synthRange = {2000 + i * 256, 2256 + i * 256, 2511 + i * 256};
+		granulator.makeGrain(circularBuffer, analysisReadRange, synthRange, 256.0f, 256.0f);
+	}
+
+	CHECK(granulator.getWindowCache().getNumFills() == 1);
+	REQUIRE(granulator.getNumActiveGrains() == kNumGrains);
+
+	// all ones in, so every grain is exactly the window
+	for (const auto& grain : granulator.getGrains())
+	{
+		if (!grain.isActive)
+			continue; // capacity can be more than we made
+		for (int i = 0; i < grainSize; i += 37)
+			CHECK(grain.getBuffer().getSample(0, i) == Catch::Approx(granulator.getWindow().getValueAtIndexInPeriod(i)).margin(0.001f));
+	}
+}
+
+/**
+ * Grain samples live in the Granulator's pool, sized by prepare()'s maxGrainSize.
+ * Anything longer than that is dropped instead of overrunning its slice.
+ */
+TEST_CASE("Granulator grains live in the grain pool", "[Granulator][makeGrain][grainPool]")
+{
+	constexpr int maxGrainSize = 512;
+
+	Granulator granulator;
+	granulator.prepare(48000.0, 128, maxGrainSize);
+
+	const GrainPool& pool = granulator.getGrainPool();
+	REQUIRE(pool.getNumGrains() == granulator.getGrainCapacity());
+	CHECK(pool.getMaxGrainSize() == maxGrainSize);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> onesBuffer(2, 4096);
+	BufferFiller::fillWithAllOnes(onesBuffer);
+	circularBuffer.pushBuffer(onesBuffer);
+
+	SECTION("A grain's buffer is its slice of the pool")
+	{
+		granulator.makeGrain(circularBuffer, {0, 256, 511}, {2000, 2256, 2511}, 256.0f, 256.0f);
+		const auto& grains = granulator.getGrains();
+		REQUIRE(grains[0].isActive);
+
+		const auto grainBuffer = grains[0].getBuffer();
+		CHECK(grainBuffer.getNumSamples() == maxGrainSize);
+		CHECK(grainBuffer.getReadPointer(0) == pool.getSamples(0, 0));
+		CHECK(grainBuffer.getReadPointer(1) == pool.getSamples(0, 1));
+	}
+
+	SECTION("A shorter grain's buffer ends where the grain does")
+	{
+		granulator.makeGrain(circularBuffer, {0, 128, 255}, {2000, 2128, 2255}, 128.0f, 128.0f);
+		const auto& grains = granulator.getGrains();
+		REQUIRE(grains[0].isActive);
+
+		const auto grainBuffer = grains[0].getBuffer();
+		CHECK(grainBuffer.getNumSamples() == 256);
+		CHECK(grainBuffer.getReadPointer(0) == pool.getSamples(0, 0));
+	}
+
+	SECTION("Grains longer than maxGrainSize are dropped")
+	{
+		granulator.makeGrain(circularBuffer, {0, 300, 599}, {2000, 2300, 2599}, 300.0f, 300.0f);
+		for (const auto& grain : granulator.getGrains())
+			CHECK_FALSE(grain.isActive);
+	}
+}
+
+/**
+ * Capacity comes from prepare()'s shortest period and largest shift ratio. Grains go back on
+ * the free list when they finish, and any makeGrain() can't fit is counted.
+ */
+TEST_CASE("Granulator grain capacity and free list", "[Granulator][makeGrain][grainCapacity]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 512;
+
+	SECTION("Capacity grows with the shift ratio and shrinks with the period")
+	{
+		CHECK(Granulator::computeGrainCapacity(blockSize, 256, 1.f) == kNumGrains + 1);
+		CHECK(Granulator::computeGrainCapacity(blockSize, 256, 1.5f) > Granulator::computeGrainCapacity(blockSize, 256, 1.f));
+		CHECK(Granulator::computeGrainCapacity(blockSize, 32, 1.5f) > Granulator::computeGrainCapacity(blockSize, 256, 1.5f));
+		CHECK(Granulator::computeGrainCapacity(blockSize, 4096, 0.5f) == Granulator::computeGrainCapacity(blockSize, 4096, 1.f));
+	}
+
+	Granulator granulator;
+	granulator.prepare(48000.0, blockSize, grainSize, 256, 1.5f);
+	const int capacity = granulator.getGrainCapacity();
+	REQUIRE(capacity == Granulator::computeGrainCapacity(blockSize, 256, 1.5f));
+	REQUIRE(static_cast<int>(granulator.getGrains().size()) == capacity);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> onesBuffer(2, 4096);
+	BufferFiller::fillWithAllOnes(onesBuffer);
+	circularBuffer.pushBuffer(onesBuffer);
+
+	// one more grain than there's room for, all overlapping
+	for (int i = 0; i <= capacity; ++i)
+		granulator.makeGrain(circularBuffer, {0, 256, 511}, {1000, 1256, 1511}, 256.0f, 170.0f);
+
+	CHECK(granulator.getNumActiveGrains() == capacity);
+	CHECK(granulator.getNumDroppedGrains() == 1);
+
+	SECTION("Finished grains are reused")
+	{
+		juce::AudioBuffer<float> processBuffer(2, blockSize);
+		processBuffer.clear();
+		granulator.processActiveGrains(processBuffer, {1500, 1500 + blockSize - 1});
+		CHECK(granulator.getNumActiveGrains() == 0);
+		for (const auto& grain : granulator.getGrains())
+			CHECK_FALSE(grain.isActive);
+
+		granulator.makeGrain(circularBuffer, {0, 256, 511}, {2000, 2256, 2511}, 256.0f, 170.0f);
+		CHECK(granulator.getNumActiveGrains() == 1);
+		CHECK(granulator.getNumDroppedGrains() == 1);
+	}
+
+	SECTION("prepare() resets the count")
+	{
+		granulator.prepare(48000.0, blockSize, grainSize, 256, 1.5f);
+		CHECK(granulator.getNumDroppedGrains() == 0);
+		CHECK(granulator.getNumActiveGrains() == 0);
+	}
+}
+
+/**
+ * Shifting up makes several grains from one analysis range. They share one windowed copy in the pool,
+ * only a new range (or length) is extracted again, and the slice is freed once its last grain finishes.
+ */
+TEST_CASE("Granulator grains from the same analysis range share their source", "[Granulator][makeGrain][grainPool]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 512;
+
+	Granulator granulator;
+	granulator.prepare(48000.0, blockSize, grainSize, 256, 1.5f);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> incrementalBuffer(2, 4096);
+	BufferFiller::fillIncremental(incrementalBuffer);
+	circularBuffer.pushBuffer(incrementalBuffer);
+
+	granulator.makeGrain(circularBuffer, {0, 256, 511}, {1000, 1256, 1511}, 256.0f, 170.0f);
+	granulator.makeGrain(circularBuffer, {0, 256, 511}, {1170, 1426, 1681}, 256.0f, 170.0f);
+	granulator.makeGrain(circularBuffer, {0, 256, 511}, {1340, 1596, 1851}, 256.0f, 170.0f);
+
+	REQUIRE(granulator.getNumActiveGrains() == 3);
+	CHECK(granulator.getNumSourceFills() == 1);
+	CHECK(granulator.getNumSourcesInUse() == 1);
+
+	const float* sharedSamples = nullptr;
+	for (const auto& grain : granulator.getGrains())
+	{
+		if (!grain.isActive)
+			continue;
+		if (sharedSamples == nullptr)
+			sharedSamples = grain.getBuffer().getReadPointer(0);
+		CHECK(grain.getBuffer().getReadPointer(0) == sharedSamples);
+	}
+
+	SECTION("A new range gets its own copy")
+	{
+		granulator.makeGrain(circularBuffer, {256, 512, 767}, {1510, 1766, 2021}, 256.0f, 170.0f);
+		CHECK(granulator.getNumSourceFills() == 2);
+		CHECK(granulator.getNumSourcesInUse() == 2);
+
+		// windowed copy of its own range, the middle of a Hanning window is 1
+		const auto& grains = granulator.getGrains();
+		for (const auto& grain : grains)
+		{
+			if (grain.isActive && std::get<0>(grain.mAnalysisRange) == 256)
+				CHECK(grain.getBuffer().getSample(0, 256) == Catch::Approx(512.f).margin(0.5f));
+		}
+	}
+
+	SECTION("The slice stays held until its last grain finishes")
+	{
+		juce::AudioBuffer<float> processBuffer(2, blockSize);
+		processBuffer.clear();
+
+		// first two grains finish, the third one still plays the shared slice
+		granulator.processActiveGrains(processBuffer, {1600, 1600 + blockSize - 1});
+		REQUIRE(granulator.getNumActiveGrains() == 1);
+		CHECK(granulator.getNumSourcesInUse() == 1);
+
+		granulator.processActiveGrains(processBuffer, {1800, 1800 + blockSize - 1});
+		CHECK(granulator.getNumActiveGrains() == 0);
+		CHECK(granulator.getNumSourcesInUse() == 0);
+	}
+}
+
+/**
+ * Harmony voices place their own grains from the same analysis ranges. Each one has to sound like a granulator
+ * running it alone, mixed with its gain, and the windowed sources are only extracted once for all of them.
+ */
+TEST_CASE("Granulator harmony voices mix independently normalized voices", "[Granulator][processTracking][voices]")
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr int blockSize = 256;
+	constexpr int circularBufferSize = 4096;
+	constexpr float detectedPeriod = 256.0f;
+	constexpr int numVoices = 3;
+	const std::array<float, numVoices> shiftRatios { 1.f, 1.25f, 0.75f };
+	const std::array<float, numVoices> gains { 1.f, 0.5f, 0.25f };
+	const auto storage = GENERATE(Granulator::GrainStorage::kCopy, Granulator::GrainStorage::kReference);
+	const int maxGrainSize = static_cast<int>(detectedPeriod * 2);
+
+	Granulator harmonyGranulator;
+	harmonyGranulator.setGrainStorage(storage);
+	harmonyGranulator.prepare(sampleRate, blockSize, maxGrainSize, 0, 1.5f, 2, numVoices);
+	REQUIRE(harmonyGranulator.getMaxNumVoices() == numVoices);
+	harmonyGranulator.setNumVoices(numVoices + 1); // no room for a fourth
+	REQUIRE(harmonyGranulator.getNumVoices() == numVoices);
+	for (int voice = 0; voice < numVoices; ++voice)
+		harmonyGranulator.setVoice(voice, shiftRatios[(size_t)voice], gains[(size_t)voice]);
+
+	// each voice on its own
+	std::array<Granulator, numVoices> voiceGranulators;
+	for (auto& granulator : voiceGranulators)
+	{
+		granulator.setGrainStorage(storage);
+		granulator.prepare(sampleRate, blockSize, maxGrainSize, 0, 1.5f);
+	}
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, circularBufferSize);
+	juce::AudioBuffer<float> sineBuffer(2, circularBufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(detectedPeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+
+	juce::AudioBuffer<float> harmonyOutput(2, blockSize);
+	juce::AudioBuffer<float> voiceOutput(2, blockSize);
+	juce::AudioBuffer<float> expectedOutput(2, blockSize);
+
+	int mismatchCount = 0;
+	int numCoveredSamples = 0;
+	for (juce::int64 call = 0; call < 8; ++call)
+	{
+		const juce::int64 analysisMark = 1000 + call * 256;
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange = {analysisMark - 256, analysisMark, analysisMark + 255};
+		std::tuple<juce::int64, juce::int64, juce::int64> analysisWriteRange = {analysisMark + 536, analysisMark + 792, analysisMark + 1047};
+		std::tuple<juce::int64, juce::int64> processCounterRange = {1536 + call * blockSize, 1535 + (call + 1) * blockSize};
+
+		// uncovered samples are left alone, the mix is only written where some voice played
+		BufferFiller::fillWithValue(harmonyOutput, -1.f);
+		harmonyGranulator.processTracking(harmonyOutput, circularBuffer, analysisReadRange, analysisWriteRange,
+										  processCounterRange, detectedPeriod, detectedPeriod / shiftRatios[0]);
+
+		expectedOutput.clear();
+		juce::AudioBuffer<float> coverage(1, blockSize);
+		coverage.clear();
+		for (int voice = 0; voice < numVoices; ++voice)
+		{
+			BufferFiller::fillWithValue(voiceOutput, 2.f); // no grain ever writes 2 out of a unit sine
+			voiceGranulators[(size_t)voice].processTracking(voiceOutput, circularBuffer, analysisReadRange, analysisWriteRange,
+															processCounterRange, detectedPeriod, detectedPeriod / shiftRatios[(size_t)voice]);
+			for (int i = 0; i < blockSize; ++i)
+			{
+				if (voiceOutput.getSample(0, i) == 2.f)
+					continue;
+				coverage.setSample(0, i, 1.f);
+				for (int ch = 0; ch < 2; ++ch)
+					expectedOutput.addSample(ch, i, gains[(size_t)voice] * voiceOutput.getSample(ch, i));
+			}
+		}
+
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			for (int i = 0; i < blockSize; ++i)
+			{
+				const float expected = coverage.getSample(0, i) > 0.f ? expectedOutput.getSample(ch, i) : -1.f;
+				if (harmonyOutput.getSample(ch, i) != Catch::Approx(expected).margin(1.0e-3f))
+					mismatchCount++;
+				if (coverage.getSample(0, i) > 0.f)
+					numCoveredSamples++;
+			}
+		}
+	}
+
+	INFO("Storage: " << (int)storage);
+	CHECK(mismatchCount == 0);
+	CHECK(numCoveredSamples > 0);
+	CHECK(harmonyGranulator.getNumDroppedGrains() == 0);
+	for (int voice = 0; voice < numVoices; ++voice)
+		CHECK(harmonyGranulator.getVoiceSynthMark(voice) == voiceGranulators[(size_t)voice].getSynthMark());
+
+	// the harmonies play the main voice's windowed sources, nothing more is copied for them
+	CHECK(harmonyGranulator.getNumSourceFills() == voiceGranulators[0].getNumSourceFills());
+
+	SECTION("A voice switched off lets its grains run out unheard and starts over when it's back")
+	{
+		harmonyGranulator.setNumVoices(1);
+		voiceGranulators[0].resetNumDroppedGrains();
+
+		BufferFiller::fillWithValue(harmonyOutput, -1.f);
+		BufferFiller::fillWithValue(voiceOutput, -1.f);
+		const juce::int64 blockStart = 1536 + 8 * blockSize;
+		std::tuple<juce::int64, juce::int64> processCounterRange = {blockStart, blockStart + blockSize - 1};
+		harmonyGranulator.processActiveGrains(harmonyOutput, processCounterRange);
+		voiceGranulators[0].processActiveGrains(voiceOutput, processCounterRange);
+
+		int soloMismatchCount = 0;
+		for (int ch = 0; ch < 2; ++ch)
+		{
+			for (int i = 0; i < blockSize; ++i)
+			{
+				if (harmonyOutput.getSample(ch, i) != Catch::Approx(voiceOutput.getSample(ch, i)).margin(1.0e-5f))
+					soloMismatchCount++;
+			}
+		}
+		CHECK(soloMismatchCount == 0);
+
+		harmonyGranulator.processTracking(harmonyOutput, circularBuffer, {2792, 3048, 3303}, {3328, 3584, 3839},
+										  {blockStart + blockSize, blockStart + 2 * blockSize - 1}, detectedPeriod, detectedPeriod);
+		CHECK(harmonyGranulator.getVoiceSynthMark(1) == -1);
+	}
+}
+
+/**
+ * Normalization multiplies by one shared reciprocal of the window sum. Samples no grain
+ * covers have nothing to normalize and keep whatever processBlock already held.
+ */
+TEST_CASE("Granulator processActiveGrains() normalizes covered samples only", "[Granulator][processActiveGrains]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 128;
+
+	Granulator granulator;
+	granulator.prepare(48000.0, blockSize, grainSize);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 1024);
+	juce::AudioBuffer<float> valueBuffer(2, 1024);
+	BufferFiller::fillWithValue(valueBuffer, 0.25f);
+	circularBuffer.pushBuffer(valueBuffer);
+
+	// Hanning grain covering the second half of the block
+	granulator.makeGrain(circularBuffer, {0, 64, 127}, {64, 128, 191}, 64.0f, 64.0f);
+
+	juce::AudioBuffer<float> processBuffer(2, blockSize);
+	BufferFiller::fillWithValue(processBuffer, -1.f);
+	granulator.processActiveGrains(processBuffer, {0, blockSize - 1});
+
+	for (int ch = 0; ch < 2; ++ch)
+	{
+		for (int i = 0; i < 64; ++i)
+			CHECK(processBuffer.getSample(ch, i) == -1.f);
+
+		// the window's first sample may be 0, that one is left alone too
+		for (int i = 65; i < blockSize; ++i)
+			CHECK(processBuffer.getSample(ch, i) == Catch::Approx(0.25f).margin(1.0e-4f));
+	}
+}
+
+/**
+ * @brief Prepares the granulator and fills the circular buffer with a 256 sample period sine, then makes
+ * numGrains grains staggered 8 samples apart that all cover the block starting at blockStart and none
+ * finish in it. Shared setup for the processActiveGrains() benchmarks.
+ */
+static void prepareStaggeredBenchmarkGrains(Granulator& granulator, CircularBuffer& circularBuffer, int numChannels,
+											int numGrains, int grainSize, int blockSize, juce::int64 blockStart)
+{
+	constexpr int numStoredSamples = 8192;
+
+	granulator.prepare(48000.0, blockSize, grainSize, 8, 1.5f, numChannels);
+	REQUIRE(granulator.getGrainCapacity() >= numGrains);
+
+	circularBuffer.setSize(numChannels, numStoredSamples);
+	juce::AudioBuffer<float> sineBuffer(numChannels, numStoredSamples);
+	BufferFiller::generateSineCycles(sineBuffer, 256);
+	circularBuffer.pushBuffer(sineBuffer);
+
+	for (int i = 0; i < numGrains; ++i)
+	{
+		const juce::int64 synthStart = blockStart - grainSize + blockSize + 1 + i * 8;
+		const juce::int64 readStart = (juce::int64)i * 64;
+		granulator.makeGrain(circularBuffer, {readStart, readStart + grainSize / 2, readStart + grainSize - 1},
+							 {synthStart, synthStart + grainSize / 2, synthStart + grainSize - 1}, grainSize / 2, grainSize / 2);
+	}
+	REQUIRE(granulator.getNumActiveGrains() == numGrains);
+}
+
+/**
+ * Overlap-add cost as the number of active grains grows. Grains are 1024 samples, staggered
+ * so they all cover the block without any finishing in it. Run with "[.benchmark]".
+ */
+TEST_CASE("Granulator processActiveGrains() benchmark", "[Granulator][processActiveGrains][.benchmark]")
+{
+	constexpr int blockSize = 512;
+	constexpr int grainSize = 1024;
+
+	const auto storage = GENERATE(Granulator::GrainStorage::kCopy, Granulator::GrainStorage::kReference);
+	const int numGrains = GENERATE(4, 8, 16, 32, 64);
+
+	Granulator granulator;
+	granulator.setGrainStorage(storage);
+	CircularBuffer circularBuffer;
+	constexpr juce::int64 blockStart = 4096;
+	prepareStaggeredBenchmarkGrains(granulator, circularBuffer, 2, numGrains, grainSize, blockSize, blockStart);
+
+	juce::AudioBuffer<float> processBuffer(2, blockSize);
+	const std::string name = std::string(storage == Granulator::GrainStorage::kCopy ? "kCopy" : "kReference")
+						   + ", " + std::to_string(numGrains) + " grains";
+
+	BENCHMARK(std::string(name))
+	{
+		processBuffer.clear();
+		granulator.processActiveGrains(processBuffer, {blockStart, blockStart + blockSize - 1});
+		return processBuffer.getSample(0, 0);
+	};
+
+	CHECK(granulator.getNumActiveGrains() == numGrains);
+}
+
+TEST_CASE("Granulator channel specialization benchmark", "[Granulator][processActiveGrains][channels][.benchmark]")
+{
+	constexpr int blockSize = 128;
+	constexpr int grainSize = 1024;
+	constexpr int numGrains = 16;
+
+	const int numChannels = GENERATE(1, 2);
+	const bool shouldSpecialize = GENERATE(true, false);
+
+	Granulator granulator;
+	granulator.setChannelSpecialization(shouldSpecialize);
+	CircularBuffer circularBuffer;
+	constexpr juce::int64 blockStart = 4096;
+	prepareStaggeredBenchmarkGrains(granulator, circularBuffer, numChannels, numGrains, grainSize, blockSize, blockStart);
+
+	juce::AudioBuffer<float> processBuffer(numChannels, blockSize);
+	const std::string name = std::string(numChannels == 1 ? "mono" : "stereo") + (shouldSpecialize ? ", specialized" : ", generic");
+
+	BENCHMARK(std::string(name))
+	{
+		processBuffer.clear();
+		granulator.processActiveGrains(processBuffer, {blockStart, blockStart + blockSize - 1});
+		return processBuffer.getSample(0, 0);
+	};
+
+	CHECK(granulator.getNumActiveGrains() == numGrains);
+}
+
+/**
+ * A constant synth hop with one grain length normalizes from a table made once, and has to
+ * come out the same as accumulating the windows. A missing grain falls back to accumulating.
+ */
+TEST_CASE("Granulator steady state normalization matches the accumulated window sum", "[Granulator][processActiveGrains][steadyStateNorm]")
+{
+	constexpr int blockSize = 128;
+	constexpr float detectedPeriod = 256.0f;
+	constexpr int grainSize = 512;
+	constexpr int numBlocks = 40;
+
+	const auto storage = GENERATE(Granulator::GrainStorage::kCopy, Granulator::GrainStorage::kReference);
+	const int hop = GENERATE(256, 192, 320, 170);
+
+	Granulator steady, accumulated;
+	for (auto* granulator : { &steady, &accumulated })
+	{
+		granulator->setGrainStorage(storage);
+		granulator->prepare(48000.0, blockSize, grainSize, 128, 1.5f);
+	}
+	accumulated.setSteadyStateNormalization(false);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 8192);
+	juce::AudioBuffer<float> sineBuffer(2, 8192);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(detectedPeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+
+	juce::AudioBuffer<float> steadyBuffer(2, blockSize), accumulatedBuffer(2, blockSize);
+	juce::int64 nextSynthStart = 0;
+	int steadyBlocks = 0;
+	int mismatchCount = 0;
+
+	for (int block = 0; block < numBlocks; ++block)
+	{
+		const juce::int64 blockStart = (juce::int64)block * blockSize;
+		const juce::int64 blockEnd = blockStart + blockSize - 1;
+
+		// grains are made before the block they start in, like processTracking() does
+		for (; nextSynthStart <= blockEnd; nextSynthStart += hop)
+		{
+			const std::tuple<juce::int64, juce::int64, juce::int64> analysisRange = {1024, 1280, 1535};
+			const std::tuple<juce::int64, juce::int64, juce::int64> synthRange = {nextSynthStart, nextSynthStart + 256, nextSynthStart + grainSize - 1};
+			steady.makeGrain(circularBuffer, analysisRange, synthRange, detectedPeriod, detectedPeriod);
+			accumulated.makeGrain(circularBuffer, analysisRange, synthRange, detectedPeriod, detectedPeriod);
+		}
+
+		steadyBuffer.clear();
+		accumulatedBuffer.clear();
+		steady.processActiveGrains(steadyBuffer, {blockStart, blockEnd});
+		accumulated.processActiveGrains(accumulatedBuffer, {blockStart, blockEnd});
+
+		if (steady.usedSteadyStateNormalizationLastBlock())
+			steadyBlocks++;
+		CHECK_FALSE(accumulated.usedSteadyStateNormalizationLastBlock());
+
+		for (int ch = 0; ch < 2; ++ch)
+			for (int i = 0; i < blockSize; ++i)
+				if (steadyBuffer.getSample(ch, i) != Catch::Approx(accumulatedBuffer.getSample(ch, i)).margin(1.0e-5f))
+					mismatchCount++;
+	}
+
+	INFO("Hop: " << hop);
+	CHECK(mismatchCount == 0);
+	// the first grain has nothing before it, after that every block is regular
+	CHECK(steadyBlocks >= numBlocks - grainSize / blockSize - 1);
+	CHECK(steady.getNumNormTableFills() == 1);
+	CHECK(steady.getNumDroppedGrains() == 0);
+
+	SECTION("A missing grain falls back to accumulating")
+	{
+		// the grain starting here was never made
+		const juce::int64 blockStart = nextSynthStart;
+
+		steadyBuffer.clear();
+		accumulatedBuffer.clear();
+		steady.processActiveGrains(steadyBuffer, {blockStart, blockStart + blockSize - 1});
+		accumulated.processActiveGrains(accumulatedBuffer, {blockStart, blockStart + blockSize - 1});
+
+		CHECK_FALSE(steady.usedSteadyStateNormalizationLastBlock());
+		for (int i = 0; i < blockSize; ++i)
+			CHECK(steadyBuffer.getSample(0, i) == Catch::Approx(accumulatedBuffer.getSample(0, i)).margin(1.0e-5f));
+	}
+}
+
+/**
+ * A formant factor of exactly 1 has to be the granulator without formant shifting: nothing resampled,
+ * kReference grains still read straight out of the CircularBuffer.
+ */
+TEST_CASE("Granulator formant factor of 1 doesn't resample", "[Granulator][makeGrain][formant]")
+{
+	constexpr int blockSize = 128;
+	constexpr float detectedPeriod = 256.0f;
+	constexpr int maxGrainSize = 512;
+	const auto storage = GENERATE(Granulator::GrainStorage::kCopy, Granulator::GrainStorage::kReference);
+
+	Granulator plain, shifting;
+	shifting.setFormantShifting(true);
+	CHECK_FALSE(shifting.isFormantShifting()); // not until prepare()
+	for (auto* granulator : { &plain, &shifting })
+	{
+		granulator->setGrainStorage(storage);
+		granulator->prepare(48000.0, blockSize, maxGrainSize, 128, 1.5f);
+	}
+	REQUIRE(shifting.isFormantShifting());
+	shifting.setFormantFactor(1.f);
+
+	// room for grains stretched to twice their length
+	CHECK(shifting.getGrainPool().getMaxGrainSize() == 2 * maxGrainSize);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> sineBuffer(2, 4096);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(detectedPeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+
+	juce::AudioBuffer<float> plainBuffer(2, blockSize), shiftingBuffer(2, blockSize);
+	int mismatchCount = 0;
+	for (juce::int64 call = 0; call < 6; ++call)
+	{
+		const juce::int64 analysisMark = 1000 + call * 256;
+		const std::tuple<juce::int64, juce::int64, juce::int64> analysisReadRange = {analysisMark - 256, analysisMark, analysisMark + 255};
+		const std::tuple<juce::int64, juce::int64, juce::int64> analysisWriteRange = {analysisMark + 536, analysisMark + 792, analysisMark + 1047};
+		const std::tuple<juce::int64, juce::int64> processCounterRange = {1536 + call * blockSize, 1663 + call * blockSize};
+
+		plainBuffer.clear();
+		shiftingBuffer.clear();
+		plain.processTracking(plainBuffer, circularBuffer, analysisReadRange, analysisWriteRange, processCounterRange, detectedPeriod, 200.f);
+		shifting.processTracking(shiftingBuffer, circularBuffer, analysisReadRange, analysisWriteRange, processCounterRange, detectedPeriod, 200.f);
+
+		if (storage == Granulator::GrainStorage::kReference)
+			CHECK(shifting.getNumSourcesInUse() == 0);
+
+		for (int ch = 0; ch < 2; ++ch)
+			for (int i = 0; i < blockSize; ++i)
+				if (shiftingBuffer.getSample(ch, i) != plainBuffer.getSample(ch, i))
+					mismatchCount++;
+	}
+
+	CHECK(mismatchCount == 0);
+	CHECK(shifting.getNumResampledGrains() == 0);
+	CHECK(shifting.getNumDroppedGrains() == 0);
+}
+
+/**
+ * A formant shifted grain is its windowed source resampled to 2 * period / factor samples, centered on the same
+ * synth mark. Played alone, normalizing by its window leaves the source read factor times as fast around the mark.
+ */
+TEST_CASE("Granulator formant shift resamples each grain around its synth mark", "[Granulator][makeGrain][formant]")
+{
+	constexpr int blockSize = 128;
+	constexpr float detectedPeriod = 256.0f;
+	constexpr int maxGrainSize = 512;
+	constexpr double sinePeriod = 64.0;
+	const auto storage = GENERATE(Granulator::GrainStorage::kCopy, Granulator::GrainStorage::kReference);
+	const float formantFactor = GENERATE(0.8f, 1.25f, 2.f);
+	CAPTURE(formantFactor);
+
+	Granulator granulator;
+	granulator.setGrainStorage(storage);
+	granulator.setFormantShifting(true);
+	granulator.prepare(48000.0, blockSize, maxGrainSize, 128, 1.5f);
+	granulator.setFormantFactor(formantFactor);
+	// rounded down to a tabled cutoff
+	const float cutoff = granulator.getResampler().getCutoff();
+	CHECK(cutoff <= juce::jmin(1.f, 1.f / formantFactor));
+	CHECK(cutoff > juce::jmin(1.f, 1.f / formantFactor) - PolyphaseResampler::kCutoffStep);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 4096);
+	juce::AudioBuffer<float> sineBuffer(2, 4096);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(sinePeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+
+	// the same range twice only resamples it once
+	constexpr juce::int64 analysisMark = 1000;
+	constexpr juce::int64 synthMark = 3000;
+	granulator.makeGrain(circularBuffer, {analysisMark - 256, analysisMark, analysisMark + 255}, {synthMark - 256, synthMark, synthMark + 255}, detectedPeriod, detectedPeriod);
+	granulator.makeGrain(circularBuffer, {analysisMark - 256, analysisMark, analysisMark + 255}, {synthMark + 2000, synthMark + 2256, synthMark + 2511}, detectedPeriod, detectedPeriod);
+	CHECK(granulator.getNumResampledGrains() == 1);
+	CHECK(granulator.getNumSourcesInUse() == 1);
+
+	const int grainSize = juce::roundToInt((float)maxGrainSize / formantFactor);
+	REQUIRE(granulator.getNumActiveGrains() == 2);
+	const GrainSchedule::Entry& entry = granulator.getSchedule()[0];
+	CHECK(entry.synthStart == synthMark - grainSize / 2);
+	CHECK(entry.synthEnd - entry.synthStart + 1 == grainSize);
+
+	juce::AudioBuffer<float> processBuffer(2, blockSize);
+	const double step = (double)(maxGrainSize - 1) / (double)(grainSize - 1);
+	int numChecked = 0;
+	int mismatchCount = 0;
+	for (juce::int64 blockStart = entry.synthStart / blockSize * blockSize; blockStart <= entry.synthEnd; blockStart += blockSize)
+	{
+		processBuffer.clear();
+		granulator.processActiveGrains(processBuffer, {blockStart, blockStart + blockSize - 1});
+
+		// the middle half, where the window isn't small enough for the difference between the resampled
+		// window and the one it's normalized by to matter
+		for (int i = 0; i < blockSize; ++i)
+		{
+			const juce::int64 grainIndex = blockStart + i - entry.synthStart;
+			if (grainIndex < grainSize / 4 || grainIndex >= grainSize - grainSize / 4)
+				continue;
+
+			const double sourcePosition = (double)(analysisMark - 256) + (double)grainIndex * step;
+			const float expected = (float)std::sin(2.0 * M_PI * sourcePosition / sinePeriod);
+			for (int ch = 0; ch < 2; ++ch)
+				if (processBuffer.getSample(ch, i) != Catch::Approx(expected).margin(0.02f))
+					mismatchCount++;
+			numChecked++;
+		}
+	}
+	CHECK(numChecked == grainSize - 2 * (grainSize / 4));
+	CHECK(mismatchCount == 0);
+	CHECK(granulator.getNumDroppedGrains() == 0);
+}
+
+/**
+ * The formant factor is handed over every block, so moving it can only select a resampler table.
+ * They're all built in prepare(), and only when formant shifting is on.
+ */
+TEST_CASE("Granulator formant automation doesn't build resampler tables", "[Granulator][formant]")
+{
+	Granulator plain, shifting;
+	shifting.setFormantShifting(true);
+	plain.prepare(48000.0, 128, 512, 128, 1.5f);
+	shifting.prepare(48000.0, 128, 512, 128, 1.5f);
+	CHECK(plain.getResampler().getNumCutoffs() == 1);
+	REQUIRE(shifting.getResampler().getNumCutoffs() > 1);
+
+	const int numTableFills = shifting.getResampler().getNumTableFills();
+	for (float factor = kMinFormantFactor; factor <= kMaxFormantFactor; factor += 0.01f)
+		shifting.setFormantFactor(factor);
+	CHECK(shifting.getResampler().getNumTableFills() == numTableFills);
+
+	// the highest factor has its own table, not the lowest cutoff's neighbour
+	shifting.setFormantFactor(kMaxFormantFactor);
+	CHECK(shifting.getResampler().getCutoff() == 1.f / kMaxFormantFactor);
+}
+
+TEST_CASE("Granulator formant shift benchmark", "[Granulator][processTracking][formant][.benchmark]")
+{
+	constexpr int blockSize = 128;
+	constexpr float detectedPeriod = 256.0f;
+
+	Granulator granulator;
+	granulator.setGrainStorage(Granulator::GrainStorage::kReference);
+	granulator.setFormantShifting(true);
+	granulator.prepare(48000.0, blockSize, 1024, 128, 1.5f);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, 8192);
+	juce::AudioBuffer<float> sineBuffer(2, 8192);
+	BufferFiller::generateSineCycles(sineBuffer, static_cast<int>(detectedPeriod));
+	circularBuffer.pushBuffer(sineBuffer);
+	juce::AudioBuffer<float> processBuffer(2, blockSize);
+
+	for (float formantFactor : { 1.f, 1.25f })
+	{
+		granulator.setFormantFactor(formantFactor);
+		juce::int64 call = 0;
+		const std::string name = formantFactor == 1.f ? "formant factor 1, nothing resampled" : "formant factor 1.25";
+		BENCHMARK("one 128 sample stereo block, 256 sample period, " + name)
+		{
+			// a new analysis range every other block, like tracking a steady pitch, written just past the block
+			const juce::int64 analysisMark = 1024 + (call / 2 % 16) * 256;
+			const juce::int64 blockStart = 4096 + call * blockSize;
+			const juce::int64 writeMark = blockStart + blockSize;
+			processBuffer.clear();
+			granulator.processTracking(processBuffer, circularBuffer, {analysisMark - 256, analysisMark, analysisMark + 255},
+									   {writeMark - 256, writeMark, writeMark + 255},
+									   {blockStart, blockStart + blockSize - 1}, detectedPeriod, detectedPeriod);
+			call++;
+			return processBuffer.getSample(0, 0);
+		};
+		granulator.prepare(48000.0, blockSize, 1024, 128, 1.5f);
+	}
+}
@@ -7,9 +7,13 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include <catch2/generators/catch_generators.hpp>
 #include <catch2/matchers/catch_matchers_string.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <iostream>
 #include "../SOURCE/PITCH/PitchDetector.h"
 #include "../SUBMODULES/RD/SOURCE/BufferFiller.h"
+#include "../SUBMODULES/RD/SOURCE/BufferMath.h"
 
 //==============================================================================
 // Test Access Class - Provides access to private members for testing
@@ -23,6 +27,9 @@ public:
 	static int getDifferenceBufferNumChannels(const PitchDetector& pd) { return pd.differenceBuffer.getNumChannels(); }
 	static int getCmndBufferNumSamples(const PitchDetector& pd) { return pd.cmndBuffer.getNumSamples(); }
 	static int getCmndBufferNumChannels(const PitchDetector& pd) { return pd.cmndBuffer.getNumChannels(); }
+	static float getDifferenceSample(const PitchDetector& pd, int tau) { return pd.differenceBuffer.getSample(0, tau); }
+	static int getLastNumLagsSearched(const PitchDetector& pd) { return pd.mLastNumLagsSearched; }
+	static int getFFTSize(const PitchDetector& pd) { return pd.mFFT != nullptr ? pd.mFFT->getSize() : 0; }
 };
 
 //==============================================================================
@@ -132,3 +139,430 @@ TEST_CASE("PitchDetector process() detects sine wave period", "[PitchDetector][p
 	}
 }
 
+
+//==============================================================================
+// Difference engine Tests
+//==============================================================================
+
+TEST_CASE("PitchDetector FFT difference engine matches scalar BufferMath::yin_difference", "[PitchDetector][process][fft]")
+{
+	constexpr int bufferSize = 2048;
+	constexpr double sampleRate = 48000.0;
+
+	// sine plus a quieter sine at a non-harmonic period so every lag has something to compare
+	juce::AudioBuffer<float> testBuffer(1, bufferSize);
+	juce::AudioBuffer<float> partialBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(testBuffer, 200);
+	BufferFiller::generateSineCycles(partialBuffer, 67);
+	testBuffer.addFrom(0, 0, partialBuffer, 0, 0, bufferSize, 0.3f);
+
+	PitchDetector scalarDetector;
+	scalarDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kScalar);
+	scalarDetector.prepareToPlay(sampleRate, bufferSize);
+
+	PitchDetector fftDetector;
+	fftDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kFFT);
+	fftDetector.prepareToPlay(sampleRate, bufferSize);
+
+	float scalarPeriod = scalarDetector.process(testBuffer);
+	float fftPeriod = fftDetector.process(testBuffer);
+
+	SECTION("Every lag of the difference function agrees")
+	{
+		const int halfBlock = PitchDetectorTester::getHalfBlock(fftDetector);
+		int mismatchCount = 0;
+		for (int tau = 1; tau < halfBlock - 1; ++tau)
+		{
+			float expected = PitchDetectorTester::getDifferenceSample(scalarDetector, tau);
+			float actual = PitchDetectorTester::getDifferenceSample(fftDetector, tau);
+			if (actual != Catch::Approx(expected).epsilon(1.0e-3).margin(1.0e-2))
+				mismatchCount++;
+		}
+		CHECK(mismatchCount == 0);
+	}
+
+	SECTION("Both engines report the same period")
+	{
+		CHECK(fftPeriod == Catch::Approx(scalarPeriod).margin(0.01f));
+	}
+
+	SECTION("A narrower search range runs a smaller plan and still agrees")
+	{
+		CHECK(PitchDetectorTester::getFFTSize(fftDetector) == bufferSize);
+
+		scalarDetector.setSearchRange(bufferSize / 4, 1);
+		fftDetector.setSearchRange(bufferSize / 4, 1);
+		CHECK(PitchDetectorTester::getFFTSize(fftDetector) == bufferSize / 4);
+
+		scalarDetector.process(testBuffer);
+		fftDetector.process(testBuffer);
+
+		const int halfBlock = PitchDetectorTester::getHalfBlock(fftDetector);
+		int mismatchCount = 0;
+		for (int tau = 1; tau < halfBlock - 1; ++tau)
+		{
+			float expected = PitchDetectorTester::getDifferenceSample(scalarDetector, tau);
+			float actual = PitchDetectorTester::getDifferenceSample(fftDetector, tau);
+			if (actual != Catch::Approx(expected).epsilon(1.0e-3).margin(1.0e-2))
+				mismatchCount++;
+		}
+		CHECK(mismatchCount == 0);
+	}
+}
+
+TEST_CASE("PitchDetector FFT difference engine detects sine period at high sample rates", "[PitchDetector][process][fft]")
+{
+	// prepareToPlay() in the processor quadruples the detection buffer above 96k
+	constexpr int bufferSize = 8192;
+	constexpr int sinePeriod = 1024;
+
+	PitchDetector detector;
+	detector.setDifferenceEngine(PitchDetector::DifferenceEngine::kFFT);
+	detector.prepareToPlay(192000.0, bufferSize);
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	CHECK(detector.process(sineBuffer) == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+}
+
+//==============================================================================
+// processStreaming() Tests
+//==============================================================================
+
+TEST_CASE("PitchDetector processStreaming() matches a full recompute of the newest window", "[PitchDetector][processStreaming]")
+{
+	constexpr int windowBufferSize = 1024; // mHalfBlock = 512
+	constexpr int hopSize = 64;
+	constexpr int numHops = 40; // 2560 samples, past the 1024 sample warmup
+	constexpr int sinePeriod = 256;
+
+	PitchDetector detector;
+	detector.prepareToPlay(48000.0, windowBufferSize);
+
+	juce::AudioBuffer<float> signal(1, hopSize * numHops);
+	juce::AudioBuffer<float> partialBuffer(1, hopSize * numHops);
+	BufferFiller::generateSineCycles(signal, sinePeriod);
+	BufferFiller::generateSineCycles(partialBuffer, sinePeriod / 2); // a harmonic, so the window stays periodic at sinePeriod
+	signal.addFrom(0, 0, partialBuffer, 0, 0, signal.getNumSamples(), 0.25f);
+
+	juce::AudioBuffer<float> hopBuffer(1, hopSize);
+	float lastPeriod = -1.f;
+	for (int hop = 0; hop < numHops; ++hop)
+	{
+		hopBuffer.copyFrom(0, 0, signal, 0, hop * hopSize, hopSize);
+		float period = detector.processStreaming(hopBuffer);
+
+		if ((hop + 1) * hopSize < windowBufferSize)
+		{
+			CHECK(period == -1.f);
+		}
+		lastPeriod = period;
+	}
+
+	SECTION("Running sums equal d(tau) over the last mHalfBlock samples")
+	{
+		const int halfBlock = PitchDetectorTester::getHalfBlock(detector);
+		const float* x = signal.getReadPointer(0);
+		const int newest = signal.getNumSamples() - 1;
+
+		int mismatchCount = 0;
+		for (int tau = 1; tau < halfBlock; ++tau)
+		{
+			double expected = 0.0;
+			for (int k = 0; k < halfBlock; ++k)
+			{
+				double delta = (double)x[newest - k] - (double)x[newest - k - tau];
+				expected += delta * delta;
+			}
+
+			float actual = PitchDetectorTester::getDifferenceSample(detector, tau);
+			if (actual != Catch::Approx(expected).epsilon(1.0e-4).margin(1.0e-3))
+				mismatchCount++;
+		}
+		CHECK(mismatchCount == 0);
+	}
+
+	SECTION("Detects the sine period")
+	{
+		CHECK(lastPeriod == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+	}
+
+	SECTION("resetStream() requires a new warmup")
+	{
+		detector.resetStream();
+		hopBuffer.copyFrom(0, 0, signal, 0, 0, hopSize);
+		CHECK(detector.processStreaming(hopBuffer) == -1.f);
+	}
+}
+
+//==============================================================================
+// Coarse to fine search Tests
+//==============================================================================
+
+TEST_CASE("PitchDetector coarse-to-fine search stays within a sample of the full search", "[PitchDetector][process][coarseToFine]")
+{
+	constexpr int bufferSize = 2048;
+	constexpr double sampleRate = 48000.0;
+
+	// periods from the existing sine test plus the SATB extremes at 48k
+	const int factor = GENERATE(2, 4);
+	const int sinePeriod = GENERATE(54, 128, 183, 256, 388, 582);
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	PitchDetector fullDetector;
+	fullDetector.prepareToPlay(sampleRate, bufferSize);
+
+	PitchDetector coarseDetector;
+	coarseDetector.setSearchMode(PitchDetector::SearchMode::kCoarseToFine);
+	coarseDetector.setDecimationFactor(factor);
+	coarseDetector.prepareToPlay(sampleRate, bufferSize);
+
+	float fullPeriod = fullDetector.process(sineBuffer);
+	float coarsePeriod = coarseDetector.process(sineBuffer);
+
+	INFO("factor " << factor << ", period " << sinePeriod << ": full " << fullPeriod << ", coarse " << coarsePeriod
+		 << ", delta " << (coarsePeriod - fullPeriod));
+	CHECK(coarsePeriod == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+	CHECK(coarsePeriod == Catch::Approx(fullPeriod).margin(0.5f));
+}
+
+TEST_CASE("PitchDetector decimation factor waits for prepareToPlay()", "[PitchDetector][process][coarseToFine]")
+{
+	constexpr int bufferSize = 2048;
+	constexpr int sinePeriod = 183;
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	PitchDetector detector;
+	detector.setSearchMode(PitchDetector::SearchMode::kCoarseToFine);
+	detector.setTrackingEnabled(false);
+	detector.prepareToPlay(48000.0, bufferSize);
+	REQUIRE(detector.getDecimationFactor() == 4);
+
+	// coarse buffers and taps are still sized for 4, so the search keeps using it
+	detector.setDecimationFactor(2);
+	CHECK(detector.getDecimationFactor() == 4);
+	CHECK(detector.process(sineBuffer) == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+
+	detector.prepareToPlay(48000.0, bufferSize);
+	CHECK(detector.getDecimationFactor() == 2);
+	CHECK(detector.process(sineBuffer) == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+}
+
+TEST_CASE("PitchDetector search mode benchmark", "[PitchDetector][.benchmark]")
+{
+	constexpr int bufferSize = 2048;
+	constexpr int sinePeriod = 256;
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	PitchDetector scalarDetector;
+	scalarDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kScalar);
+	scalarDetector.setTrackingEnabled(false); // measure the search itself, not the tracking shortcut
+	scalarDetector.prepareToPlay(48000.0, bufferSize);
+
+	PitchDetector fftDetector;
+	fftDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kFFT);
+	fftDetector.setTrackingEnabled(false);
+	fftDetector.prepareToPlay(48000.0, bufferSize);
+
+	PitchDetector fusedDetector;
+	fusedDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kFused);
+	fusedDetector.setTrackingEnabled(false);
+	fusedDetector.prepareToPlay(48000.0, bufferSize);
+
+	PitchDetector coarse2Detector;
+	coarse2Detector.setSearchMode(PitchDetector::SearchMode::kCoarseToFine);
+	coarse2Detector.setDecimationFactor(2);
+	coarse2Detector.setTrackingEnabled(false);
+	coarse2Detector.prepareToPlay(48000.0, bufferSize);
+
+	PitchDetector coarse4Detector;
+	coarse4Detector.setSearchMode(PitchDetector::SearchMode::kCoarseToFine);
+	coarse4Detector.setDecimationFactor(4);
+	coarse4Detector.setTrackingEnabled(false);
+	coarse4Detector.prepareToPlay(48000.0, bufferSize);
+
+	// accuracy delta against the scalar reference, printed alongside the timings
+	float reference = scalarDetector.process(sineBuffer);
+	std::cout << "fft delta: " << (fftDetector.process(sineBuffer) - reference)
+			  << ", coarse 2x delta: " << (coarse2Detector.process(sineBuffer) - reference)
+			  << ", coarse 4x delta: " << (coarse4Detector.process(sineBuffer) - reference) << std::endl;
+
+	BENCHMARK("full search, scalar difference") { return scalarDetector.process(sineBuffer); };
+	BENCHMARK("full search, fft difference") { return fftDetector.process(sineBuffer); };
+	BENCHMARK("full search, fused single pass") { return fusedDetector.process(sineBuffer); };
+	BENCHMARK("coarse to fine, 2x") { return coarse2Detector.process(sineBuffer); };
+	BENCHMARK("coarse to fine, 4x") { return coarse4Detector.process(sineBuffer); };
+}
+
+//==============================================================================
+// Detect / track state machine Tests
+//==============================================================================
+
+TEST_CASE("PitchDetector tracks with a narrow lag search and falls back on loss of lock", "[PitchDetector][process][tracking]")
+{
+	constexpr int bufferSize = 2048;
+	constexpr int sinePeriod = 256;
+
+	PitchDetector detector;
+	detector.prepareToPlay(48000.0, bufferSize);
+	REQUIRE(detector.getState() == PitchDetector::State::kDetecting);
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	// first call is a full search and locks on
+	detector.process(sineBuffer);
+	REQUIRE(detector.getState() == PitchDetector::State::kTracking);
+	CHECK(PitchDetectorTester::getLastNumLagsSearched(detector) == PitchDetectorTester::getHalfBlock(detector));
+
+	SECTION("Sustained note stays locked and only searches the band")
+	{
+		float trackedPeriod = detector.process(sineBuffer);
+		CHECK(trackedPeriod == Catch::Approx(static_cast<float>(sinePeriod)).margin(1.0f));
+		CHECK(detector.getState() == PitchDetector::State::kTracking);
+
+		// 0.2 band around 256 is ~105 lags, vs 1024 for the full search
+		CHECK(PitchDetectorTester::getLastNumLagsSearched(detector) * 8 < PitchDetectorTester::getHalfBlock(detector));
+	}
+
+	SECTION("A jump outside the band falls back to the full search")
+	{
+		juce::AudioBuffer<float> higherSine(1, bufferSize);
+		BufferFiller::generateSineCycles(higherSine, 128);
+
+		float newPeriod = detector.process(higherSine);
+		CHECK(newPeriod == Catch::Approx(128.0f).margin(1.0f));
+		CHECK(detector.getState() == PitchDetector::State::kTracking);
+		CHECK(PitchDetectorTester::getLastNumLagsSearched(detector) == PitchDetectorTester::getHalfBlock(detector));
+	}
+
+	SECTION("Silence loses lock")
+	{
+		juce::AudioBuffer<float> silence(1, bufferSize);
+		silence.clear();
+
+		detector.process(silence);
+		CHECK(detector.getState() == PitchDetector::State::kDetecting);
+	}
+
+	SECTION("Disabling tracking always runs the full search")
+	{
+		detector.setTrackingEnabled(false);
+		detector.process(sineBuffer);
+		CHECK(PitchDetectorTester::getLastNumLagsSearched(detector) == PitchDetectorTester::getHalfBlock(detector));
+	}
+}
+
+TEST_CASE("PitchDetector tracking benchmark", "[PitchDetector][tracking][.benchmark]")
+{
+	constexpr int bufferSize = 2048;
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, 256);
+
+	PitchDetector detectingOnly;
+	detectingOnly.setDifferenceEngine(PitchDetector::DifferenceEngine::kScalar);
+	detectingOnly.setTrackingEnabled(false);
+	detectingOnly.prepareToPlay(48000.0, bufferSize);
+
+	PitchDetector tracking;
+	tracking.setDifferenceEngine(PitchDetector::DifferenceEngine::kScalar);
+	tracking.prepareToPlay(48000.0, bufferSize);
+	tracking.process(sineBuffer); // lock on
+
+	BENCHMARK("sustained note, full search every call") { return detectingOnly.process(sineBuffer); };
+	BENCHMARK("sustained note, tracking") { return tracking.process(sineBuffer); };
+}
+
+//==============================================================================
+// Fused kernel Tests
+//==============================================================================
+
+TEST_CASE("PitchDetector fused kernel matches the multi-pass scalar path", "[PitchDetector][process][fused]")
+{
+	constexpr int bufferSize = 2048;
+	const int sinePeriod = GENERATE(54, 128, 256, 582);
+
+	juce::AudioBuffer<float> sineBuffer(1, bufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, sinePeriod);
+
+	PitchDetector scalarDetector;
+	scalarDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kScalar);
+	scalarDetector.prepareToPlay(48000.0, bufferSize);
+
+	PitchDetector fusedDetector;
+	fusedDetector.setDifferenceEngine(PitchDetector::DifferenceEngine::kFused);
+	fusedDetector.prepareToPlay(48000.0, bufferSize);
+
+	float scalarPeriod = scalarDetector.process(sineBuffer);
+	float fusedPeriod = fusedDetector.process(sineBuffer);
+
+	INFO("period " << sinePeriod << ": scalar " << scalarPeriod << ", fused " << fusedPeriod);
+	CHECK(fusedPeriod == Catch::Approx(scalarPeriod).margin(0.01f));
+
+	// early exit, stops just past the first dip instead of sweeping every lag
+	CHECK(PitchDetectorTester::getLastNumLagsSearched(fusedDetector) <= sinePeriod + 3);
+}
+
+//==============================================================================
+// Frequency range Tests
+//==============================================================================
+
+TEST_CASE("PitchDetector setFrequencyRange() bounds the window and the lag search", "[PitchDetector][process][frequencyRange]")
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr int capacity = 2048;
+
+	PitchDetector detector;
+	detector.prepareToPlay(sampleRate, capacity);
+	REQUIRE(detector.getWindowNumSamples() == capacity);
+
+	juce::AudioBuffer<float> sineBuffer(1, capacity);
+	sineBuffer.clear();
+	BufferFiller::generateSineCycles(sineBuffer, 128);
+
+	SECTION("Soprano window is 2x its longest period and still finds 128")
+	{
+		detector.setFrequencyRange(261.f, 880.f);
+		CHECK(detector.getWindowNumSamples() == (184 + 2) * 2);
+		CHECK(detector.getMinTau() == 54);
+		CHECK(PitchDetectorTester::getDifferenceBufferNumSamples(detector) == 186);
+
+		CHECK(detector.process(sineBuffer) == Catch::Approx(128.f).margin(1.f));
+	}
+
+	SECTION("Bass range skips lags above 261 Hz and lands on the next period")
+	{
+		detector.setFrequencyRange(82.f, 261.f);
+		CHECK(detector.getMinTau() == 183);
+
+		// 128 is out of range, the octave below is the first dip the search is allowed to see
+		CHECK(detector.process(sineBuffer) == Catch::Approx(256.f).margin(1.f));
+	}
+
+	SECTION("Higher voices search a smaller window")
+	{
+		detector.setFrequencyRange(261.f, 880.f);
+		const int sopranoWindow = detector.getWindowNumSamples();
+		detector.setFrequencyRange(82.f, 261.f);
+		const int bassWindow = detector.getWindowNumSamples();
+		CHECK(sopranoWindow < bassWindow);
+	}
+
+	SECTION("Window never grows past what prepareToPlay() allocated")
+	{
+		detector.setFrequencyRange(10.f, 880.f);
+		CHECK(detector.getWindowNumSamples() == capacity);
+
+		detector.setFrequencyRange(0.f, 0.f);
+		CHECK(detector.getWindowNumSamples() == capacity);
+		CHECK(detector.getMinTau() == 1);
+	}
+}
@@ -15,7 +15,11 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include <catch2/generators/catch_generators.hpp>
 #include "../SOURCE/PluginProcessor.h"
+#include "../SOURCE/PITCH/PitchDetector.h"
+#include "../SOURCE/GRAIN/GrainCloud.h"
+#include "../SOURCE/GRAIN/TimeStretcher.h"
 #include "../SUBMODULES/RD/SOURCE/BufferFiller.h"
 #include "../SUBMODULES/RD/SOURCE/BufferHelper.h"
 #include "../SUBMODULES/RD/TESTS/TEST_UTILS/TestUtils.h"
@@ -461,8 +465,8 @@ TEST_CASE("PluginProcessor end-to-end processBlock with sine input", "[PluginPro
 	SECTION("Output has non-zero samples when tracking with sufficient warmup")
 	{
 		// Need enough warmup for circular buffer to be fully populated
-		// CircularBuffer is 2 * pitchDetectBufferNumSamples = 2 * 1024 = 2048 samples
-		// Need 2048 / 128 = 16 blocks minimum to fill buffer
+		// CircularBuffer is at least 2 * detection capacity + lookahead + block (5440 at 48k / 128), more for cloud grains and stretching
+		// Detection only needs the newest window plus the lookahead to be filled
 		// Use 25 to be safe and ensure stable tracking
 		constexpr int warmupBlocks = 25;
 
@@ -684,3 +688,617 @@ TEST_CASE("PluginProcessor end-to-end processBlock with sine input", "[PluginPro
 		CHECK(trackingCount == testBlocks);
 	}
 }
+
+//==============================================================================
+//==============================================================================
+// STREAMING DETECTION TESTS
+//==============================================================================
+/**
+ * PitchDetector defaults to the scalar reference, the processor opts into the FFT engine for its full searches.
+ */
+TEST_CASE("PluginProcessor detects through the FFT difference engine", "[PluginProcessor][doDetection][fft]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	CHECK(PitchDetector().getDifferenceEngine() == PitchDetector::DifferenceEngine::kScalar);
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, TestConfig::blockSize);
+	REQUIRE(processor.getPitchDetector().getDifferenceEngine() == PitchDetector::DifferenceEngine::kFFT);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, TestConfig::sineBufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, TestConfig::blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	for (int callIndex = 1; callIndex <= 30; ++callIndex)
+	{
+		int sourceStartSample = ((callIndex - 1) * TestConfig::blockSize) % TestConfig::sineBufferSize;
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, sourceStartSample, TestConfig::blockSize);
+
+		processor.processBlock(processBuffer, midiBuffer);
+	}
+
+	CHECK(processor.getLastDetectedPeriod() == Catch::Approx(static_cast<float>(TestConfig::sinePeriod)).margin(1.0f));
+}
+
+/**
+ * Streaming detection only pushes the newest block of the detection range into the
+ * PitchDetector. It should land on the same period as the full-window path.
+ */
+TEST_CASE("PluginProcessor streaming detection finds sine period", "[PluginProcessor][doDetection][streaming]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	PluginProcessor processor;
+	processor.setStreamingDetection(true);
+	processor.prepareToPlay(TestConfig::sampleRate, TestConfig::blockSize);
+	REQUIRE(processor.isStreamingDetection());
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, TestConfig::sineBufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, TestConfig::blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	for (int callIndex = 1; callIndex <= 30; ++callIndex)
+	{
+		int sourceStartSample = ((callIndex - 1) * TestConfig::blockSize) % TestConfig::sineBufferSize;
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, sourceStartSample, TestConfig::blockSize);
+
+		processor.processBlock(processBuffer, midiBuffer);
+	}
+
+	CHECK(processor.getLastDetectedPeriod() == Catch::Approx(static_cast<float>(TestConfig::sinePeriod)).margin(1.0f));
+}
+
+/**
+ * Async detection hands windows to a worker and picks the results up on a later block. Blocks are paced
+ * like a host would so the worker keeps up, and correction has to get a pitch out of it.
+ */
+TEST_CASE("PluginProcessor async detection tracks a sine through processBlock", "[PluginProcessor][doDetection][async]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	constexpr int blockSize = 512;
+	constexpr int totalNumSamples = 24576;
+
+	PluginProcessor processor;
+	processor.setAsyncDetection(true);
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+	REQUIRE(processor.isAsyncDetection());
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	int numTrackingBlocks = 0;
+	for (int start = 0; start + blockSize <= totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+		processor.processBlock(processBuffer, midiBuffer);
+		if (processor.getCurrentState() == PluginProcessor::ProcessState::kTracking)
+			numTrackingBlocks++;
+
+		// about a block's worth of real time
+		juce::Thread::sleep(blockSize * 1000 / (int)TestConfig::sampleRate);
+	}
+
+	// the first few blocks are still filling the detection window
+	CHECK(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+	CHECK(numTrackingBlocks > totalNumSamples / blockSize / 2);
+	processor.releaseResources();
+}
+
+/**
+ * A 1024 sample block crosses 8 hops. The worker has room for every one of their windows, so none are
+ * dropped and the pitch still comes through.
+ */
+TEST_CASE("PluginProcessor async detection at a large block size", "[PluginProcessor][doDetection][async]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	constexpr int blockSize = 1024;
+	constexpr int totalNumSamples = 32768;
+
+	PluginProcessor processor;
+	processor.setAsyncDetection(true);
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+	REQUIRE(processor.isAsyncDetection());
+	REQUIRE(blockSize / processor.getAnalysisHopNumSamples() > 4);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	for (int start = 0; start + blockSize <= totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+		processor.processBlock(processBuffer, midiBuffer);
+		juce::Thread::sleep(blockSize * 1000 / (int)TestConfig::sampleRate);
+	}
+
+	CHECK(processor.getNumDroppedDetectionWindows() == 0);
+	CHECK(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+	processor.releaseResources();
+}
+
+//==============================================================================
+//==============================================================================
+// DETECTION SOURCE TESTS
+//==============================================================================
+/**
+ * readDetectionMono() mixes the circular buffer down to the single detection channel.
+ * Left is filled with 1.0 and right with 0.5 (or swapped), then one block is read back.
+ */
+TEST_CASE("PluginProcessor readDetectionMono() mixes down the selected source", "[PluginProcessor][doDetection][detectionSource]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, TestConfig::blockSize);
+
+	juce::MidiBuffer midiBuffer;
+	juce::AudioBuffer<float> inputBuffer(TestConfig::numChannels, TestConfig::blockSize);
+	juce::AudioBuffer<float> monoBuffer(1, TestConfig::blockSize * 2);
+
+	auto pushStereo = [&](float leftValue, float rightValue) {
+		for (int i = 0; i < 4; ++i)
+		{
+			juce::FloatVectorOperations::fill(inputBuffer.getWritePointer(0), leftValue, TestConfig::blockSize);
+			juce::FloatVectorOperations::fill(inputBuffer.getWritePointer(1), rightValue, TestConfig::blockSize);
+			processor.processBlock(inputBuffer, midiBuffer);
+		}
+	};
+
+	auto allSamplesEqual = [&](float expected) {
+		for (int i = 0; i < monoBuffer.getNumSamples(); ++i)
+			if (monoBuffer.getSample(0, i) != Catch::Approx(expected))
+				return false;
+		return true;
+	};
+
+	pushStereo(1.0f, 0.5f);
+
+	SECTION("Left")
+	{
+		processor.setDetectionSource(PluginProcessor::DetectionSource::kLeft);
+		processor.readDetectionMono(monoBuffer, 128);
+		CHECK(allSamplesEqual(1.0f));
+	}
+
+	SECTION("Mid")
+	{
+		processor.setDetectionSource(PluginProcessor::DetectionSource::kMid);
+		processor.readDetectionMono(monoBuffer, 128);
+		CHECK(allSamplesEqual(0.75f));
+	}
+
+	SECTION("Max energy picks the louder channel")
+	{
+		processor.setDetectionSource(PluginProcessor::DetectionSource::kMaxEnergy);
+		processor.readDetectionMono(monoBuffer, 128);
+		CHECK(allSamplesEqual(1.0f));
+
+		pushStereo(0.25f, 0.5f);
+		processor.readDetectionMono(monoBuffer, 4 * TestConfig::blockSize + 128);
+		CHECK(allSamplesEqual(0.5f));
+	}
+
+	SECTION("Detection source parameter drives the selection")
+	{
+		auto* param = processor.getAPVTS().getParameter("detection source");
+		REQUIRE(param != nullptr);
+		param->setValueNotifyingHost(param->convertTo0to1(2.0f));
+		CHECK(processor.getDetectionSource() == PluginProcessor::DetectionSource::kMaxEnergy);
+	}
+}
+
+//==============================================================================
+//==============================================================================
+// VOICE RANGE TESTS
+//==============================================================================
+/**
+ * "voice range" shrinks the detection window to 2x the longest period of the preset.
+ * The change is picked up at the top of the next processBlock().
+ */
+TEST_CASE("PluginProcessor voice range sizes the detection window", "[PluginProcessor][doDetection][voiceRange]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, TestConfig::blockSize);
+
+	// Full uses the whole analysis window, 1024 at 48k by default
+	CHECK(processor.getDetectionWindowNumSamples() == MagicNumbers::minDetectionSize);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, TestConfig::sineBufferSize);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, TestConfig::blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	auto runBlocks = [&](int numBlocks)
+	{
+		for (int callIndex = 1; callIndex <= numBlocks; ++callIndex)
+		{
+			int sourceStartSample = ((callIndex - 1) * TestConfig::blockSize) % TestConfig::sineBufferSize;
+			for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+				processBuffer.copyFrom(ch, 0, sineBuffer, ch, sourceStartSample, TestConfig::blockSize);
+
+			processor.processBlock(processBuffer, midiBuffer);
+		}
+	};
+
+	auto* param = processor.getAPVTS().getParameter("voice range");
+	REQUIRE(param != nullptr);
+
+	SECTION("Soprano is smaller than Bass")
+	{
+		param->setValueNotifyingHost(param->convertTo0to1(2.0f)); // Soprano
+		runBlocks(1);
+		const int sopranoWindow = processor.getDetectionWindowNumSamples();
+
+		param->setValueNotifyingHost(param->convertTo0to1(5.0f)); // Bass
+		runBlocks(1);
+		const int bassWindow = processor.getDetectionWindowNumSamples();
+
+		CHECK(sopranoWindow == (184 + 2) * 2);
+		CHECK(sopranoWindow < bassWindow);
+	}
+
+	SECTION("Tenor still finds the sine period")
+	{
+		param->setValueNotifyingHost(param->convertTo0to1(4.0f)); // Tenor, 123 - 392 Hz
+		runBlocks(30);
+
+		CHECK(processor.getLastDetectedPeriod() == Catch::Approx(static_cast<float>(TestConfig::sinePeriod)).margin(1.0f));
+	}
+
+	SECTION("Back to Full restores the original window")
+	{
+		param->setValueNotifyingHost(param->convertTo0to1(2.0f));
+		runBlocks(1);
+		param->setValueNotifyingHost(param->convertTo0to1(0.0f));
+		runBlocks(1);
+
+		CHECK(processor.getDetectionWindowNumSamples() == MagicNumbers::minDetectionSize);
+	}
+}
+
+//==============================================================================
+//==============================================================================
+// ANALYSIS HOP TESTS
+//==============================================================================
+/**
+ * Detection runs on a fixed hop in ms, so the number of detections per second of audio and the window
+ * size are the same whatever block size the host picks, streaming or not.
+ */
+TEST_CASE("PluginProcessor detection hop doesn't depend on host block size", "[PluginProcessor][doDetection][analysisHop]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	const int blockSize = GENERATE(32, 128, 512, 2048);
+	const bool streaming = GENERATE(false, true);
+	constexpr int totalNumSamples = 16384;
+
+	PluginProcessor processor;
+	processor.setStreamingDetection(streaming);
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+
+	// defaults are 1024 / 128 samples at 48k
+	CHECK(processor.getDetectionWindowNumSamples() == MagicNumbers::minDetectionSize);
+	const int hopNumSamples = processor.getAnalysisHopNumSamples();
+	CHECK(hopNumSamples == 128);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	int totalDetections = 0;
+	for (int start = 0; start < totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+
+		processor.processBlock(processBuffer, midiBuffer);
+		totalDetections += processor.getNumDetectionsLastBlock();
+
+		// the first block runs one, then 2048 sample blocks run all 16 of their hops and 32 sample blocks mostly none
+		if (start == 0 || blockSize < hopNumSamples)
+			CHECK(processor.getNumDetectionsLastBlock() <= 1);
+		else
+			CHECK(processor.getNumDetectionsLastBlock() == blockSize / hopNumSamples);
+	}
+
+	INFO("Block size: " << blockSize << ", streaming: " << streaming);
+	// first hop lines up with the first block's detection end, one per hop from there
+	CHECK(totalDetections == Catch::Approx((double)totalNumSamples / hopNumSamples).margin((double)blockSize / hopNumSamples + 1.0));
+	CHECK(processor.getLastDetectedPeriod() == Catch::Approx(static_cast<float>(TestConfig::sinePeriod)).margin(1.0f));
+}
+
+/**
+ * A block spanning several hops marks every cycle its hops found, each with the period detected there,
+ * rather than one mark stretched over the whole block.
+ */
+TEST_CASE("PluginProcessor marks every cycle the hops in a long block find", "[PluginProcessor][doCorrection][analysisHop]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	constexpr int blockSize = 2048;
+	constexpr int totalNumSamples = 16384;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	int numTrackedBlocks = 0;
+	int numMarks = 0;
+	for (int start = 0; start < totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+		processor.processBlock(processBuffer, midiBuffer);
+
+		if (processor.getCurrentState() == PluginProcessor::ProcessState::kTracking)
+		{
+			numTrackedBlocks++;
+			numMarks += processor.getNumAnalysisMarksLastBlock();
+		}
+	}
+
+	// a 2048 sample block holds 8 cycles of the sine
+	REQUIRE(numTrackedBlocks > 2);
+	CHECK(numMarks >= numTrackedBlocks * (blockSize / TestConfig::sinePeriod / 2));
+	CHECK(processor.getNumDroppedGrains() == 0);
+}
+
+TEST_CASE("PluginProcessor analysis hop and window parameters", "[PluginProcessor][doDetection][analysisHop]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, TestConfig::blockSize);
+
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, TestConfig::blockSize);
+	processBuffer.clear();
+	juce::MidiBuffer midiBuffer;
+
+	SECTION("Hop is read every block")
+	{
+		auto* param = processor.getAPVTS().getParameter("analysis hop");
+		REQUIRE(param != nullptr);
+		param->setValueNotifyingHost(param->convertTo0to1(10.0f));
+		CHECK(processor.getAnalysisHopNumSamples() == 480);
+	}
+
+	SECTION("Window change is picked up at the next block")
+	{
+		auto* param = processor.getAPVTS().getParameter("analysis window");
+		REQUIRE(param != nullptr);
+		param->setValueNotifyingHost(param->convertTo0to1(40.0f));
+		processor.processBlock(processBuffer, midiBuffer);
+		CHECK(processor.getDetectionWindowNumSamples() == 1920);
+	}
+}
+
+//==============================================================================
+/**
+ * At the top shift ratio several synth marks land in one analysis period, the grain pool
+ * is sized for that so no grain gets dropped.
+ */
+TEST_CASE("PluginProcessor doesn't drop grains at the maximum shift ratio", "[PluginProcessor][doCorrection][grainCapacity]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	const int blockSize = GENERATE(128, 1024);
+	constexpr int totalNumSamples = 16384;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+
+	auto* param = processor.getAPVTS().getParameter("shift ratio");
+	REQUIRE(param != nullptr);
+	param->setValueNotifyingHost(param->convertTo0to1(MagicNumbers::maxShiftRatio));
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	for (int start = 0; start < totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+		processor.processBlock(processBuffer, midiBuffer);
+	}
+
+	INFO("Block size: " << blockSize);
+	CHECK(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+	CHECK(processor.getNumDroppedGrains() == 0);
+}
+
+TEST_CASE("PluginProcessor cloud mode emits grains without detecting", "[PluginProcessor][processBlock][cloud]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	constexpr int blockSize = TestConfig::blockSize;
+	constexpr int totalNumSamples = 16384;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+
+	auto setParameter = [&processor](const juce::String& id, float value)
+	{
+		auto* param = processor.getAPVTS().getParameter(id);
+		REQUIRE(param != nullptr);
+		param->setValueNotifyingHost(param->convertTo0to1(value));
+	};
+	setParameter("mode", 1.f);
+	setParameter("emission rate", 400.f);
+	setParameter("grain size", 50.f);
+	REQUIRE(processor.getProcessMode() == PluginProcessor::ProcessMode::kCloud);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	int numNonZeroSamples = 0;
+	for (int start = 0; start < totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+		processor.processBlock(processBuffer, midiBuffer);
+
+		CHECK(processor.getNumDetectionsLastBlock() == 0);
+		for (int i = 0; i < blockSize; ++i)
+			numNonZeroSamples += processBuffer.getSample(0, i) != 0.f ? 1 : 0;
+	}
+
+	// a grain every 120 samples
+	CHECK(processor.getGrainCloud().getNumEmittedGrains() == Catch::Approx(totalNumSamples / 120.0).margin(1.0));
+	CHECK(processor.getGrainCloud().getNumDroppedGrains() == 0);
+	CHECK(numNonZeroSamples > totalNumSamples / 2);
+
+	SECTION("Back in pitch mode detection starts over and tracks")
+	{
+		setParameter("mode", 0.f);
+		for (int start = 0; start < totalNumSamples; start += blockSize)
+		{
+			for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+				processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+			processor.processBlock(processBuffer, midiBuffer);
+		}
+		CHECK(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+		CHECK(processor.getLastDetectedPeriod() == Catch::Approx(static_cast<float>(TestConfig::sinePeriod)).margin(1.0f));
+	}
+}
+
+TEST_CASE("PluginProcessor stretch mode keeps the pitch without detecting", "[PluginProcessor][processBlock][stretch]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	constexpr int blockSize = TestConfig::blockSize;
+	constexpr int totalNumSamples = 48000;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+
+	auto setParameter = [&processor](const juce::String& id, float value)
+	{
+		auto* param = processor.getAPVTS().getParameter(id);
+		REQUIRE(param != nullptr);
+		param->setValueNotifyingHost(param->convertTo0to1(value));
+	};
+	setParameter("mode", 2.f);
+	setParameter("stretch", 0.5f);
+	REQUIRE(processor.getProcessMode() == PluginProcessor::ProcessMode::kStretch);
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	int numNonZeroSamples = 0;
+	for (int start = 0; start + blockSize <= totalNumSamples; start += blockSize)
+	{
+		for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+			processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+		processor.processBlock(processBuffer, midiBuffer);
+
+		CHECK(processor.getNumDetectionsLastBlock() == 0);
+		for (int i = 0; i < blockSize; ++i)
+			numNonZeroSamples += processBuffer.getSample(0, i) != 0.f ? 1 : 0;
+	}
+
+	const TimeStretcher& stretcher = processor.getTimeStretcher();
+	CHECK(stretcher.getStretchFactor() == Catch::Approx(0.5f));
+	CHECK(stretcher.wasLastGrainVoiced());
+	CHECK(stretcher.getLastPeriod() == Catch::Approx((float)TestConfig::sinePeriod).margin(1.0f));
+	CHECK(stretcher.getGranulator().getNumDroppedGrains() == 0);
+	CHECK(numNonZeroSamples > totalNumSamples / 2);
+
+	SECTION("Back in pitch mode detection starts over and tracks")
+	{
+		setParameter("mode", 0.f);
+		for (int start = 0; start + blockSize <= totalNumSamples / 2; start += blockSize)
+		{
+			for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+				processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+			processor.processBlock(processBuffer, midiBuffer);
+		}
+		CHECK(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+		CHECK(processor.getLastDetectedPeriod() == Catch::Approx(static_cast<float>(TestConfig::sinePeriod)).margin(1.0f));
+	}
+}
+
+TEST_CASE("PluginProcessor formant resamples grains only off 1", "[PluginProcessor][processBlock][formant]")
+{
+	TestUtils::SetupAndTeardown setupAndTeardown;
+
+	constexpr int blockSize = TestConfig::blockSize;
+	constexpr int totalNumSamples = 24000;
+
+	PluginProcessor processor;
+	processor.prepareToPlay(TestConfig::sampleRate, blockSize);
+
+	// sized for formant shifting up front, so the parameter works without another prepareToPlay()
+	REQUIRE(processor.getGranulator().isFormantShifting());
+	CHECK(processor.isFormantShiftingAvailable());
+
+	auto setParameter = [&processor](const juce::String& id, float value)
+	{
+		auto* param = processor.getAPVTS().getParameter(id);
+		REQUIRE(param != nullptr);
+		param->setValueNotifyingHost(param->convertTo0to1(value));
+	};
+
+	juce::AudioBuffer<float> sineBuffer(TestConfig::numChannels, totalNumSamples);
+	BufferFiller::generateSineCycles(sineBuffer, TestConfig::sinePeriod);
+	juce::AudioBuffer<float> processBuffer(TestConfig::numChannels, blockSize);
+	juce::MidiBuffer midiBuffer;
+
+	auto processSine = [&]()
+	{
+		for (int start = 0; start + blockSize <= totalNumSamples; start += blockSize)
+		{
+			for (int ch = 0; ch < TestConfig::numChannels; ++ch)
+				processBuffer.copyFrom(ch, 0, sineBuffer, ch, start, blockSize);
+			processor.processBlock(processBuffer, midiBuffer);
+		}
+	};
+
+	// the default leaves grains in the circular buffer
+	processSine();
+	REQUIRE(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+	CHECK(processor.getGranulator().getFormantFactor() == 1.f);
+	CHECK(processor.getGranulator().getNumResampledGrains() == 0);
+
+	// moved mid session, no prepareToPlay() in between
+	setParameter("formant", 1.25f);
+	processSine();
+	CHECK(processor.getGranulator().getFormantFactor() == Catch::Approx(1.25f).margin(1.0e-3f));
+	CHECK(processor.getGranulator().getNumResampledGrains() > 0);
+	CHECK(processor.getCurrentState() == PluginProcessor::ProcessState::kTracking);
+	CHECK(processor.getNumDroppedGrains() == 0);
+
+	float peak = 0.f;
+	for (int i = 0; i < blockSize; ++i)
+		peak = juce::jmax(peak, std::abs(processBuffer.getSample(0, i)));
+	CHECK(peak > 0.1f);
+}
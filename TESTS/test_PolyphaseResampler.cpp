@@ -0,0 +1,149 @@
+/**
+ * test_PolyphaseResampler.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for the table driven windowed sinc resampler
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <cmath>
+#include <vector>
+#include "../SOURCE/Util/PolyphaseResampler.h"
+
+namespace
+{
+	constexpr int kNumSamples = 1024;
+	constexpr int kPadding = PolyphaseResampler::kPadding;
+
+	// kNumSamples of a sine with kPadding of silence either side, sample 0 is at kPadding
+	std::vector<float> makePaddedSine(double period)
+	{
+		std::vector<float> samples((size_t)(kNumSamples + 2 * kPadding), 0.f);
+		for (int i = 0; i < kNumSamples; ++i)
+			samples[(size_t)(i + kPadding)] = (float)std::sin(juce::MathConstants<double>::twoPi * (double)i / period);
+		return samples;
+	}
+}
+
+TEST_CASE("PolyphaseResampler passes whole samples through at a cutoff of 1", "[PolyphaseResampler]")
+{
+	PolyphaseResampler resampler;
+	REQUIRE(resampler.getCutoff() == 1.f);
+
+	const auto input = makePaddedSine(37.0);
+	int mismatchCount = 0;
+	for (int i = 0; i < kNumSamples; ++i)
+	{
+		if (resampler.getSampleAt(input.data() + kPadding, (double)i) != Catch::Approx(input[(size_t)(i + kPadding)]).margin(1.0e-6f))
+			mismatchCount++;
+	}
+	CHECK(mismatchCount == 0);
+
+	// every row sums to 1, so a constant stays put between samples too
+	for (int phase = 0; phase <= PolyphaseResampler::kNumPhases; ++phase)
+	{
+		float sum = 0.f;
+		for (int tap = 0; tap < PolyphaseResampler::kNumTaps; ++tap)
+			sum += resampler.getPhase(phase)[tap];
+		CHECK(sum == Catch::Approx(1.f).margin(1.0e-5f));
+	}
+}
+
+TEST_CASE("PolyphaseResampler interpolates between samples", "[PolyphaseResampler]")
+{
+	constexpr double period = 64.0;
+	const auto input = makePaddedSine(period);
+
+	PolyphaseResampler resampler;
+	const double step = GENERATE(0.8, 1.25, 0.37);
+	CAPTURE(step);
+
+	// away from the ends, where the filter runs into the silence
+	const int numOutputs = (int)((kNumSamples - 4 * kPadding) / step);
+	std::vector<float> output((size_t)numOutputs);
+	resampler.process(input.data() + kPadding, (double)(2 * kPadding), step, output.data(), numOutputs);
+
+	int mismatchCount = 0;
+	for (int i = 0; i < numOutputs; ++i)
+	{
+		const double position = (double)(2 * kPadding) + (double)i * step;
+		const float expected = (float)std::sin(juce::MathConstants<double>::twoPi * position / period);
+		if (output[(size_t)i] != Catch::Approx(expected).margin(2.0e-3f))
+			mismatchCount++;
+	}
+	CHECK(mismatchCount == 0);
+}
+
+TEST_CASE("PolyphaseResampler cutoff band limits and only builds tables in prepare", "[PolyphaseResampler]")
+{
+	PolyphaseResampler resampler;
+	CHECK(resampler.getNumTableFills() == 1);
+	CHECK(resampler.getNumCutoffs() == 1);
+
+	// nothing lower was tabled
+	resampler.setCutoff(0.5f);
+	CHECK(resampler.getCutoff() == 1.f);
+
+	// 1, 15/16 .. 8/16
+	resampler.prepare(0.5f);
+	CHECK(resampler.getNumCutoffs() == 9);
+	CHECK(resampler.getNumTableFills() == 10);
+	CHECK(resampler.getCutoff() == 1.f);
+
+	// rounded down to a tabled cutoff, limited to the ones there are, never built here
+	resampler.setCutoff(2.f);
+	CHECK(resampler.getCutoff() == 1.f);
+	resampler.setCutoff(0.8f);
+	CHECK(resampler.getCutoff() == 0.75f);
+	resampler.setCutoff(0.1f);
+	CHECK(resampler.getCutoff() == 0.5f);
+	resampler.setCutoff(0.5f);
+	CHECK(resampler.getCutoff() == 0.5f);
+	CHECK(resampler.getNumTableFills() == 10);
+
+	// 0.8 of Nyquist is well past the cutoff, 0.1 of it well inside
+	auto measureGain = [&resampler](double period)
+	{
+		const auto input = makePaddedSine(period);
+		double sum = 0.0;
+		int numOutputs = 0;
+		for (int i = 4 * kPadding; i < kNumSamples - 4 * kPadding; ++i, ++numOutputs)
+		{
+			const float value = resampler.getSampleAt(input.data() + kPadding, (double)i + 0.5);
+			sum += (double)value * (double)value;
+		}
+		return std::sqrt(2.0 * sum / (double)numOutputs);
+	};
+
+	CHECK(measureGain(2.5) < 0.1);
+	CHECK(measureGain(20.0) == Catch::Approx(1.0).margin(0.02));
+}
+
+TEST_CASE("PolyphaseResampler benchmark", "[.benchmark][PolyphaseResampler]")
+{
+	PolyphaseResampler resampler;
+	resampler.prepare(0.5f);
+	resampler.setCutoff(0.8f);
+	const auto input = makePaddedSine(100.0);
+	std::vector<float> output(800);
+
+	BENCHMARK("800 outputs from 1000 samples, a 1.25 step")
+	{
+		resampler.process(input.data() + kPadding, 0.0, 1.25, output.data(), (int)output.size());
+		return output[0];
+	};
+
+	BENCHMARK("cutoff change")
+	{
+		resampler.setCutoff(resampler.getCutoff() == 0.75f ? 0.5f : 0.75f);
+		return resampler.getPhase(0)[0];
+	};
+
+	BENCHMARK("prepare 9 cutoffs")
+	{
+		resampler.prepare(0.5f);
+		return resampler.getPhase(0)[0];
+	};
+}
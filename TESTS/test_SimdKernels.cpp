@@ -0,0 +1,221 @@
+/**
+ * test_SimdKernels.cpp
+ * Created by Ryan Devens
+ *
+ * Every vectorized kernel is checked against SimdKernels::Scalar on each ISA this machine supports.
+ * Hidden benchmarks time each kernel per ISA, run with "[.benchmark]".
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <vector>
+#include "../SOURCE/Util/SimdKernels.h"
+#include "../SOURCE/Util/Juce_Header.h"
+
+namespace
+{
+	// odd sizes so every kernel runs its scalar tail too
+	constexpr int kWindowSize = 1021;
+	constexpr int kMaxTau = 1019;
+
+	std::vector<float> makeNoise(int numSamples, juce::int64 seed)
+	{
+		juce::Random random(seed);
+		std::vector<float> samples((size_t)numSamples);
+		for (auto& sample : samples)
+			sample = random.nextFloat() * 2.f - 1.f;
+		return samples;
+	}
+
+	// restores the default dispatch even when a CHECK fails
+	struct ScopedIsaOverride
+	{
+		explicit ScopedIsaOverride(SimdKernels::Isa isa) { SimdKernels::setIsaOverride(isa); }
+		~ScopedIsaOverride() { SimdKernels::clearIsaOverride(); }
+	};
+}
+
+TEST_CASE("SimdKernels dispatch picks a supported ISA", "[SimdKernels]")
+{
+	CHECK(SimdKernels::isIsaSupported(SimdKernels::getActiveIsa()));
+	CHECK(SimdKernels::isIsaSupported(SimdKernels::Isa::kScalar));
+
+	SECTION("Unsupported override falls back to scalar")
+	{
+		for (auto isa : { SimdKernels::Isa::kSSE2, SimdKernels::Isa::kAVX2, SimdKernels::Isa::kNEON })
+		{
+			if (SimdKernels::isIsaSupported(isa))
+				continue;
+
+			ScopedIsaOverride scopedIsa(isa);
+			CHECK(SimdKernels::getActiveIsa() == SimdKernels::Isa::kScalar);
+		}
+	}
+}
+
+TEST_CASE("SimdKernels match the scalar reference", "[SimdKernels]")
+{
+	const auto isa = GENERATE(SimdKernels::Isa::kScalar, SimdKernels::Isa::kSSE2, SimdKernels::Isa::kAVX2, SimdKernels::Isa::kNEON);
+	if (!SimdKernels::isIsaSupported(isa))
+		return; // nothing to compare on this machine
+
+	ScopedIsaOverride scopedIsa(isa);
+	REQUIRE(SimdKernels::getActiveIsa() == isa);
+	INFO("ISA: " << SimdKernels::getIsaName(isa));
+
+	const auto signal = makeNoise(kWindowSize + kMaxTau + 1, 1);
+	const auto other = makeNoise(kWindowSize, 2);
+
+	SECTION("sumSquaredDifference")
+	{
+		const float expected = SimdKernels::Scalar::sumSquaredDifference(signal.data(), other.data(), kWindowSize);
+		CHECK(SimdKernels::sumSquaredDifference(signal.data(), other.data(), kWindowSize) == Catch::Approx(expected).epsilon(1.0e-4));
+	}
+
+	SECTION("dotProduct")
+	{
+		// the long odd one, and every length a filter row could be
+		for (int n : { kWindowSize, 16, 15, 8, 7, 0 })
+		{
+			const float expected = SimdKernels::Scalar::dotProduct(signal.data(), other.data(), n);
+			CHECK(SimdKernels::dotProduct(signal.data(), other.data(), n) == Catch::Approx(expected).margin(1.0e-3));
+		}
+	}
+
+	SECTION("yinDifference and yinNormalizedDifference")
+	{
+		std::vector<float> expectedDiff((size_t)kMaxTau + 1), actualDiff((size_t)kMaxTau + 1);
+		SimdKernels::Scalar::yinDifference(signal.data(), expectedDiff.data(), kWindowSize, kMaxTau);
+		SimdKernels::yinDifference(signal.data(), actualDiff.data(), kWindowSize, kMaxTau);
+
+		std::vector<float> expectedCmnd(expectedDiff.size()), actualCmnd(expectedDiff.size());
+		SimdKernels::Scalar::yinNormalizedDifference(expectedDiff.data(), expectedCmnd.data(), (int)expectedDiff.size());
+		SimdKernels::yinNormalizedDifference(expectedDiff.data(), actualCmnd.data(), (int)expectedDiff.size());
+
+		int mismatchCount = 0;
+		for (size_t tau = 0; tau < expectedDiff.size(); ++tau)
+		{
+			if (actualDiff[tau] != Catch::Approx(expectedDiff[tau]).epsilon(1.0e-4))
+				mismatchCount++;
+			if (actualCmnd[tau] != Catch::Approx(expectedCmnd[tau]).epsilon(1.0e-4))
+				mismatchCount++;
+		}
+		CHECK(actualDiff[0] == 0.f);
+		CHECK(actualCmnd[0] == 1.f);
+		CHECK(mismatchCount == 0);
+	}
+
+	SECTION("yinNormalizedDifference of silence is all ones")
+	{
+		std::vector<float> silence(64, 0.f), cmnd(64, 0.f);
+		SimdKernels::yinNormalizedDifference(silence.data(), cmnd.data(), 64);
+		for (float value : cmnd)
+			CHECK(value == 1.f);
+	}
+
+	SECTION("multiply, add and divideWhereAbove")
+	{
+		auto expected = makeNoise(kWindowSize, 3);
+		auto actual = expected;
+
+		SimdKernels::Scalar::multiply(expected.data(), signal.data(), other.data(), kWindowSize);
+		SimdKernels::multiply(actual.data(), signal.data(), other.data(), kWindowSize);
+		CHECK(actual == expected);
+
+		SimdKernels::Scalar::add(expected.data(), signal.data(), kWindowSize);
+		SimdKernels::add(actual.data(), signal.data(), kWindowSize);
+		CHECK(actual == expected);
+
+		// half the denominators are below the floor, those samples must be left alone
+		SimdKernels::Scalar::divideWhereAbove(expected.data(), signal.data(), other.data(), 0.f, kWindowSize);
+		SimdKernels::divideWhereAbove(actual.data(), signal.data(), other.data(), 0.f, kWindowSize);
+		CHECK(actual == expected);
+	}
+
+	SECTION("guardedReciprocal and multiplyWhereNonZero")
+	{
+		// half of other is below the floor, so half the gains are 0 and those samples are kept
+		std::vector<float> expectedGain((size_t)kWindowSize), actualGain((size_t)kWindowSize);
+		SimdKernels::Scalar::guardedReciprocal(expectedGain.data(), other.data(), 0.f, kWindowSize);
+		SimdKernels::guardedReciprocal(actualGain.data(), other.data(), 0.f, kWindowSize);
+		CHECK(actualGain == expectedGain);
+
+		auto expected = makeNoise(kWindowSize, 4);
+		auto actual = expected;
+		SimdKernels::Scalar::multiplyWhereNonZero(expected.data(), signal.data(), expectedGain.data(), kWindowSize);
+		SimdKernels::multiplyWhereNonZero(actual.data(), signal.data(), actualGain.data(), kWindowSize);
+		CHECK(actual == expected);
+
+		// in place, the way the Granulator uses it
+		auto inPlace = other;
+		SimdKernels::guardedReciprocal(inPlace.data(), inPlace.data(), 0.f, kWindowSize);
+		CHECK(inPlace == expectedGain);
+	}
+}
+
+TEST_CASE("SimdKernels benchmark", "[SimdKernels][.benchmark]")
+{
+	const auto isa = GENERATE(SimdKernels::Isa::kScalar, SimdKernels::Isa::kSSE2, SimdKernels::Isa::kAVX2, SimdKernels::Isa::kNEON);
+	if (!SimdKernels::isIsaSupported(isa))
+		return; // nothing to compare on this machine
+
+	ScopedIsaOverride scopedIsa(isa);
+	const juce::String name = SimdKernels::getIsaName(isa);
+
+	// same shape as a 1024 sample detection window and a 2048 sample grain at 48k
+	constexpr int halfBlock = 512;
+	constexpr int grainSize = 2048;
+	const auto signal = makeNoise(halfBlock * 2, 1);
+	const auto window = makeNoise(grainSize, 2);
+	const auto source = makeNoise(grainSize, 3);
+	std::vector<float> diff((size_t)halfBlock), cmnd((size_t)halfBlock), dest((size_t)grainSize, 0.f), normGain((size_t)grainSize);
+	SimdKernels::Scalar::yinDifference(signal.data(), diff.data(), halfBlock, halfBlock - 1);
+
+	BENCHMARK((name + " yinDifference, 512 lags").toStdString())
+	{
+		SimdKernels::yinDifference(signal.data(), diff.data(), halfBlock, halfBlock - 1);
+		return diff[1];
+	};
+
+	BENCHMARK((name + " yinNormalizedDifference, 512 lags").toStdString())
+	{
+		SimdKernels::yinNormalizedDifference(diff.data(), cmnd.data(), halfBlock);
+		return cmnd[1];
+	};
+
+	BENCHMARK((name + " dotProduct (16 tap resampling), 2048 outputs").toStdString())
+	{
+		float sum = 0.f;
+		for (int i = 0; i + 16 <= grainSize; ++i)
+			sum += SimdKernels::dotProduct(source.data() + i, window.data(), 16);
+		return sum;
+	};
+
+	BENCHMARK((name + " multiply (grain windowing), 2048").toStdString())
+	{
+		SimdKernels::multiply(dest.data(), source.data(), window.data(), grainSize);
+		return dest[0];
+	};
+
+	BENCHMARK((name + " add (overlap-add), 2048").toStdString())
+	{
+		SimdKernels::add(dest.data(), source.data(), grainSize);
+		return dest[0];
+	};
+
+	BENCHMARK((name + " divideWhereAbove (normalization), 2048").toStdString())
+	{
+		SimdKernels::divideWhereAbove(dest.data(), source.data(), window.data(), 1.0e-6f, grainSize);
+		return dest[0];
+	};
+
+	BENCHMARK((name + " guardedReciprocal + 2 x multiplyWhereNonZero (stereo normalization), 2048").toStdString())
+	{
+		SimdKernels::guardedReciprocal(normGain.data(), window.data(), 1.0e-6f, grainSize);
+		SimdKernels::multiplyWhereNonZero(dest.data(), source.data(), normGain.data(), grainSize);
+		SimdKernels::multiplyWhereNonZero(dest.data(), window.data(), normGain.data(), grainSize);
+		return dest[0];
+	};
+}
@@ -0,0 +1,264 @@
+/**
+ * test_TimeStretcher.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for PSOLA time stretching, offline and over a bounded CircularBuffer
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../SOURCE/GRAIN/TimeStretcher.h"
+
+namespace
+{
+	constexpr double kSampleRate = 48000.0;
+	constexpr int kBlockSize = 512;
+	constexpr int kMinPeriod = 32; // 1500 Hz
+	constexpr int kMaxPeriod = 802; // 60 Hz and a couple of lags
+	constexpr int kSinePeriod = 240; // 200 Hz
+
+	void fillSine(juce::AudioBuffer<float>& buffer, juce::int64 firstSample, float amplitude = 0.5f)
+	{
+		for (int i = 0; i < buffer.getNumSamples(); ++i)
+		{
+			const double phase = juce::MathConstants<double>::twoPi * (double)(firstSample + i) / (double)kSinePeriod;
+			for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+				buffer.setSample(ch, i, amplitude * (float)std::sin(phase));
+		}
+	}
+
+	// median distance between rising zero crossings over [start, start + numSamples), so a splice doesn't move it.
+	// -1 if there are fewer than two.
+	double measurePeriod(const juce::AudioBuffer<float>& buffer, int start, int numSamples)
+	{
+		const float* x = buffer.getReadPointer(0);
+		std::vector<double> periods;
+		double lastCrossing = -1.0;
+		for (int i = start + 1; i < start + numSamples; ++i)
+		{
+			if (x[i - 1] < 0.f && x[i] >= 0.f)
+			{
+				const double crossing = (double)(i - 1) + (double)(-x[i - 1] / (x[i] - x[i - 1]));
+				if (lastCrossing >= 0.0)
+					periods.push_back(crossing - lastCrossing);
+				lastCrossing = crossing;
+			}
+		}
+		if (periods.empty())
+			return -1.0;
+		std::nth_element(periods.begin(), periods.begin() + (long)periods.size() / 2, periods.end());
+		return periods[periods.size() / 2];
+	}
+
+	double measureRms(const juce::AudioBuffer<float>& buffer, int start, int numSamples)
+	{
+		double sum = 0.0;
+		for (int i = start; i < start + numSamples; ++i)
+			sum += (double)buffer.getSample(0, i) * (double)buffer.getSample(0, i);
+		return std::sqrt(sum / (double)numSamples);
+	}
+}
+
+TEST_CASE("TimeStretcher offline changes the length and keeps the pitch", "[TimeStretcher][offline]")
+{
+	const float stretchFactor = GENERATE(0.5f, 1.f, 1.5f, 2.f);
+	CAPTURE(stretchFactor);
+
+	TimeStretcher stretcher;
+	stretcher.prepare(kSampleRate, kBlockSize, 2, kMinPeriod, kMaxPeriod, 1000.f);
+	stretcher.setStretchFactor(stretchFactor);
+
+	juce::AudioBuffer<float> input(2, 48000);
+	fillSine(input, 0);
+	juce::AudioBuffer<float> output;
+	stretcher.processOffline(input, output);
+
+	REQUIRE(output.getNumChannels() == 2);
+	REQUIRE(output.getNumSamples() == (int)std::ceil(48000.0 / stretchFactor));
+	CHECK(stretcher.getGranulator().getNumDroppedGrains() == 0);
+
+	// away from the ends, where the grains run out of input
+	const int start = output.getNumSamples() / 4;
+	const int numSamples = output.getNumSamples() / 2;
+	CHECK(measurePeriod(output, start, numSamples) == Catch::Approx((double)kSinePeriod).margin(1.0));
+	CHECK(measureRms(output, start, numSamples) == Catch::Approx(0.5 / std::sqrt(2.0)).epsilon(0.1));
+
+	int channelMismatchCount = 0;
+	for (int i = 0; i < output.getNumSamples(); ++i)
+		if (output.getSample(0, i) != output.getSample(1, i))
+			channelMismatchCount++;
+	CHECK(channelMismatchCount == 0);
+}
+
+TEST_CASE("TimeStretcher analysis advances by the period times the stretch factor", "[TimeStretcher][marks]")
+{
+	const float stretchFactor = GENERATE(0.75f, 1.5f);
+	CAPTURE(stretchFactor);
+
+	TimeStretcher stretcher;
+	stretcher.prepare(kSampleRate, kBlockSize, 2, kMinPeriod, kMaxPeriod, 1000.f);
+	stretcher.setStretchFactor(stretchFactor);
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, stretcher.getRequiredBufferSize());
+	juce::AudioBuffer<float> block(2, kBlockSize);
+
+	int numBlocksChecked = 0;
+	int mismatchCount = 0;
+	int firstNumDetections = 0;
+	double totalAnalysisAdvance = 0.0;
+	for (juce::int64 blockStart = 0; blockStart < 48000; blockStart += kBlockSize)
+	{
+		const double analysisPosition = stretcher.getAnalysisPosition();
+		const juce::int64 synthMark = stretcher.getSynthMark();
+		const int numResyncs = stretcher.getNumResyncs();
+
+		fillSine(block, blockStart);
+		circularBuffer.pushBuffer(block);
+		block.clear();
+		stretcher.process(block, circularBuffer, {blockStart, blockStart + kBlockSize - 1});
+
+		// the first grains are placed before the pitch is known all the way through the window,
+		// and a jump to stay inside the buffer moves the analysis on its own
+		if (blockStart < 4 * kBlockSize || stretcher.getNumResyncs() != numResyncs)
+		{
+			firstNumDetections = stretcher.getNumDetections();
+			totalAnalysisAdvance = 0.0;
+			continue;
+		}
+
+		const double synthAdvance = (double)(stretcher.getSynthMark() - synthMark);
+		const double analysisAdvance = stretcher.getAnalysisPosition() - analysisPosition;
+		totalAnalysisAdvance += analysisAdvance;
+		if (synthAdvance <= 0.0 || analysisAdvance != Catch::Approx(synthAdvance * stretchFactor).margin(1.0e-6))
+			mismatchCount++;
+		numBlocksChecked++;
+	}
+
+	// slowing down never catches up with a second of buffer, speeding up jumps back to the start of the input a few times
+	CHECK(numBlocksChecked > 40);
+	CHECK(mismatchCount == 0);
+	CHECK((stretcher.getNumResyncs() == 0) == (stretchFactor < 1.f));
+	CHECK(stretcher.wasLastGrainVoiced());
+	CHECK(stretcher.getLastPeriod() == kSinePeriod);
+
+	// a period detected every half of the longest period the analysis moves, not every grain
+	CHECK(stretcher.getNumDetections() - firstNumDetections <= (int)(totalAnalysisAdvance / (kMaxPeriod / 2)) + 1);
+}
+
+TEST_CASE("TimeStretcher realtime stays inside its buffer", "[TimeStretcher][realtime]")
+{
+	const float stretchFactor = GENERATE(0.5f, 2.f);
+	CAPTURE(stretchFactor);
+
+	TimeStretcher stretcher;
+	stretcher.prepare(kSampleRate, kBlockSize, 2, kMinPeriod, kMaxPeriod, 100.f);
+	stretcher.setStretchFactor(stretchFactor);
+	REQUIRE(stretcher.getMaxDelay() == 4800);
+	REQUIRE(stretcher.getMinDelay() < stretcher.getMaxDelay());
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, stretcher.getRequiredBufferSize());
+	juce::AudioBuffer<float> block(2, kBlockSize);
+	juce::AudioBuffer<float> output(2, 96000);
+	output.clear();
+
+	int outOfBoundsCount = 0;
+	for (juce::int64 blockStart = 0; blockStart + kBlockSize <= output.getNumSamples(); blockStart += kBlockSize)
+	{
+		fillSine(block, blockStart);
+		circularBuffer.pushBuffer(block);
+		block.clear();
+		stretcher.process(block, circularBuffer, {blockStart, blockStart + kBlockSize - 1});
+		for (int ch = 0; ch < 2; ++ch)
+			output.copyFrom(ch, (int)blockStart, block, ch, 0, kBlockSize);
+
+		// every grain was made inside the bounds, the last one may have moved the position a grain on since
+		const juce::int64 newestSample = blockStart + kBlockSize - 1;
+		const double analysisPosition = stretcher.getAnalysisPosition();
+		if ((double)newestSample - analysisPosition > (double)stretcher.getMaxDelay()
+			|| (double)stretcher.getSynthMark() - analysisPosition < (double)stretcher.getMinDelay() - kMaxPeriod * stretchFactor)
+			outOfBoundsCount++;
+	}
+
+	CHECK(outOfBoundsCount == 0);
+	CHECK(stretcher.getGranulator().getNumDroppedGrains() == 0);
+
+	// it kept jumping, a splice every few hundred ms, and the pitch never moved
+	CHECK(stretcher.getNumResyncs() >= 10);
+	CHECK(measurePeriod(output, 4800, 48000) == Catch::Approx((double)kSinePeriod).margin(1.0));
+	CHECK(measureRms(output, 4800, 48000) == Catch::Approx(0.5 / std::sqrt(2.0)).epsilon(0.15));
+}
+
+TEST_CASE("TimeStretcher cuts unvoiced input into fixed grains", "[TimeStretcher][unvoiced]")
+{
+	TimeStretcher stretcher;
+	stretcher.prepare(kSampleRate, kBlockSize, 1, kMinPeriod, kMaxPeriod, 1000.f);
+	stretcher.setStretchFactor(0.5f);
+
+	juce::Random random(42);
+	juce::AudioBuffer<float> input(1, 24000);
+	for (int i = 0; i < input.getNumSamples(); ++i)
+		input.setSample(0, i, random.nextFloat() - 0.5f);
+
+	juce::AudioBuffer<float> output;
+	stretcher.processOffline(input, output);
+	REQUIRE(output.getNumSamples() == 48000);
+	CHECK(stretcher.getGranulator().getNumDroppedGrains() == 0);
+
+	// still comes out at about the input level
+	const double inputRms = measureRms(input, 6000, 12000);
+	CHECK(measureRms(output, 12000, 24000) == Catch::Approx(inputRms).epsilon(0.35));
+
+	SECTION("Realtime grains are 5 ms")
+	{
+		CircularBuffer circularBuffer;
+		circularBuffer.setSize(1, stretcher.getRequiredBufferSize());
+		juce::AudioBuffer<float> block(1, kBlockSize);
+		for (juce::int64 blockStart = 0; blockStart < 8 * kBlockSize; blockStart += kBlockSize)
+		{
+			block.copyFrom(0, 0, input, 0, (int)blockStart, kBlockSize);
+			circularBuffer.pushBuffer(block);
+			stretcher.process(block, circularBuffer, {blockStart, blockStart + kBlockSize - 1});
+		}
+		CHECK_FALSE(stretcher.wasLastGrainVoiced());
+		CHECK(stretcher.getLastPeriod() == 240);
+	}
+}
+
+TEST_CASE("TimeStretcher benchmark", "[.benchmark][TimeStretcher]")
+{
+	TimeStretcher stretcher;
+	stretcher.prepare(kSampleRate, kBlockSize, 2, kMinPeriod, kMaxPeriod, 1000.f);
+	stretcher.setStretchFactor(0.8f);
+
+	juce::AudioBuffer<float> input(2, 48000);
+	fillSine(input, 0);
+	juce::AudioBuffer<float> output;
+
+	BENCHMARK("offline, one second of stereo at 0.8")
+	{
+		stretcher.processOffline(input, output);
+		return output.getSample(0, 0);
+	};
+
+	CircularBuffer circularBuffer;
+	circularBuffer.setSize(2, stretcher.getRequiredBufferSize());
+	juce::AudioBuffer<float> block(2, kBlockSize);
+	juce::int64 blockStart = 0;
+
+	BENCHMARK("realtime, one 512 sample stereo block at 0.8")
+	{
+		fillSine(block, blockStart);
+		circularBuffer.pushBuffer(block);
+		block.clear();
+		stretcher.process(block, circularBuffer, {blockStart, blockStart + kBlockSize - 1});
+		blockStart += kBlockSize;
+		return block.getSample(0, 0);
+	};
+}
@@ -0,0 +1,121 @@
+/**
+ * test_WindowCache.cpp
+ * Created by Ryan Devens
+ *
+ * Tests for the grain window table cache
+ */
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <vector>
+#include "../SOURCE/GRAIN/WindowCache.h"
+
+//==============================================================================
+// Test Access Class - Provides access to private members for testing
+//==============================================================================
+class WindowCacheTester
+{
+public:
+	static int getSlotStride(const WindowCache& cache) { return cache.mSlotStride; }
+	static int getNumHolders(const WindowCache& cache, int slot) { return cache.mSlots[(size_t)slot].numHolders; }
+};
+
+namespace
+{
+	constexpr int kSampleRate = 48000;
+	constexpr int kMaxLength = 2048;
+	constexpr int kNumSlots = 4;
+}
+
+TEST_CASE("WindowCache expands to the same values as Window", "[WindowCache]")
+{
+	const auto shape = GENERATE(Window::Shape::kHanning, Window::Shape::kNone);
+	const int length = GENERATE(200, 511, 512, 2048);
+
+	WindowCache cache;
+	cache.prepare(kMaxLength, kNumSlots);
+
+	// only half of each window is stored
+	CHECK(WindowCacheTester::getSlotStride(cache) == kMaxLength / 2 + 1);
+
+	Window window;
+	window.setSizeShapePeriod(kSampleRate, shape, length);
+
+	const int slot = cache.acquire(window, length);
+	REQUIRE(slot >= 0);
+	CHECK(cache.getLength(slot) == length);
+
+	std::vector<float> expanded((size_t)length);
+	cache.expand(slot, 0, length, expanded.data());
+
+	int mismatchCount = 0;
+	for (int i = 0; i < length; ++i)
+	{
+		if (expanded[(size_t)i] != Catch::Approx(window.getValueAtIndexInPeriod(i)).margin(0.001f))
+			mismatchCount++;
+	}
+	INFO("Length: " << length);
+	CHECK(mismatchCount == 0);
+
+	SECTION("A span in the middle matches the same span of the full expansion")
+	{
+		std::vector<float> span(100);
+		cache.expand(slot, length / 2 - 50, 100, span.data());
+		for (int i = 0; i < 100; ++i)
+			CHECK(span[(size_t)i] == expanded[(size_t)(length / 2 - 50 + i)]);
+	}
+}
+
+TEST_CASE("WindowCache reuses tables and stays bounded", "[WindowCache]")
+{
+	WindowCache cache;
+	cache.prepare(kMaxLength, kNumSlots);
+
+	Window window;
+	window.setSizeShapePeriod(kSampleRate, Window::Shape::kHanning, 512);
+
+	SECTION("Same length and shape is a hit")
+	{
+		const int first = cache.acquire(window, 512);
+		const int second = cache.acquire(window, 512);
+		CHECK(first == second);
+		CHECK(cache.getNumFills() == 1);
+		CHECK(WindowCacheTester::getNumHolders(cache, first) == 2);
+	}
+
+	SECTION("Shape is part of the key")
+	{
+		const int hanning = cache.acquire(window, 512);
+		window.setSizeShapePeriod(kSampleRate, Window::Shape::kNone, 512);
+		const int none = cache.acquire(window, 512);
+		CHECK(hanning != none);
+		CHECK(cache.getNumFills() == 2);
+	}
+
+	SECTION("Held slots are never reused, released ones are")
+	{
+		std::vector<int> slots;
+		for (int i = 0; i < kNumSlots; ++i)
+			slots.push_back(cache.acquire(window, 256 + i * 2));
+		CHECK(cache.getNumFills() == kNumSlots);
+
+		// every slot is held
+		CHECK(cache.acquire(window, 1000) == -1);
+
+		// released table is still cached until something else needs the slot
+		cache.release(slots[1]);
+		CHECK(cache.acquire(window, 258) == slots[1]);
+		CHECK(cache.getNumFills() == kNumSlots);
+
+		cache.release(slots[1]);
+		const int evicted = cache.acquire(window, 1000);
+		CHECK(evicted == slots[1]);
+		CHECK(cache.getLength(evicted) == 1000);
+	}
+
+	SECTION("Lengths past what was prepared aren't cached")
+	{
+		CHECK(cache.acquire(window, kMaxLength + 2) == -1);
+	}
+}